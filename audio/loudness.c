@@ -0,0 +1,262 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <math.h>
+#include <assert.h>
+
+#include "common/common.h"
+
+#include "chmap.h"
+#include "loudness.h"
+
+// Gating block length is 400ms, with 75% overlap between blocks.
+#define SUBBLOCKS 4
+
+// True peak detection oversamples by this factor with a polyphase FIR.
+#define TP_FACTOR 4
+#define TP_TAPS 12
+
+struct biquad {
+    double b0, b1, b2, a1, a2;
+};
+
+struct channel {
+    double weight;      // 0 means the channel is ignored (LFE)
+    double z[4];        // state of both K-weighting biquads
+    float hist[TP_TAPS * 2]; // last input samples (duplicated, see push_hist)
+    int hist_pos;
+};
+
+struct mp_loudness {
+    int rate;
+    int num_channels;
+    struct channel channels[MP_NUM_CHANNELS];
+    struct biquad shelf, highpass;
+    float tp_coeffs[TP_FACTOR][TP_TAPS];
+    double true_peak;
+
+    int subblock_size;  // 100ms in samples
+    int subblock_pos;
+    double subblock_sum;
+    double subblocks[SUBBLOCKS]; // ring buffer of the last mean squares
+    int num_subblocks;
+
+    // Mean square energy of each gating block.
+    double *blocks;
+    int num_blocks;
+};
+
+// K-weighting filter coefficients for any sample rate (same as libebur128).
+static void init_kweighting(struct mp_loudness *l)
+{
+    double f0 = 1681.974450955533;
+    double G = 3.999843853973347;
+    double Q = 0.7071752369554196;
+    double K = tan(M_PI * f0 / l->rate);
+    double Vh = pow(10.0, G / 20.0);
+    double Vb = pow(Vh, 0.4996667741545416);
+    double a0 = 1.0 + K / Q + K * K;
+    l->shelf = (struct biquad){
+        .b0 = (Vh + Vb * K / Q + K * K) / a0,
+        .b1 = 2.0 * (K * K - Vh) / a0,
+        .b2 = (Vh - Vb * K / Q + K * K) / a0,
+        .a1 = 2.0 * (K * K - 1.0) / a0,
+        .a2 = (1.0 - K / Q + K * K) / a0,
+    };
+
+    f0 = 38.13547087602444;
+    Q = 0.5003270373238773;
+    K = tan(M_PI * f0 / l->rate);
+    a0 = 1.0 + K / Q + K * K;
+    l->highpass = (struct biquad){
+        .b0 = 1.0,
+        .b1 = -2.0,
+        .b2 = 1.0,
+        .a1 = 2.0 * (K * K - 1.0) / a0,
+        .a2 = (1.0 - K / Q + K * K) / a0,
+    };
+}
+
+// Windowed sinc interpolation filter, split into TP_FACTOR phases.
+static void init_true_peak(struct mp_loudness *l)
+{
+    int taps = TP_FACTOR * TP_TAPS;
+    double center = (taps - 1) / 2.0;
+    for (int p = 0; p < TP_FACTOR; p++) {
+        double sum = 0;
+        for (int k = 0; k < TP_TAPS; k++) {
+            double x = (p + k * TP_FACTOR - center) / TP_FACTOR;
+            double sinc = fabs(x) < 1e-9 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+            double w = 0.5 - 0.5 * cos(2 * M_PI * (p + k * TP_FACTOR + 0.5) / taps);
+            l->tp_coeffs[p][k] = sinc * w;
+            sum += sinc * w;
+        }
+        for (int k = 0; k < TP_TAPS; k++)
+            l->tp_coeffs[p][k] /= sum;
+    }
+}
+
+static double channel_weight(int speaker)
+{
+    switch (speaker) {
+    case MP_SPEAKER_ID_LFE:
+    case MP_SPEAKER_ID_LFE2:
+        return 0.0;
+    case MP_SPEAKER_ID_BL:
+    case MP_SPEAKER_ID_BR:
+    case MP_SPEAKER_ID_SL:
+    case MP_SPEAKER_ID_SR:
+    case MP_SPEAKER_ID_SDL:
+    case MP_SPEAKER_ID_SDR:
+        return 1.41;
+    default:
+        return 1.0;
+    }
+}
+
+struct mp_loudness *mp_loudness_create(void *talloc_ctx, int rate,
+                                       const struct mp_chmap *channels)
+{
+    assert(rate > 0 && channels->num > 0);
+
+    struct mp_loudness *l = talloc_zero(talloc_ctx, struct mp_loudness);
+    l->rate = rate;
+    l->num_channels = channels->num;
+    for (int n = 0; n < l->num_channels; n++)
+        l->channels[n].weight = channel_weight(channels->speaker[n]);
+    l->subblock_size = MPMAX(rate / 10, 1);
+    init_kweighting(l);
+    init_true_peak(l);
+    return l;
+}
+
+static inline double biquad(const struct biquad *f, double *z, double x)
+{
+    double y = f->b0 * x + z[0];
+    z[0] = f->b1 * x - f->a1 * y + z[1];
+    z[1] = f->b2 * x - f->a2 * y;
+    return y;
+}
+
+// Sum of the squared K-weighted samples.
+static double filter_channel(struct mp_loudness *l, struct channel *c,
+                             float *src, int samples)
+{
+    double sum = 0;
+    for (int n = 0; n < samples; n++) {
+        double y = biquad(&l->shelf, &c->z[0], src[n]);
+        y = biquad(&l->highpass, &c->z[2], y);
+        sum += y * y;
+    }
+    return sum;
+}
+
+// The history is stored twice in a row, so that the TP_TAPS newest samples are
+// always contiguous at hist + hist_pos, which keeps the inner loop of
+// scan_peak() trivially vectorizable.
+static void scan_peak(struct mp_loudness *l, struct channel *c,
+                      float *src, int samples)
+{
+    float peak = l->true_peak;
+    for (int n = 0; n < samples; n++) {
+        c->hist_pos = (c->hist_pos + TP_TAPS - 1) % TP_TAPS;
+        c->hist[c->hist_pos] = c->hist[c->hist_pos + TP_TAPS] = src[n];
+        const float *h = c->hist + c->hist_pos;
+        for (int p = 0; p < TP_FACTOR; p++) {
+            float y = 0;
+            for (int k = 0; k < TP_TAPS; k++)
+                y += l->tp_coeffs[p][k] * h[k];
+            peak = MPMAX(peak, fabsf(y));
+        }
+    }
+    l->true_peak = peak;
+}
+
+static void end_subblock(struct mp_loudness *l)
+{
+    l->subblocks[l->num_subblocks % SUBBLOCKS] =
+        l->subblock_sum / l->subblock_size;
+    l->num_subblocks++;
+    l->subblock_sum = 0;
+    l->subblock_pos = 0;
+
+    if (l->num_subblocks >= SUBBLOCKS) {
+        double block = 0;
+        for (int n = 0; n < SUBBLOCKS; n++)
+            block += l->subblocks[n];
+        MP_TARRAY_APPEND(l, l->blocks, l->num_blocks, block / SUBBLOCKS);
+    }
+}
+
+// Add audio in AF_FORMAT_FLOATP, with the rate and channel layout the meter
+// was created with.
+void mp_loudness_add_planar(struct mp_loudness *l, float **planes, int samples)
+{
+    int pos = 0;
+    while (pos < samples) {
+        int len = MPMIN(samples - pos, l->subblock_size - l->subblock_pos);
+        for (int c = 0; c < l->num_channels; c++) {
+            struct channel *ch = &l->channels[c];
+            if (ch->weight > 0)
+                l->subblock_sum += ch->weight * filter_channel(l, ch, planes[c] + pos, len);
+            scan_peak(l, ch, planes[c] + pos, len);
+        }
+        pos += len;
+        l->subblock_pos += len;
+        if (l->subblock_pos == l->subblock_size)
+            end_subblock(l);
+    }
+}
+
+static double energy_to_lufs(double energy)
+{
+    return -0.691 + 10.0 * log10(energy);
+}
+
+// Mean energy of all blocks above the threshold. Returns 0 if there are none.
+static double gated_mean(struct mp_loudness *l, double threshold)
+{
+    double sum = 0;
+    int num = 0;
+    for (int n = 0; n < l->num_blocks; n++) {
+        if (l->blocks[n] > threshold) {
+            sum += l->blocks[n];
+            num++;
+        }
+    }
+    return num ? sum / num : 0;
+}
+
+// Return the gated integrated loudness in LUFS, or -INFINITY if there was not
+// enough (non-silent) audio.
+double mp_loudness_integrated(struct mp_loudness *l)
+{
+    double abs_gate = pow(10.0, (-70.0 + 0.691) / 10.0);
+    double mean = gated_mean(l, abs_gate);
+    if (mean <= 0)
+        return -INFINITY;
+    double rel_gate = mean * pow(10.0, -10.0 / 10.0);
+    mean = gated_mean(l, MPMAX(abs_gate, rel_gate));
+    return mean > 0 ? energy_to_lufs(mean) : -INFINITY;
+}
+
+// Return the linear true peak (1.0 is full scale).
+double mp_loudness_true_peak(struct mp_loudness *l)
+{
+    return l->true_peak;
+}
@@ -0,0 +1,33 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MP_AUDIO_LOUDNESS_H
+#define MP_AUDIO_LOUDNESS_H
+
+struct mp_chmap;
+
+// EBU R128 / ITU-R BS.1770 loudness meter.
+struct mp_loudness;
+
+struct mp_loudness *mp_loudness_create(void *talloc_ctx, int rate,
+                                       const struct mp_chmap *channels);
+void mp_loudness_add_planar(struct mp_loudness *l, float **planes, int samples);
+double mp_loudness_integrated(struct mp_loudness *l);
+double mp_loudness_true_peak(struct mp_loudness *l);
+
+#endif
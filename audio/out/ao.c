@@ -27,10 +27,10 @@
 #include "ao.h"
 #include "internal.h"
 #include "audio/format.h"
+#include "audio/sample_conv.h"
 
 #include "options/options.h"
 #include "options/m_config.h"
-#include "osdep/endian.h"
 #include "common/msg.h"
 #include "common/common.h"
 #include "common/global.h"
@@ -230,6 +230,10 @@ static struct ao *ao_init(bool probing, struct mpv_global *global,
     if (ao->device_buffer)
         MP_VERBOSE(ao, "device buffer: %d samples.\n", ao->device_buffer);
     ao->buffer = MPMAX(ao->device_buffer, ao->def_buffer * ao->samplerate);
+    // Untimed AOs take data as fast as it's produced, so the soft buffer only
+    // determines how much audio the player processes per iteration.
+    if (ao->untimed)
+        ao->buffer = MPMAX(ao->buffer, ao->samplerate * 2);
     ao->buffer = MPMAX(ao->buffer, 1);
 
     int align = af_format_sample_alignment(ao->format);
@@ -714,32 +718,15 @@ bool ao_need_conversion(struct ao_convert_fmt *fmt)
     return get_conv_type(fmt) != 0;
 }
 
-// The LSB is always ignored.
-#if BYTE_ORDER == BIG_ENDIAN
-#define SHIFT24(x) ((3-(x))*8)
-#else
-#define SHIFT24(x) (((x)+1)*8)
-#endif
-
 static void convert_plane(int type, void *data, int num_samples)
 {
     switch (type) {
     case 0:
         break;
     case 1: /* fall through */
-    case 2: {
-        int bytes = type == 1 ? 3 : 4;
-        for (int s = 0; s < num_samples; s++) {
-            uint32_t val = *((uint32_t *)data + s);
-            uint8_t *ptr = (uint8_t *)data + s * bytes;
-            ptr[0] = val >> SHIFT24(0);
-            ptr[1] = val >> SHIFT24(1);
-            ptr[2] = val >> SHIFT24(2);
-            if (type == 2)
-                ptr[3] = 0;
-        }
+    case 2:
+        mp_s32_to_s24(data, num_samples, type == 2);
         break;
-    }
     default:
         abort();
     }
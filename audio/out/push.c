@@ -65,6 +65,15 @@ struct ao_push_state {
     int wakeup_pipe[2];
 };
 
+static void ao_play_data(struct ao *ao);
+
+// Untimed AOs (like encoding or writing to a file) never block, so there is no
+// point in pacing them from the playthread. Write to them directly from play().
+static bool play_direct(struct ao *ao)
+{
+    return ao->untimed && !ao->stream_silence;
+}
+
 // lock must be held
 static void wakeup_playthread(struct ao *ao)
 {
@@ -248,9 +257,23 @@ static int play(struct ao *ao, void **data, int samples, int flags)
         p->still_playing = true;
         p->expected_end_time = 0;
 
-        // If we don't have new data, the decoder thread basically promises it
-        // will send new data as soon as it's available.
-        wakeup_playthread(ao);
+        if (play_direct(ao)) {
+            int left = mp_audio_buffer_samples(p->buffer);
+            while (left > 0) {
+                ao_play_data(ao);
+                int prev = left;
+                left = mp_audio_buffer_samples(p->buffer);
+                if (left == prev)
+                    break;
+            }
+            // The playthread still needs to notice EOF.
+            if (p->final_chunk)
+                wakeup_playthread(ao);
+        } else {
+            // If we don't have new data, the decoder thread basically promises
+            // it will send new data as soon as it's available.
+            wakeup_playthread(ao);
+        }
     }
     pthread_mutex_unlock(&p->lock);
     return write_samples;
@@ -401,7 +424,12 @@ static void *playthread(void *arg)
                 }
             } else {
                 // Wait until the device wants us to write more data to it.
-                if (!ao->driver->wait || ao->driver->wait(ao, &p->lock) < 0) {
+                if (play_direct(ao) && !mp_audio_buffer_samples(p->buffer)) {
+                    // play() feeds the AO; nothing to wait for.
+                    pthread_cond_wait(&p->wakeup, &p->lock);
+                } else if (!ao->driver->wait ||
+                           ao->driver->wait(ao, &p->lock) < 0)
+                {
                     // Fallback to guessing.
                     double timeout = 0;
                     if (ao->driver->get_delay)
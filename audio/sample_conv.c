@@ -0,0 +1,258 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <math.h>
+#include <string.h>
+
+#include "common/common.h"
+#include "osdep/endian.h"
+
+#include "format.h"
+#include "sample_conv.h"
+
+// The loops below are written with the channel count and sample size as
+// compile-time constants, so that compilers can unroll and vectorize them.
+
+#define GEN_INTERLEAVE(name, type, ch)                                      \
+    static void name(void *dst, void **src, int samples)                    \
+    {                                                                       \
+        type *restrict d = dst;                                             \
+        const type *restrict s[ch];                                         \
+        for (int c = 0; c < (ch); c++)                                      \
+            s[c] = src[c];                                                  \
+        for (int n = 0; n < samples; n++) {                                 \
+            for (int c = 0; c < (ch); c++)                                  \
+                d[n * (ch) + c] = s[c][n];                                  \
+        }                                                                   \
+    }
+
+#define GEN_DEINTERLEAVE(name, type, ch)                                    \
+    static void name(void **dst, void *src, int samples)                    \
+    {                                                                       \
+        const type *restrict s = src;                                       \
+        type *restrict d[ch];                                               \
+        for (int c = 0; c < (ch); c++)                                      \
+            d[c] = dst[c];                                                  \
+        for (int n = 0; n < samples; n++) {                                 \
+            for (int c = 0; c < (ch); c++)                                  \
+                d[c][n] = s[n * (ch) + c];                                  \
+        }                                                                   \
+    }
+
+#define GEN_KERNELS(ch, bits)                                               \
+    GEN_INTERLEAVE(interleave_##ch##_##bits, uint##bits##_t, ch)            \
+    GEN_DEINTERLEAVE(deinterleave_##ch##_##bits, uint##bits##_t, ch)
+
+GEN_KERNELS(2, 16)
+GEN_KERNELS(6, 16)
+GEN_KERNELS(8, 16)
+GEN_KERNELS(2, 32)
+GEN_KERNELS(6, 32)
+GEN_KERNELS(8, 32)
+GEN_KERNELS(2, 64)
+GEN_KERNELS(6, 64)
+GEN_KERNELS(8, 64)
+
+#define KERNEL_ENTRY(ch, bits) \
+    {ch, (bits) / 8, interleave_##ch##_##bits, deinterleave_##ch##_##bits}
+
+static const struct {
+    int channels, bytes;
+    void (*interleave)(void *dst, void **src, int samples);
+    void (*deinterleave)(void **dst, void *src, int samples);
+} kernels[] = {
+    KERNEL_ENTRY(2, 16),
+    KERNEL_ENTRY(6, 16),
+    KERNEL_ENTRY(8, 16),
+    KERNEL_ENTRY(2, 32),
+    KERNEL_ENTRY(6, 32),
+    KERNEL_ENTRY(8, 32),
+    KERNEL_ENTRY(2, 64),
+    KERNEL_ENTRY(6, 64),
+    KERNEL_ENTRY(8, 64),
+};
+
+static int find_kernel(int channels, int bytes)
+{
+    for (int n = 0; n < MP_ARRAY_SIZE(kernels); n++) {
+        if (kernels[n].channels == channels && kernels[n].bytes == bytes)
+            return n;
+    }
+    return -1;
+}
+
+void mp_interleave(void *dst, void **src, int channels, int samples, int bytes)
+{
+    int k = find_kernel(channels, bytes);
+    if (k >= 0) {
+        kernels[k].interleave(dst, src, samples);
+        return;
+    }
+    size_t stride = channels * (size_t)bytes;
+    for (int c = 0; c < channels; c++) {
+        uint8_t *d = (uint8_t *)dst + c * bytes;
+        uint8_t *s = src[c];
+        for (int n = 0; n < samples; n++)
+            memcpy(d + n * stride, s + n * bytes, bytes);
+    }
+}
+
+void mp_deinterleave(void **dst, void *src, int channels, int samples,
+                     int bytes)
+{
+    int k = find_kernel(channels, bytes);
+    if (k >= 0) {
+        kernels[k].deinterleave(dst, src, samples);
+        return;
+    }
+    size_t stride = channels * (size_t)bytes;
+    for (int c = 0; c < channels; c++) {
+        uint8_t *d = dst[c];
+        uint8_t *s = (uint8_t *)src + c * bytes;
+        for (int n = 0; n < samples; n++)
+            memcpy(d + n * bytes, s + n * stride, bytes);
+    }
+}
+
+static inline float s16_to_float(int16_t v)
+{
+    return v * (1.0f / (1 << 15));
+}
+
+static inline int16_t float_to_s16(float v)
+{
+    return lrintf(MPCLAMP(v * (1 << 15), INT16_MIN, INT16_MAX));
+}
+
+void mp_s16_to_float(float *dst, const int16_t *src, int num)
+{
+    for (int n = 0; n < num; n++)
+        dst[n] = s16_to_float(src[n]);
+}
+
+void mp_float_to_s16(int16_t *dst, const float *src, int num)
+{
+    for (int n = 0; n < num; n++)
+        dst[n] = float_to_s16(src[n]);
+}
+
+// The LSB is always ignored.
+#if BYTE_ORDER == BIG_ENDIAN
+#define SHIFT24(x) ((3-(x))*8)
+#else
+#define SHIFT24(x) (((x)+1)*8)
+#endif
+
+void mp_s32_to_s24(void *data, int num, bool pad_msb)
+{
+    if (pad_msb) {
+        // Same as the byte-wise conversion below, but each sample stays at
+        // its place, so it can be done on whole words.
+        uint32_t *d = data;
+        for (int n = 0; n < num; n++) {
+#if BYTE_ORDER == BIG_ENDIAN
+            d[n] &= ~(uint32_t)0xFF;
+#else
+            d[n] >>= 8;
+#endif
+        }
+        return;
+    }
+    for (int n = 0; n < num; n++) {
+        uint32_t val = *((uint32_t *)data + n);
+        uint8_t *ptr = (uint8_t *)data + n * 3;
+        ptr[0] = val >> SHIFT24(0);
+        ptr[1] = val >> SHIFT24(1);
+        ptr[2] = val >> SHIFT24(2);
+    }
+}
+
+bool mp_sample_conv_supported(int src_fmt, int dst_fmt)
+{
+    src_fmt = af_fmt_from_planar(src_fmt);
+    dst_fmt = af_fmt_from_planar(dst_fmt);
+    if (!af_fmt_is_pcm(src_fmt) || !af_fmt_is_pcm(dst_fmt))
+        return false;
+    if (src_fmt == dst_fmt)
+        return true;
+    return (src_fmt == AF_FORMAT_S16 && dst_fmt == AF_FORMAT_FLOAT) ||
+           (src_fmt == AF_FORMAT_FLOAT && dst_fmt == AF_FORMAT_S16);
+}
+
+static void convert_plane(void *dst, int dst_type, void *src, int num)
+{
+    if (dst_type == AF_FORMAT_FLOAT) {
+        mp_s16_to_float(dst, src, num);
+    } else {
+        mp_float_to_s16(dst, src, num);
+    }
+}
+
+// Scalar fallback for conversions which change both the sample type and the
+// packing. Converts a single channel.
+static void convert_strided(void *dst, int dst_type, int dst_stride,
+                            void *src, int src_stride, int num)
+{
+    if (dst_type == AF_FORMAT_FLOAT) {
+        float *d = dst;
+        const int16_t *s = src;
+        for (int n = 0; n < num; n++)
+            d[n * dst_stride] = s16_to_float(s[n * src_stride]);
+    } else {
+        int16_t *d = dst;
+        const float *s = src;
+        for (int n = 0; n < num; n++)
+            d[n * dst_stride] = float_to_s16(s[n * src_stride]);
+    }
+}
+
+void mp_sample_convert(void **dst, int dst_fmt, void **src, int src_fmt,
+                       int channels, int samples)
+{
+    int src_type = af_fmt_from_planar(src_fmt);
+    int dst_type = af_fmt_from_planar(dst_fmt);
+    bool src_planar = af_fmt_is_planar(src_fmt);
+    bool dst_planar = af_fmt_is_planar(dst_fmt);
+    int src_bytes = af_fmt_to_bytes(src_type);
+    int dst_bytes = af_fmt_to_bytes(dst_type);
+
+    if (src_planar == dst_planar) {
+        int planes = src_planar ? channels : 1;
+        int num = samples * (src_planar ? 1 : channels);
+        for (int n = 0; n < planes; n++) {
+            if (src_type == dst_type) {
+                memcpy(dst[n], src[n], num * (size_t)src_bytes);
+            } else {
+                convert_plane(dst[n], dst_type, src[n], num);
+            }
+        }
+    } else if (src_type == dst_type) {
+        if (dst_planar) {
+            mp_deinterleave(dst, src[0], channels, samples, src_bytes);
+        } else {
+            mp_interleave(dst[0], src, channels, samples, src_bytes);
+        }
+    } else {
+        for (int c = 0; c < channels; c++) {
+            void *s = src_planar ? src[c] : (uint8_t *)src[0] + c * src_bytes;
+            void *d = dst_planar ? dst[c] : (uint8_t *)dst[0] + c * dst_bytes;
+            convert_strided(d, dst_type, dst_planar ? 1 : channels,
+                            s, src_planar ? 1 : channels, samples);
+        }
+    }
+}
@@ -0,0 +1,52 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MP_AUDIO_SAMPLE_CONV_H
+#define MP_AUDIO_SAMPLE_CONV_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Fast paths for trivial sample conversions. The common channel counts and
+// sample sizes use specialized loops that compilers can vectorize.
+
+// Copy one plane per channel into a single interleaved plane. bytes is the
+// size of a single sample.
+void mp_interleave(void *dst, void **src, int channels, int samples, int bytes);
+// The inverse of mp_interleave().
+void mp_deinterleave(void **dst, void *src, int channels, int samples,
+                     int bytes);
+
+// Same conversions as libswresample.
+void mp_s16_to_float(float *dst, const int16_t *src, int num);
+void mp_float_to_s16(int16_t *dst, const float *src, int num);
+
+// In-place conversion of S32 samples to packed 24 bit samples (3 bytes), or
+// to 24 bit samples in the lower 3 bytes of 4 byte samples (pad_msb=true).
+// The LSB of the source is dropped.
+void mp_s32_to_s24(void *data, int num, bool pad_msb);
+
+// Whether mp_sample_convert() supports converting src_fmt to dst_fmt
+// (AF_FORMAT_*).
+bool mp_sample_conv_supported(int src_fmt, int dst_fmt);
+// Convert between any formats for which mp_sample_conv_supported() returns
+// true. The number of planes is 1 for packed formats, and channels for planar.
+void mp_sample_convert(void **dst, int dst_fmt, void **src, int src_fmt,
+                       int channels, int samples);
+
+#endif
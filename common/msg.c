@@ -53,6 +53,7 @@ struct mp_log_root {
     bool termosd;       // use terminal control codes for status line
     int blank_lines;    // number of lines usable by status
     int status_lines;   // number of current status lines
+    uint64_t term_lines; // number of lines printed to the terminal
     bool color;
     int verbose;
     bool really_quiet;
@@ -203,6 +204,17 @@ bool mp_msg_has_status_line(struct mpv_global *global)
     return r;
 }
 
+// Return the number of lines printed to the terminal so far, not counting
+// updates of the status line in place. Can be used to detect whether
+// something else wrote to the terminal.
+uint64_t mp_msg_get_term_lines(struct mpv_global *global)
+{
+    pthread_mutex_lock(&mp_msg_lock);
+    uint64_t r = global->log->root->term_lines;
+    pthread_mutex_unlock(&mp_msg_lock);
+    return r;
+}
+
 static void set_term_color(FILE *stream, int c)
 {
     if (c == -1) {
@@ -256,6 +268,9 @@ static void print_terminal_line(struct mp_log *log, int lev,
     if (lev != MSGL_STATUS)
         flush_status_line(root);
 
+    if (lev != MSGL_STATUS || !root->termosd)
+        root->term_lines++;
+
     if (root->color)
         set_msg_color(stream, lev);
 
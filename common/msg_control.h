@@ -2,6 +2,7 @@
 #define MP_MSG_CONTROL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 struct mpv_global;
 void mp_msg_init(struct mpv_global *global);
@@ -10,6 +11,7 @@ void mp_msg_update_msglevels(struct mpv_global *global);
 void mp_msg_force_stderr(struct mpv_global *global, bool force_stderr);
 bool mp_msg_has_status_line(struct mpv_global *global);
 bool mp_msg_has_log_file(struct mpv_global *global);
+uint64_t mp_msg_get_term_lines(struct mpv_global *global);
 
 void mp_msg_flush_status_line(struct mp_log *log);
 
@@ -162,6 +162,7 @@ struct demux_internal {
     double min_secs;
     int max_bytes;
     int max_bytes_bw;
+    int max_bytes_user;         // max_bytes as set by options
     bool seekable_cache;
 
     // At least one decoder actually requested data since init or the last seek.
@@ -2193,6 +2194,7 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         .min_secs = opts->min_secs,
         .max_bytes = opts->max_bytes,
         .max_bytes_bw = opts->max_bytes_bw,
+        .max_bytes_user = opts->max_bytes,
         .initial_state = true,
         .highest_av_pts = MP_NOPTS_VALUE,
         .seeking_in_progress = MP_NOPTS_VALUE,
@@ -2787,6 +2789,41 @@ void demux_set_stream_autoselect(struct demuxer *demuxer, bool autoselect)
     demuxer->in->autoselect = autoselect;
 }
 
+// Select all streams and start reading packets before any decoder requested
+// data, limiting the packet queue to max_bytes (if >0). This is used to warm
+// up prefetched playlist entries. Can be called from any thread, as long as
+// it's the only one accessing the demuxer. The caller is supposed to deselect
+// unwanted streams and call demux_stop_prefetch() when playback starts.
+void demux_start_prefetch(struct demuxer *demuxer, int64_t max_bytes)
+{
+    struct demux_internal *in = demuxer->in;
+    assert(demuxer == in->d_user);
+
+    for (int n = 0; n < demux_get_num_stream(demuxer); n++)
+        demuxer_select_track(demuxer, demux_get_stream(demuxer, n),
+                             MP_NOPTS_VALUE, true);
+
+    pthread_mutex_lock(&in->lock);
+    if (max_bytes > 0)
+        in->max_bytes = MPMIN(in->max_bytes_user, max_bytes);
+    in->reading = true;
+    pthread_mutex_unlock(&in->lock);
+
+    demux_start_thread(demuxer);
+}
+
+// Restore the normal packet queue limit after demux_start_prefetch().
+void demux_stop_prefetch(struct demuxer *demuxer)
+{
+    struct demux_internal *in = demuxer->in;
+    assert(demuxer == in->d_user);
+
+    pthread_mutex_lock(&in->lock);
+    in->max_bytes = in->max_bytes_user;
+    pthread_cond_signal(&in->wakeup);
+    pthread_mutex_unlock(&in->lock);
+}
+
 // This is for demuxer implementations only. demuxer_select_track() sets the
 // logical state, while this function returns the actual state (in case the
 // demuxer attempts to cache even unselected packets for track switching - this
@@ -81,6 +81,8 @@ static const int cook_fl2bps[COOK_FLAVORS] = {
 
 enum {
     MAX_NUM_LACES = 256,
+    // Track numbers below this are looked up with a direct table.
+    MAX_TRACK_LOOKUP = 1024,
 };
 
 typedef struct mkv_content_encoding {
@@ -175,6 +177,9 @@ typedef struct mkv_demuxer {
 
     mkv_track_t **tracks;
     int num_tracks;
+    // tracks_by_num[tnum] for track numbers below MAX_TRACK_LOOKUP
+    mkv_track_t **tracks_by_num;
+    int num_tracks_by_num;
 
     struct ebml_tags *tags;
 
@@ -186,6 +191,8 @@ typedef struct mkv_demuxer {
     mkv_index_t *indexes;
     size_t num_indexes;
     bool index_complete;
+    // entry with the highest filepos added by add_block_position()
+    size_t highest_index_entry;
     int index_mode;
 
     int edition_id;
@@ -788,6 +795,33 @@ static void parse_trackentry(struct demuxer *demuxer,
         track->codec_delay = entry->codec_delay / 1e9;
 
     mkv_d->tracks[mkv_d->num_tracks++] = track;
+
+    if (track->tnum >= 0 && track->tnum < MAX_TRACK_LOOKUP) {
+        if (track->tnum >= mkv_d->num_tracks_by_num) {
+            int num = track->tnum + 1;
+            mkv_d->tracks_by_num = talloc_realloc(mkv_d, mkv_d->tracks_by_num,
+                                                  mkv_track_t *, num);
+            for (int n = mkv_d->num_tracks_by_num; n < num; n++)
+                mkv_d->tracks_by_num[n] = NULL;
+            mkv_d->num_tracks_by_num = num;
+        }
+        // Like the linear search, the first track with a given number wins.
+        if (!mkv_d->tracks_by_num[track->tnum])
+            mkv_d->tracks_by_num[track->tnum] = track;
+    }
+}
+
+static mkv_track_t *find_track_by_num(struct mkv_demuxer *mkv_d, uint64_t num)
+{
+    if (num < (uint64_t)mkv_d->num_tracks_by_num)
+        return mkv_d->tracks_by_num[num];
+    if (num < MAX_TRACK_LOOKUP)
+        return NULL;
+    for (int i = 0; i < mkv_d->num_tracks; i++) {
+        if (mkv_d->tracks[i]->tnum == num)
+            return mkv_d->tracks[i];
+    }
+    return NULL;
 }
 
 static int demux_mkv_read_tracks(demuxer_t *demuxer)
@@ -848,6 +882,10 @@ static void add_block_position(demuxer_t *demuxer, struct mkv_track *track,
     }
     cue_index_add(demuxer, track->tnum, filepos, timecode, duration);
     track->last_index_entry = mkv_d->num_indexes - 1;
+
+    size_t highest = mkv_d->highest_index_entry;
+    if (highest == (size_t)-1 || filepos > mkv_d->indexes[highest].filepos)
+        mkv_d->highest_index_entry = track->last_index_entry;
 }
 
 static int demux_mkv_read_cues(demuxer_t *demuxer)
@@ -883,6 +921,9 @@ static int demux_mkv_read_cues(demuxer_t *demuxer)
     // start of the file - helps with files that miss the first index entry.)
     mkv_d->num_indexes = MPMIN(1, mkv_d->num_indexes);
     mkv_d->index_has_durations = false;
+    mkv_d->highest_index_entry = (size_t)-1;
+    for (int n = 0; n < mkv_d->num_tracks; n++)
+        mkv_d->tracks[n]->last_index_entry = (size_t)-1;
 
     for (int i = 0; i < cues.n_cue_point; i++) {
         struct ebml_cue_point *cuepoint = &cues.cue_point[i];
@@ -2030,6 +2071,7 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
     mkv_d->segment_end = end_pos;
     mkv_d->a_skip_preroll = 1;
     mkv_d->skip_to_timecode = INT64_MIN;
+    mkv_d->highest_index_entry = (size_t)-1;
 
     mp_read_option_raw(demuxer->global, "index", &m_option_type_choice,
                        &mkv_d->index_mode);
@@ -2125,23 +2167,24 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
     return 0;
 }
 
-// Read the laced block data at the current stream position (until endpos as
-// indicated by the block length field) into individual buffers.
+// Split the laced block data (size bytes at data, which points into buf) into
+// individual buffers. They reference slices of buf, so nothing is copied.
 static int demux_mkv_read_block_lacing(struct block_info *block, int type,
-                                       struct stream *s, uint64_t endpos)
+                                       AVBufferRef *buf, uint8_t *data,
+                                       size_t size)
 {
     int laces;
     uint32_t lace_size[MAX_NUM_LACES];
-
+    uint8_t *end = data + size;
+    int len;
 
     if (type == 0) {           /* no lacing */
         laces = 1;
-        lace_size[0] = endpos - stream_tell(s);
+        lace_size[0] = size;
     } else {
-        laces = stream_read_char(s);
-        if (laces < 0 || stream_tell(s) > endpos)
+        if (data >= end)
             goto error;
-        laces += 1;
+        laces = *data++ + 1;
 
         switch (type) {
         case 1: {              /* xiph lacing */
@@ -2150,39 +2193,41 @@ static int demux_mkv_read_block_lacing(struct block_info *block, int type,
                 lace_size[i] = 0;
                 uint8_t t;
                 do {
-                    t = stream_read_char(s);
-                    if (stream_eof(s) || stream_tell(s) >= endpos)
+                    if (end - data < 2)
                         goto error;
+                    t = *data++;
                     lace_size[i] += t;
                 } while (t == 0xFF);
                 total += lace_size[i];
             }
-            uint32_t rest_length = endpos - stream_tell(s);
+            uint32_t rest_length = end - data;
             lace_size[laces - 1] = rest_length - total;
             break;
         }
 
         case 2: {              /* fixed-size lacing */
-            uint32_t full_length = endpos - stream_tell(s);
+            uint32_t full_length = end - data;
             for (int i = 0; i < laces; i++)
                 lace_size[i] = full_length / laces;
             break;
         }
 
         case 3: {              /* EBML lacing */
-            uint64_t num = ebml_read_length(s);
-            if (num == EBML_UINT_INVALID || stream_tell(s) >= endpos)
+            uint64_t num = ebml_parse_length(data, end - data, &len);
+            if (len < 0 || len >= end - data)
                 goto error;
+            data += len;
 
             uint32_t total = lace_size[0] = num;
             for (int i = 1; i < laces - 1; i++) {
-                int64_t snum = ebml_read_signed_length(s);
-                if (snum == EBML_INT_INVALID || stream_tell(s) >= endpos)
+                int64_t snum = ebml_parse_signed_length(data, end - data, &len);
+                if (len < 0 || len >= end - data)
                     goto error;
+                data += len;
                 lace_size[i] = lace_size[i - 1] + snum;
                 total += lace_size[i];
             }
-            uint32_t rest_length = endpos - stream_tell(s);
+            uint32_t rest_length = end - data;
             lace_size[laces - 1] = rest_length - total;
             break;
         }
@@ -2193,23 +2238,19 @@ static int demux_mkv_read_block_lacing(struct block_info *block, int type,
     }
 
     for (int i = 0; i < laces; i++) {
-        uint32_t size = lace_size[i];
-        if (stream_tell(s) + size > endpos || size > (1 << 30))
+        uint32_t lsize = lace_size[i];
+        if (lsize > end - data || lsize > (1 << 30))
             goto error;
-        int pad = MPMAX(AV_INPUT_BUFFER_PADDING_SIZE, AV_LZO_INPUT_PADDING);
-        AVBufferRef *buf = av_buffer_alloc(size + pad);
-        if (!buf)
+        AVBufferRef *lace = av_buffer_ref(buf);
+        if (!lace)
             goto error;
-        buf->size = size;
-        if (stream_read(s, buf->data, buf->size) != buf->size) {
-            av_buffer_unref(&buf);
-            goto error;
-        }
-        memset(buf->data + buf->size, 0, pad);
-        block->laces[block->num_laces++] = buf;
+        lace->data = data;
+        lace->size = lsize;
+        block->laces[block->num_laces++] = lace;
+        data += lsize;
     }
 
-    if (stream_tell(s) != endpos)
+    if (data != end)
         goto error;
 
     return 0;
@@ -2539,55 +2580,63 @@ static int read_block(demuxer_t *demuxer, int64_t end, struct block_info *block)
     uint64_t num;
     int16_t time;
     uint64_t length;
+    int len;
 
     free_block(block);
     length = ebml_read_length(s);
     if (!length || length > 500000000 || stream_tell(s) + length > (uint64_t)end)
         return -1;
 
-    uint64_t endpos = stream_tell(s) + length;
+    uint64_t startpos = stream_tell(s);
+    uint64_t endpos = startpos + length;
     int res = -1;
 
+    // Read the whole Block element with a single read, and parse it from
+    // memory. The padding is for the last lace; see demux_mkv_decode().
+    int pad = MPMAX(AV_INPUT_BUFFER_PADDING_SIZE, AV_LZO_INPUT_PADDING);
+    AVBufferRef *buf = av_buffer_alloc(length + pad);
+    if (!buf)
+        goto exit;
+    if (stream_read(s, buf->data, length) != length)
+        goto exit;
+    memset(buf->data + length, 0, pad);
+    uint8_t *data = buf->data;
+    uint8_t *data_end = data + length;
+
     // Parse header of the Block element
     /* first byte(s): track num */
-    num = ebml_read_length(s);
-    if (num == EBML_UINT_INVALID || stream_tell(s) >= endpos)
+    num = ebml_parse_length(data, length, &len);
+    if (len < 0)
         goto exit;
+    data += len;
 
     /* time (relative to cluster time) */
-    if (stream_tell(s) + 3 > endpos)
+    if (data_end - data < 3)
         goto exit;
-    uint8_t c1 = stream_read_char(s);
-    uint8_t c2 = stream_read_char(s);
-    time = c1 << 8 | c2;
+    time = data[0] << 8 | data[1];
 
-    uint8_t header_flags = stream_read_char(s);
+    uint8_t header_flags = data[2];
+    data += 3;
 
-    block->filepos = stream_tell(s);
+    block->filepos = startpos + (data - buf->data);
 
     int lace_type = (header_flags >> 1) & 0x03;
-    if (demux_mkv_read_block_lacing(block, lace_type, s, endpos))
+    if (demux_mkv_read_block_lacing(block, lace_type, buf, data,
+                                    data_end - data))
         goto exit;
 
     if (block->simple)
         block->keyframe = header_flags & 0x80;
     block->timecode = time * mkv_d->tc_scale + mkv_d->cluster_tc;
-    for (int i = 0; i < mkv_d->num_tracks; i++) {
-        if (mkv_d->tracks[i]->tnum == num) {
-            block->track = mkv_d->tracks[i];
-            break;
-        }
-    }
+    block->track = find_track_by_num(mkv_d, num);
     if (!block->track) {
         res = 0;
         goto exit;
     }
 
-    if (stream_tell(s) != endpos)
-        goto exit;
-
     res = 1;
 exit:
+    av_buffer_unref(&buf);
     if (res <= 0)
         free_block(block);
     stream_seek(s, endpos);
@@ -2918,16 +2967,9 @@ static mkv_index_t *get_highest_index_entry(struct demuxer *demuxer)
     struct mkv_demuxer *mkv_d = demuxer->priv;
     assert(!mkv_d->index_complete); // would require separate code
 
-    mkv_index_t *index = NULL;
-    for (int n = 0; n < mkv_d->num_tracks; n++) {
-        int n_index = mkv_d->tracks[n]->last_index_entry;
-        if (n_index >= 0) {
-            mkv_index_t *index2 = &mkv_d->indexes[n_index];
-            if (!index || index2->filepos > index->filepos)
-                index = index2;
-        }
-    }
-    return index;
+    if (mkv_d->highest_index_entry == (size_t)-1)
+        return NULL;
+    return &mkv_d->indexes[mkv_d->highest_index_entry];
 }
 
 static int create_index_until(struct demuxer *demuxer, int64_t timecode)
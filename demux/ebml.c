@@ -253,7 +253,10 @@ static uint32_t ebml_parse_id(uint8_t *data, size_t data_len, int *length)
     return id;
 }
 
-static uint64_t ebml_parse_length(uint8_t *data, size_t data_len, int *length)
+// Parse an element length (or other unsigned variable length integer) from
+// memory. On success, *length is set to the number of bytes used; on error,
+// it is set to -1.
+uint64_t ebml_parse_length(uint8_t *data, size_t data_len, int *length)
 {
     *length = -1;
     uint8_t *end = data + data_len;
@@ -287,6 +290,15 @@ static uint64_t ebml_parse_length(uint8_t *data, size_t data_len, int *length)
     return r;
 }
 
+// Like ebml_parse_length(), but for a signed variable length integer.
+int64_t ebml_parse_signed_length(uint8_t *data, size_t data_len, int *length)
+{
+    uint64_t unum = ebml_parse_length(data, data_len, length);
+    if (*length < 0)
+        return EBML_INT_INVALID;
+    return unum - ((1LL << ((7 * *length) - 1)) - 1);
+}
+
 static uint64_t ebml_parse_uint(uint8_t *data, int length)
 {
     assert(length >= 0 && length <= 8);
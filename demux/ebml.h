@@ -87,6 +87,9 @@ int64_t ebml_read_int (stream_t *s);
 int ebml_read_skip(struct mp_log *log, int64_t end, stream_t *s);
 int ebml_resync_cluster(struct mp_log *log, stream_t *s);
 
+uint64_t ebml_parse_length(uint8_t *data, size_t data_len, int *length);
+int64_t ebml_parse_signed_length(uint8_t *data, size_t data_len, int *length);
+
 int ebml_read_element(struct stream *s, struct ebml_parse_ctx *ctx,
                       void *target, const struct ebml_elem_desc *desc);
 
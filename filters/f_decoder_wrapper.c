@@ -489,6 +489,9 @@ static void feed_packet(struct priv *p)
             packet->pts < start_pts - .005 && !p->has_broken_packet_pts)
             framedrop_type = 2;
 
+        if (p->public.keyframes_only)
+            framedrop_type = 3;
+
         p->decoder->control(p->decoder->f, VDCTRL_SET_FRAMEDROP, &framedrop_type);
     }
 
@@ -47,6 +47,9 @@ struct mp_decoder_wrapper {
     int attempt_framedrops; // try dropping this many frames
     int dropped_frames; // total frames _probably_ dropped
 
+    // Decode keyframes only, and skip everything else (e.g. for thumbnails).
+    bool keyframes_only;
+
     // --- for STREAM_AUDIO
 
     // Prefer spdif wrapper over real decoders.
@@ -74,7 +77,7 @@ enum dec_ctrl {
     VDCTRL_GET_HWDEC,
     VDCTRL_REINIT,
     VDCTRL_GET_BFRAMES,
-    // framedrop mode: 0=none, 1=standard, 2=hrseek
+    // framedrop mode: 0=none, 1=standard, 2=hrseek, 3=keyframes only
     VDCTRL_SET_FRAMEDROP,
 };
 
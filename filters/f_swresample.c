@@ -26,6 +26,7 @@
 #include "audio/aframe.h"
 #include "audio/fmt-conversion.h"
 #include "audio/format.h"
+#include "audio/sample_conv.h"
 #include "common/common.h"
 #include "common/av_common.h"
 #include "common/msg.h"
@@ -63,7 +64,7 @@ struct priv {
     struct mp_aframe *avrctx_fmt; // output format of avrctx
     struct mp_aframe *pool_fmt; // format used to allocate frames for avrctx output
     struct mp_aframe *pre_out_fmt; // format before final conversion
-    struct AVAudioResampleContext *avrctx_out; // for output channel reordering
+    bool direct; // trivial conversion, done with mp_sample_convert()
     struct mp_resample_opts *opts; // opts requested by the user
     // At least libswresample keeps a pointer around for this:
     int reorder_in[MP_NUM_CHANNELS];
@@ -133,9 +134,6 @@ static void close_lavrr(struct priv *p)
     if (p->avrctx)
         avresample_close(p->avrctx);
     avresample_free(&p->avrctx);
-    if (p->avrctx_out)
-        avresample_close(p->avrctx_out);
-    avresample_free(&p->avrctx_out);
 
     TA_FREEP(&p->pre_out_fmt);
     TA_FREEP(&p->avrctx_fmt);
@@ -207,8 +205,7 @@ static bool configure_lavrr(struct priv *p, bool verbose)
                af_fmt_to_str(p->out_format));
 
     p->avrctx = avresample_alloc_context();
-    p->avrctx_out = avresample_alloc_context();
-    if (!p->avrctx || !p->avrctx_out)
+    if (!p->avrctx)
         goto error;
 
     enum AVSampleFormat in_samplefmt = af_to_avformat(p->in_format);
@@ -312,7 +309,7 @@ static bool configure_lavrr(struct priv *p, bool verbose)
 
     out_ch_layout = fudge_layout_conversion(p, in_ch_layout, out_ch_layout);
 
-    // Real conversion; output is input to avrctx_out.
+    // Real conversion; output is interleaved or relabeled afterwards.
     av_opt_set_int(p->avrctx, "in_channel_layout",  in_ch_layout, 0);
     av_opt_set_int(p->avrctx, "out_channel_layout", out_ch_layout, 0);
     av_opt_set_int(p->avrctx, "in_sample_rate",     p->in_rate, 0);
@@ -320,20 +317,6 @@ static bool configure_lavrr(struct priv *p, bool verbose)
     av_opt_set_int(p->avrctx, "in_sample_fmt",      in_samplefmt, 0);
     av_opt_set_int(p->avrctx, "out_sample_fmt",     out_samplefmtp, 0);
 
-    // Just needs the correct number of channels for deplanarization.
-    struct mp_chmap fake_chmap;
-    mp_chmap_set_unknown(&fake_chmap, map_out.num);
-    uint64_t fake_out_ch_layout = mp_chmap_to_lavc_unchecked(&fake_chmap);
-    if (!fake_out_ch_layout)
-        goto error;
-    av_opt_set_int(p->avrctx_out, "in_channel_layout",  fake_out_ch_layout, 0);
-    av_opt_set_int(p->avrctx_out, "out_channel_layout", fake_out_ch_layout, 0);
-
-    av_opt_set_int(p->avrctx_out, "in_sample_fmt",      out_samplefmtp, 0);
-    av_opt_set_int(p->avrctx_out, "out_sample_fmt",     out_samplefmt, 0);
-    av_opt_set_int(p->avrctx_out, "in_sample_rate",     p->out_rate, 0);
-    av_opt_set_int(p->avrctx_out, "out_sample_rate",    p->out_rate, 0);
-
     // API has weird requirements, quoting avresample.h:
     //  * This function can only be called when the allocated context is not open.
     //  * Also, the input channel layout must have already been set.
@@ -341,7 +324,16 @@ static bool configure_lavrr(struct priv *p, bool verbose)
 
     p->is_resampling = false;
 
-    if (avresample_open(p->avrctx) < 0 || avresample_open(p->avrctx_out) < 0) {
+    // Conversions which neither resample nor remix are done without avrctx.
+    // avrctx is still opened, in case speed compensation gets enabled.
+    p->direct = p->in_rate == p->out_rate &&
+                mp_chmap_equals(&p->in_channels, &p->out_channels) &&
+                mp_sample_conv_supported(p->in_format, p->out_format) &&
+                !(p->opts->avopts && p->opts->avopts[0]);
+    if (p->direct && verbose)
+        MP_VERBOSE(p, "Using direct conversion.\n");
+
+    if (avresample_open(p->avrctx) < 0) {
         MP_ERR(p, "Cannot open Libavresample context.\n");
         goto error;
     }
@@ -428,6 +420,44 @@ static bool reorder_planes(struct mp_aframe *mpa, int *reorder,
     return true;
 }
 
+// Trivial conversion without avrctx (see configure_lavrr()).
+static struct mp_aframe *convert_direct(struct priv *p, struct mp_aframe *in,
+                                        int samples)
+{
+    struct mp_aframe *out = mp_aframe_create();
+    mp_aframe_config_copy(out, p->pre_out_fmt);
+    if (mp_aframe_pool_allocate(p->out_pool, out, samples) < 0) {
+        talloc_free(out);
+        return NULL;
+    }
+    if (samples) {
+        mp_sample_convert((void **)mp_aframe_get_data_rw(out), p->out_format,
+                          (void **)mp_aframe_get_data_ro(in), p->in_format,
+                          p->out_channels.num, samples);
+    }
+    return out;
+}
+
+// avrctx always outputs planar audio, with possibly a different channel map
+// (but the same number of channels). Return a new frame in the final format.
+static struct mp_aframe *interleave_output(struct priv *p, struct mp_aframe *in,
+                                           int samples)
+{
+    struct mp_aframe *out = mp_aframe_create();
+    mp_aframe_config_copy(out, p->pre_out_fmt);
+    if (mp_aframe_pool_allocate(p->reorder_buffer, out, samples) < 0) {
+        talloc_free(out);
+        return NULL;
+    }
+    if (samples) {
+        mp_sample_convert((void **)mp_aframe_get_data_rw(out), p->out_format,
+                          (void **)mp_aframe_get_data_ro(in),
+                          mp_aframe_get_format(in), p->out_channels.num,
+                          samples);
+    }
+    return out;
+}
+
 static int resample_frame(struct AVAudioResampleContext *r,
                           struct mp_aframe *out, struct mp_aframe *in,
                           int consume_in)
@@ -462,40 +492,39 @@ static struct mp_frame filter_resample_output(struct priv *p,
     int consume_in = in ? mp_aframe_get_size(in) : 0;
     consume_in = MPMIN(consume_in, max_in);
 
-    int samples = get_out_samples(p, consume_in);
-    out = mp_aframe_create();
-    mp_aframe_config_copy(out, p->pool_fmt);
-    if (mp_aframe_pool_allocate(p->out_pool, out, samples) < 0)
-        goto error;
-
     int out_samples = 0;
-    if (samples) {
-        out_samples = resample_frame(p->avrctx, out, in, consume_in);
-        if (out_samples < 0 || out_samples > samples)
+    if (p->direct && !p->is_resampling) {
+        out = convert_direct(p, in, consume_in);
+        if (!out)
+            goto error;
+        out_samples = consume_in;
+    } else {
+        int samples = get_out_samples(p, consume_in);
+        out = mp_aframe_create();
+        mp_aframe_config_copy(out, p->pool_fmt);
+        if (mp_aframe_pool_allocate(p->out_pool, out, samples) < 0)
             goto error;
-        mp_aframe_set_size(out, out_samples);
-    }
 
-    struct mp_chmap out_chmap;
-    if (!mp_aframe_get_chmap(p->pool_fmt, &out_chmap))
-        goto error;
-    if (!reorder_planes(out, p->reorder_out, &out_chmap))
-        goto error;
+        if (samples) {
+            out_samples = resample_frame(p->avrctx, out, in, consume_in);
+            if (out_samples < 0 || out_samples > samples)
+                goto error;
+            mp_aframe_set_size(out, out_samples);
+        }
 
-    if (!mp_aframe_config_equals(out, p->pre_out_fmt)) {
-        struct mp_aframe *new = mp_aframe_create();
-        mp_aframe_config_copy(new, p->pre_out_fmt);
-        if (mp_aframe_pool_allocate(p->reorder_buffer, new, out_samples) < 0) {
-            talloc_free(new);
+        struct mp_chmap out_chmap;
+        if (!mp_aframe_get_chmap(p->pool_fmt, &out_chmap))
             goto error;
-        }
-        int got = 0;
-        if (out_samples)
-            got = resample_frame(p->avrctx_out, new, out, out_samples);
-        talloc_free(out);
-        out = new;
-        if (got != out_samples)
+        if (!reorder_planes(out, p->reorder_out, &out_chmap))
             goto error;
+
+        if (!mp_aframe_config_equals(out, p->pre_out_fmt)) {
+            struct mp_aframe *new = interleave_output(p, out, out_samples);
+            talloc_free(out);
+            out = new;
+            if (!out)
+                goto error;
+        }
     }
 
     extra_output_conversion(out);
@@ -60,6 +60,7 @@ const struct m_obj_list af_obj_list = {
 // --vf option
 
 const struct mp_user_filter_entry *vf_list[] = {
+    &vf_dedup,
     &vf_format,
     &vf_lavfi,
     &vf_lavfi_bridge,
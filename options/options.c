@@ -226,6 +226,9 @@ const struct m_sub_options mp_subtitle_sub_opts = {
         OPT_FLAG("sub-ass-scale-with-window", ass_scale_with_window, 0),
         OPT_SUBSTRUCT("sub", sub_style, sub_style_conf, 0),
         OPT_FLAG("sub-clear-on-seek", sub_clear_on_seek, 0),
+        OPT_INTRANGE("sub-prerender", sub_prerender, 0, 0, VO_MAX_REQ_FRAMES - 1),
+        OPT_CHOICE("sub-prune-events", sub_prune_events, 0,
+                   ({"auto", -1}, {"no", 0}, {"yes", 1})),
         OPT_INTRANGE("teletext-page", teletext_page, 0, 1, 999),
         {0}
     },
@@ -248,6 +251,7 @@ const struct m_sub_options mp_subtitle_sub_opts = {
         .ass_style_override = 1,
         .ass_shaper = 1,
         .use_embedded_fonts = 1,
+        .sub_prune_events = -1,
     },
     .change_flags = UPDATE_OSD,
 };
@@ -462,6 +466,10 @@ const m_option_t mp_opts[] = {
     OPT_STRING("sub-demuxer", sub_demuxer_name, 0),
     OPT_FLAG("demuxer-thread", demuxer_thread, 0),
     OPT_FLAG("prefetch-playlist", prefetch_open, 0),
+    OPT_INTRANGE("prefetch-playlist-entries", prefetch_entries, 0, 1, 16),
+    OPT_FLAG("prefetch-playlist-warmup", prefetch_warmup, 0),
+    OPT_BYTE_SIZE("prefetch-playlist-max-bytes", prefetch_max_bytes, 0, 0,
+                  INT_MAX),
     OPT_FLAG("cache-pause", cache_pause, 0),
     OPT_FLAG("cache-pause-initial", cache_pause_initial, 0),
     OPT_FLOAT("cache-pause-wait", cache_pause_wait, M_OPT_MIN, .min = 0),
@@ -572,6 +580,9 @@ const m_option_t mp_opts[] = {
     OPT_FLOATRANGE("replaygain-preamp", rgain_preamp, UPDATE_VOL, -15, 15),
     OPT_FLAG("replaygain-clip", rgain_clip, UPDATE_VOL),
     OPT_FLOATRANGE("replaygain-fallback", rgain_fallback, UPDATE_VOL, -200, 60),
+    OPT_FLAG("replaygain-scan", rgain_scan, 0),
+    OPT_INTRANGE("replaygain-scan-ahead", rgain_scan_ahead, 0, 0, 1000),
+    OPT_INTRANGE("replaygain-scan-threads", rgain_scan_threads, 0, 1, 16),
     OPT_CHOICE("gapless-audio", gapless_audio, 0,
                ({"no", 0},
                 {"yes", 1},
@@ -700,6 +711,8 @@ const m_option_t mp_opts[] = {
     OPT_SUBSTRUCT("screenshot", screenshot_image_opts, screenshot_conf, 0),
     OPT_STRING("screenshot-template", screenshot_template, 0),
     OPT_STRING("screenshot-directory", screenshot_directory, M_OPT_FILE),
+    OPT_SUBSTRUCT("", image_writer_queue_opts, image_writer_queue_conf, 0),
+    OPT_INTRANGE("storyboard-threads", storyboard_threads, 0, 1, 64),
 
     OPT_STRING("record-file", record_file, M_OPT_FILE),
 
@@ -884,6 +897,8 @@ const struct MPOpts mp_default_opts = {
     .softvol_max = 130,
     .softvol_volume = 100,
     .softvol_mute = 0,
+    .rgain_scan_ahead = 2,
+    .rgain_scan_threads = 1,
     .gapless_audio = -1,
     .audio_buffer = 0.2,
     .audio_device = "auto",
@@ -915,6 +930,8 @@ const struct MPOpts mp_default_opts = {
     .position_resume = 1,
     .autoload_files = 1,
     .demuxer_thread = 1,
+    .prefetch_entries = 1,
+    .prefetch_max_bytes = 16 * 1024 * 1024,
     .hls_bitrate = INT_MAX,
     .cache_pause = 1,
     .cache_pause_wait = 1.0,
@@ -951,6 +968,7 @@ const struct MPOpts mp_default_opts = {
     .audiofile_auto = -1,
     .osd_bar_visible = 1,
     .screenshot_template = "mpv-shot%n",
+    .storyboard_threads = 4,
 
     .hwdec_api = HAVE_RPI ? "mmal" : "no",
     .hwdec_codecs = "h264,vc1,wmv3,hevc,mpeg2video,vp9",
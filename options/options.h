@@ -105,6 +105,8 @@ struct mp_subtitle_opts {
     int ass_shaper;
     int ass_justify;
     int sub_clear_on_seek;
+    int sub_prerender;
+    int sub_prune_events;
     int teletext_page;
 };
 
@@ -157,6 +159,9 @@ typedef struct MPOpts {
     float rgain_preamp;         // Set replaygain pre-amplification
     int rgain_clip;             // Enable/disable clipping prevention
     float rgain_fallback;
+    int rgain_scan;
+    int rgain_scan_ahead;
+    int rgain_scan_threads;
     int softvol_mute;
     float softvol_max;
     int gapless_audio;
@@ -262,6 +267,9 @@ typedef struct MPOpts {
     char *demuxer_name;
     int demuxer_thread;
     int prefetch_open;
+    int prefetch_entries;
+    int prefetch_warmup;
+    int64_t prefetch_max_bytes;
     char *audio_demuxer_name;
     char *sub_demuxer_name;
 
@@ -272,6 +280,8 @@ typedef struct MPOpts {
     struct image_writer_opts *screenshot_image_opts;
     char *screenshot_template;
     char *screenshot_directory;
+    struct image_writer_queue_opts *image_writer_queue_opts;
+    int storyboard_threads;
 
     double force_fps;
     int index_mode;
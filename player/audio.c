@@ -119,6 +119,8 @@ static float compute_replaygain(struct MPContext *mpctx)
     struct track *track = mpctx->current_track[0][STREAM_AUDIO];
     if (track)
         rg = track->stream->codec->replaygain_data;
+    if (track && !rg && track->demuxer == mpctx->demuxer)
+        rg = mpctx->scanned_rgain;
     if (opts->rgain_mode && rg) {
         MP_VERBOSE(mpctx, "Replaygain: Track=%f/%f Album=%f/%f\n",
                    rg->track_gain, rg->track_peak,
@@ -565,6 +567,9 @@ static int write_to_ao(struct MPContext *mpctx, uint8_t **planes, int samples,
         mpctx->shown_aframes += played;
         mpctx->delay += played / real_samplerate;
         mpctx->written_audio += played / (double)samplerate;
+        // Don't wait for the AO to ask for more data; it takes everything.
+        if (mpctx->offline)
+            mp_wakeup_core(mpctx);
         return played;
     }
     return 0;
@@ -705,6 +710,9 @@ static bool copy_output(struct MPContext *mpctx, struct ao_chain *ao_c,
             return false;
         }
 
+        // (Possibly left partially written by write_direct().)
+        ao_c->last_out_pts = mp_aframe_end_pts(ao_c->output_frame);
+
         if (cursamples + mp_aframe_get_size(ao_c->output_frame) > maxsamples) {
             if (cursamples < maxsamples) {
                 uint8_t **data = mp_aframe_get_data_ro(ao_c->output_frame);
@@ -725,6 +733,65 @@ static bool copy_output(struct MPContext *mpctx, struct ao_chain *ao_c,
     return true;
 }
 
+// Write filtered frames straight to the AO, instead of copying them to
+// ao_c->ao_buffer first. This is possible in the steady state only, when no
+// samples need to be skipped, inserted, or cut off at the end. Frames which the
+// AO did not fully accept are kept in ao_c->output_frame.
+// Returns the number of samples written, or -1 if the normal path must be
+// used (EOF, format changes).
+static int write_direct(struct MPContext *mpctx, int playsize)
+{
+    struct ao_chain *ao_c = mpctx->ao_chain;
+
+    int ao_rate;
+    int ao_format;
+    struct mp_chmap ao_channels;
+    ao_get_format(ao_c->ao, &ao_rate, &ao_format, &ao_channels);
+
+    int written = 0;
+    while (written < playsize) {
+        if (!ao_c->output_frame || !mp_aframe_get_size(ao_c->output_frame)) {
+            TA_FREEP(&ao_c->output_frame);
+
+            struct mp_frame frame = mp_pin_out_read(ao_c->filter->f->pins[1]);
+            if (frame.type == MP_FRAME_AUDIO) {
+                ao_c->output_frame = frame.data;
+                ao_c->out_eof = false;
+            } else if (frame.type == MP_FRAME_EOF) {
+                ao_c->out_eof = true;
+                return -1;
+            } else if (frame.type) {
+                MP_ERR(mpctx, "unknown frame type\n");
+                mp_frame_unref(&frame);
+            }
+        }
+
+        if (!ao_c->output_frame)
+            return ao_c->filter->ao_needs_update ? -1 : written;
+
+        // Can happen only if the AO is going to be reinitialized.
+        struct mp_chmap channels = {0};
+        mp_aframe_get_chmap(ao_c->output_frame, &channels);
+        if (mp_aframe_get_format(ao_c->output_frame) != ao_format ||
+            mp_aframe_get_rate(ao_c->output_frame) != ao_rate ||
+            !mp_chmap_equals(&channels, &ao_channels))
+            return -1;
+
+        uint8_t **data = mp_aframe_get_data_ro(ao_c->output_frame);
+        int samples = MPMIN(mp_aframe_get_size(ao_c->output_frame),
+                            playsize - written);
+        int played = write_to_ao(mpctx, data, samples, 0);
+        assert(played >= 0 && played <= samples);
+        mp_aframe_skip_samples(ao_c->output_frame, played);
+        // Unlike copy_output(), the frame can remain partially written.
+        ao_c->last_out_pts = mp_aframe_get_pts(ao_c->output_frame);
+        written += played;
+        if (played < samples)
+            break;
+    }
+    return written;
+}
+
 /* Try to get at least minsamples decoded+filtered samples in outbuf
  * (total length including possible existing data).
  * Return 0 on success, or negative AD_* error code.
@@ -818,7 +885,7 @@ void fill_audio_out_buffers(struct MPContext *mpctx)
         return; // try again next iteration
     }
 
-    if (ao_c->ao_resume_time > mp_time_sec()) {
+    if (ao_c->ao_resume_time > mp_time_sec() && !mpctx->offline) {
         double remaining = ao_c->ao_resume_time - mp_time_sec();
         mp_set_timeout(mpctx, remaining);
         return;
@@ -875,6 +942,25 @@ void fill_audio_out_buffers(struct MPContext *mpctx)
 
     playsize = playsize / align * align;
 
+    if (mpctx->audio_status == STATUS_PLAYING && !skip && !skip_duplicate &&
+        align == 1 && !mpctx->paused &&
+        !mp_audio_buffer_samples(ao_c->ao_buffer) &&
+        get_play_end_pts(mpctx) == MP_NOPTS_VALUE)
+    {
+        int played = write_direct(mpctx, playsize);
+        if (played >= 0) {
+            mpctx->audio_drop_throttle =
+                MPMAX(0, mpctx->audio_drop_throttle - played / play_samplerate);
+            dump_audio_stats(mpctx);
+            return;
+        }
+        if (ao_c->filter->ao_needs_update) {
+            reinit_audio_filters_and_output(mpctx);
+            mp_wakeup_core(mpctx);
+            return; // retry on next iteration
+        }
+    }
+
     int status = mpctx->audio_status >= STATUS_DRAINING ? AD_EOF : AD_OK;
     bool working = false;
     if (playsize > mp_audio_buffer_samples(ao_c->ao_buffer)) {
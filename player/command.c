@@ -54,6 +54,8 @@
 #include "video/out/vo.h"
 #include "video/csputils.h"
 #include "video/hwdec.h"
+#include "video/image_writer.h"
+#include "video/mp_image_pool.h"
 #include "audio/aframe.h"
 #include "audio/format.h"
 #include "audio/out/ao.h"
@@ -2919,6 +2921,49 @@ out:
     return ret;
 }
 
+static int mp_property_image_pool_stats(void *ctx, struct m_property *prop,
+                                        int action, void *arg)
+{
+    struct mp_image_pool_stats st;
+    mp_image_pool_get_total_stats(&st);
+
+    struct m_sub_property props[] = {
+        {"hits",        SUB_PROP_INT64(st.hits)},
+        {"misses",      SUB_PROP_INT64(st.misses)},
+        {"images",      SUB_PROP_INT64(st.num_images)},
+        {"bytes",       SUB_PROP_INT64(st.bytes)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
+static int mp_property_image_writer_stats(void *ctx, struct m_property *prop,
+                                          int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct image_writer_queue_stats st;
+    image_writer_queue_get_stats(mpctx->image_writer_queue, &st);
+
+    struct m_sub_property props[] = {
+        {"written",     SUB_PROP_INT64(st.written)},
+        {"failed",      SUB_PROP_INT64(st.failed)},
+        {"dropped",     SUB_PROP_INT64(st.dropped)},
+        {"queued",      SUB_PROP_INT(st.queued)},
+        {"fps",         SUB_PROP_DOUBLE(st.fps)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
+static int mp_property_storyboard_pending(void *ctx, struct m_property *prop,
+                                          int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    return m_property_int_ro(action, arg, mp_storyboard_pending(mpctx));
+}
+
 static int mp_property_vo(void *ctx, struct m_property *p, int action, void *arg)
 {
     MPContext *mpctx = ctx;
@@ -3101,6 +3146,43 @@ static int mp_property_sub_text(void *ctx, struct m_property *prop,
     return m_property_strdup_ro(action, arg, text);
 }
 
+static int mp_property_sub_preload_progress(void *ctx, struct m_property *prop,
+                                            int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    double progress = -1;
+    for (int n = 0; n < NUM_PTRACKS; n++) {
+        struct track *track = mpctx->current_track[n][STREAM_SUB];
+        if (!track || !track->d_sub)
+            continue;
+        double p = sub_get_preload_progress(track->d_sub);
+        if (p >= 0)
+            progress = progress < 0 ? p : MPMIN(progress, p);
+    }
+    if (progress < 0)
+        return M_PROPERTY_UNAVAILABLE;
+
+    return m_property_double_ro(action, arg, progress * 100);
+}
+
+static int mp_property_sub_memory_usage(void *ctx, struct m_property *prop,
+                                        int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    int64_t size = -1;
+    for (int n = 0; n < NUM_PTRACKS; n++) {
+        struct track *track = mpctx->current_track[n][STREAM_SUB];
+        int64_t s;
+        if (track && track->d_sub &&
+            sub_control(track->d_sub, SD_CTRL_GET_MEMORY_USAGE, &s) > 0)
+            size = MPMAX(size, 0) + s;
+    }
+    if (size < 0)
+        return M_PROPERTY_UNAVAILABLE;
+
+    return m_property_int64_ro(action, arg, size);
+}
+
 static int mp_property_cursor_autohide(void *ctx, struct m_property *prop,
                                        int action, void *arg)
 {
@@ -3947,6 +4029,9 @@ static const struct m_property mp_properties_base[] = {
     {"window-scale", mp_property_window_scale},
     {"vo-configured", mp_property_vo_configured},
     {"vo-passes", mp_property_vo_passes},
+    {"image-pool-stats", mp_property_image_pool_stats},
+    {"image-writer-stats", mp_property_image_writer_stats},
+    {"storyboard-pending", mp_property_storyboard_pending},
     {"current-vo", mp_property_vo},
     {"container-fps", mp_property_fps},
     {"estimated-vf-fps", mp_property_vf_fps},
@@ -3974,6 +4059,8 @@ static const struct m_property mp_properties_base[] = {
     {"sub-speed", mp_property_sub_speed},
     {"sub-pos", mp_property_sub_pos},
     {"sub-text", mp_property_sub_text},
+    {"sub-preload-progress", mp_property_sub_preload_progress},
+    {"sub-memory-usage", mp_property_sub_memory_usage},
 
     {"vf", mp_property_vf},
     {"af", mp_property_af},
@@ -4063,7 +4150,8 @@ static const char *const *const mp_event_property_change[] = {
       "estimated-vf-fps", "drop-frame-count", "vo-drop-frame-count",
       "total-avsync-change", "audio-speed-correction", "video-speed-correction",
       "vo-delayed-frame-count", "mistimed-frame-count", "vsync-ratio",
-      "estimated-display-fps", "vsync-jitter", "sub-text", "audio-bitrate",
+      "estimated-display-fps", "vsync-jitter", "sub-text",
+      "sub-preload-progress", "sub-memory-usage", "audio-bitrate",
       "video-bitrate", "sub-bitrate", "decoder-frame-drop-count",
       "frame-drop-count", "video-frame-info"),
     E(MP_EVENT_DURATION_UPDATE, "duration"),
@@ -5531,6 +5619,25 @@ static void cmd_screenshot_raw(void *p)
     talloc_steal(ba, img);
 }
 
+static void cmd_storyboard(void *p)
+{
+    struct mp_cmd_ctx *cmd = p;
+    struct MPContext *mpctx = cmd->mpctx;
+    int cols = cmd->args[2].v.i, rows = cmd->args[3].v.i;
+    int width = cmd->args[4].v.i;
+
+    if (cols < 1 || rows < 1 || cols * (int64_t)rows > 10000 ||
+        width < 1 || width * (int64_t)cols > 16384)
+    {
+        MP_ERR(mpctx, "storyboard: invalid sheet size.\n");
+        cmd->success = false;
+        return;
+    }
+
+    cmd->success = mp_storyboard_start(mpctx, cmd->args[0].v.s,
+                                       cmd->args[1].v.s, cols, rows, width);
+}
+
 static void cmd_run(void *p)
 {
     struct mp_cmd_ctx *cmd = p;
@@ -5926,6 +6033,9 @@ const struct mp_cmd_def mp_cmds[] = {
                         {"window", 1},
                         {"subtitles", 2})),
     }},
+    { "storyboard", cmd_storyboard, {
+        ARG_STRING, ARG_STRING, OARG_INT(10), OARG_INT(10), OARG_INT(160),
+    }},
     { "screenshot-raw", cmd_screenshot_raw, {
         OARG_CHOICE(2, ({"video", 0},
                         {"window", 1},
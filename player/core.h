@@ -151,6 +151,8 @@ struct track {
 
     // Current subtitle state (or cached state if selected==false).
     struct dec_sub *d_sub;
+    bool sub_preloading;        // d_sub is read in the background
+    double sub_prune_pts;       // playback position d_sub was last pruned at
 
     // Current decoding state (NULL if selected==false)
     struct mp_decoder_wrapper *dec;
@@ -223,6 +225,25 @@ enum playback_status {
 
 #define NUM_PTRACKS 2
 
+// Opening a URL on a separate thread (see loadfile.c).
+struct open_job {
+    struct MPContext *mpctx;
+    pthread_t thread;
+    bool active; // thread is a valid thread handle, all setup
+    atomic_bool done;
+    // --- All fields below are immutable while active is true.
+    //     Otherwise, they're owned by MPContext.
+    struct mp_cancel *cancel;
+    char *url;
+    char *format;
+    int url_flags;
+    bool warmup;        // start reading packets after opening
+    int64_t max_bytes;  // packet buffer budget while warming up (0: default)
+    // --- All fields below are owned by thread, unless done was set to true.
+    struct demuxer *res_demuxer;
+    int res_error;
+};
+
 typedef struct MPContext {
     bool initialized;
     bool is_cli;
@@ -280,6 +301,9 @@ typedef struct MPContext {
     int files_errored;      // played, but errors happened at one point
     int files_broken;       // couldn't be played at all
 
+    // Directory listings used for external file autoloading
+    struct external_files_cache *external_files_cache;
+
     // Current file statistics
     int64_t shown_vframes, shown_aframes;
 
@@ -407,6 +431,8 @@ typedef struct MPContext {
     bool paused;            // internal pause state
     bool playback_active;   // not paused, restarting, loading, unloading
     bool in_playloop;
+    // No output is paced by a clock (see update_offline_mode()).
+    bool offline;
 
     // step this many frames, then pause
     int step_frames;
@@ -427,6 +453,12 @@ typedef struct MPContext {
     char *cached_watch_later_configdir;
 
     struct screenshot_ctx *screenshot_ctx;
+    // Shared by screenshots and vo_image.
+    struct image_writer_queue *image_writer_queue;
+    struct rgain_scan *rgain_scan;
+    struct storyboard_ctx *storyboard_ctx;
+    // Result of --replaygain-scan for the currently playing file, or NULL.
+    struct replaygain_data *scanned_rgain;
     struct command_ctx *command_ctx;
     struct encode_lavc_context *encode_lavc_ctx;
 
@@ -438,19 +470,10 @@ typedef struct MPContext {
     struct mp_cancel *demuxer_cancel; // cancel handle for MPContext.demuxer
 
     // --- Owned by MPContext
-    pthread_t open_thread;
-    bool open_active; // open_thread is a valid thread handle, all setup
-    atomic_bool open_done;
-    // --- All fields below are immutable while open_active is true.
-    //     Otherwise, they're owned by MPContext.
-    struct mp_cancel *open_cancel;
-    char *open_url;
-    char *open_format;
-    int open_url_flags;
-    // --- All fields below are owned by open_thread, unless open_done was set
-    //     to true.
-    struct demuxer *open_res_demuxer;
-    int open_res_error;
+    // Asynchronous opening of the next file to play, and prefetched playlist
+    // entries after it (sorted by playlist order; at most one per URL).
+    struct open_job **open_jobs;
+    int num_open_jobs;
 } MPContext;
 
 // audio.c
@@ -533,6 +556,9 @@ void update_window_title(struct MPContext *mpctx, bool force);
 void error_on_track(struct MPContext *mpctx, struct track *track);
 int stream_dump(struct MPContext *mpctx, const char *source_filename);
 double get_track_seek_offset(struct MPContext *mpctx, struct track *track);
+struct mp_frame read_frame_sync(struct mp_filter *root, struct mp_pin *out,
+                                enum mp_frame_type type,
+                                struct mp_cancel *cancel);
 
 // osd.c
 void set_osd_bar(struct MPContext *mpctx, int type,
@@ -577,6 +603,19 @@ int handle_force_window(struct MPContext *mpctx, bool force);
 void seek_to_last_frame(struct MPContext *mpctx);
 void update_screensaver_state(struct MPContext *mpctx);
 
+// replaygain_scan.c
+struct replaygain_data *mp_rgain_scan_lookup(void *talloc_ctx,
+                                             struct MPContext *mpctx,
+                                             const char *url);
+void mp_rgain_scan_update(struct MPContext *mpctx);
+void mp_rgain_scan_uninit(struct MPContext *mpctx);
+
+// storyboard.c
+bool mp_storyboard_start(struct MPContext *mpctx, const char *url,
+                         const char *filename, int cols, int rows, int tile_w);
+int mp_storyboard_pending(struct MPContext *mpctx);
+void mp_storyboard_uninit(struct MPContext *mpctx);
+
 // scripting.c
 struct mp_scripting {
     const char *name;       // e.g. "lua script"
@@ -595,6 +634,8 @@ void uninit_sub(struct MPContext *mpctx, struct track *track);
 void uninit_sub_all(struct MPContext *mpctx);
 void update_osd_msg(struct MPContext *mpctx);
 bool update_subtitles(struct MPContext *mpctx, double video_pts);
+void prerender_subtitles(struct MPContext *mpctx, double *video_pts, int num_pts);
+void handle_sub_preload(struct MPContext *mpctx);
 
 // video.c
 int video_get_colors(struct vo_chain *vo_c, const char *item, int *value);
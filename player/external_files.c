@@ -20,6 +20,7 @@
 #include <strings.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <time.h>
 
 #include "osdep/io.h"
 
@@ -104,7 +105,150 @@ static struct bstr guess_lang_from_filename(struct bstr name)
     return (struct bstr){name.start + i + 1, n};
 }
 
+// A directory entry that might be an external file, with its name already
+// normalized for matching.
+struct dir_file {
+    bstr name;      // UTF-8 version of the name as returned by readdir()
+    bstr trim;      // lower case name without extension and surrounding spaces
+    int type;       // STREAM_SUB/STREAM_AUDIO
+};
+
+struct cached_dir {
+    char *path;
+    time_t mtime;
+    time_t scan_time;
+    uint64_t last_used;
+    struct dir_file *files; // sorted by trim
+    int num_files;
+};
+
+// Keep the listings of the directories used last.
+#define MAX_CACHED_DIRS 32
+
+struct external_files_cache {
+    struct cached_dir **dirs;
+    int num_dirs;
+    uint64_t use_counter;
+};
+
+struct external_files_cache *external_files_cache_create(void *ta_parent)
+{
+    return talloc_zero(ta_parent, struct external_files_cache);
+}
+
+static int compare_dir_file(const void *a, const void *b)
+{
+    const struct dir_file *f1 = a;
+    const struct dir_file *f2 = b;
+    return bstrcmp(f1->trim, f2->trim);
+}
+
+static struct cached_dir *read_dir(void *ta_parent, struct mp_log *log,
+                                   const char *path)
+{
+    DIR *d = opendir(path);
+    if (!d)
+        return NULL;
+    struct cached_dir *dir = talloc_zero(ta_parent, struct cached_dir);
+    dir->path = talloc_strdup(dir, path);
+    dir->scan_time = time(NULL);
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        struct bstr den = bstr0(de->d_name);
+        int type = test_ext(bstr_get_ext(den));
+        if (type < 0)
+            continue;
+        struct bstr dename = mp_iconv_to_utf8(log, den,
+                                              "UTF-8-MAC", MP_NO_LATIN1_FALLBACK);
+        struct dir_file f = {
+            .name = bstrdup(dir, dename),
+            .type = type,
+        };
+        if (den.start != dename.start)
+            talloc_free(dename.start);
+        // retrieve various parts of the filename
+        struct bstr noext = bstrdup(dir, bstr_strip_ext(f.name));
+        bstr_lower(noext);
+        f.trim = bstr_strip(noext);
+        MP_TARRAY_APPEND(dir, dir->files, dir->num_files, f);
+    }
+    closedir(d);
+    qsort(dir->files, dir->num_files, sizeof(dir->files[0]), compare_dir_file);
+    return dir;
+}
+
+// Return the listing of the given directory, from the cache if the directory
+// was not modified since it was read. Without cache, the result is allocated
+// under ta_parent.
+static struct cached_dir *get_dir(struct external_files_cache *cache,
+                                  void *ta_parent, struct mp_log *log,
+                                  const char *path)
+{
+    if (!cache)
+        return read_dir(ta_parent, log, path);
+
+    struct stat st;
+    if (stat(path, &st))
+        return NULL;
+
+    int found = -1;
+    for (int n = 0; n < cache->num_dirs; n++) {
+        if (strcmp(cache->dirs[n]->path, path) == 0) {
+            found = n;
+            break;
+        }
+    }
+
+    struct cached_dir *dir = found >= 0 ? cache->dirs[found] : NULL;
+    // The mtime has only a resolution of 1 second on some systems, so a
+    // listing read in the same second the directory was modified might be
+    // outdated even if the mtime stays the same.
+    if (dir && (dir->mtime != st.st_mtime ||
+                dir->mtime + 1 >= dir->scan_time))
+    {
+        talloc_free(dir);
+        MP_TARRAY_REMOVE_AT(cache->dirs, cache->num_dirs, found);
+        dir = NULL;
+    }
+
+    if (!dir) {
+        dir = read_dir(cache, log, path);
+        if (!dir)
+            return NULL;
+        dir->mtime = st.st_mtime;
+        if (cache->num_dirs >= MAX_CACHED_DIRS) {
+            int oldest = 0;
+            for (int n = 1; n < cache->num_dirs; n++) {
+                if (cache->dirs[n]->last_used < cache->dirs[oldest]->last_used)
+                    oldest = n;
+            }
+            talloc_free(cache->dirs[oldest]);
+            MP_TARRAY_REMOVE_AT(cache->dirs, cache->num_dirs, oldest);
+        }
+        MP_TARRAY_APPEND(cache, cache->dirs, cache->num_dirs, dir);
+    }
+
+    dir->last_used = ++cache->use_counter;
+    return dir;
+}
+
+// Index of the first entry whose trim is not less than the given name.
+static int find_first_file(struct cached_dir *dir, bstr name)
+{
+    int lo = 0, hi = dir->num_files;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (bstrcmp(dir->files[mid].trim, name) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
 static void append_dir_subtitles(struct mpv_global *global,
+                                 struct external_files_cache *cache,
                                  struct subfn **slist, int *nsub,
                                  struct bstr path, const char *fname,
                                  int limit_fuzziness, int limit_type)
@@ -128,27 +272,34 @@ static void append_dir_subtitles(struct mpv_global *global,
     if (mp_is_url(bstr0(path0)))
         goto out;
 
-    DIR *d = opendir(path0);
-    if (!d)
+    struct cached_dir *dir = get_dir(cache, tmpmem, log, path0);
+    if (!dir)
         goto out;
     mp_verbose(log, "Loading external files in %.*s\n", BSTR_P(path));
-    struct dirent *de;
-    while ((de = readdir(d))) {
-        void *tmpmem2 = talloc_new(tmpmem);
-        struct bstr den = bstr0(de->d_name);
-        struct bstr dename = mp_iconv_to_utf8(log, den,
-                                              "UTF-8-MAC", MP_NO_LATIN1_FALLBACK);
-        // retrieve various parts of the filename
-        struct bstr tmp_fname_noext = bstrdup(tmpmem2, bstr_strip_ext(dename));
-        bstr_lower(tmp_fname_noext);
-        struct bstr tmp_fname_ext = bstr_get_ext(dename);
-        struct bstr tmp_fname_trim = bstr_strip(tmp_fname_noext);
 
-        if (den.start != dename.start)
-            talloc_steal(tmpmem2, dename.start);
+    // Unless fuzzy matching is enabled, only files starting with the movie
+    // name can match, and these are next to each other in the sorted list.
+    int max_fuzz = -1;
+    if (limit_type < 0 || limit_type == STREAM_SUB)
+        max_fuzz = MPMAX(max_fuzz, opts->sub_auto);
+    if (limit_type < 0 || limit_type == STREAM_AUDIO)
+        max_fuzz = MPMAX(max_fuzz, opts->audiofile_auto);
+    int first = 0;
+    int last = dir->num_files;
+    if (max_fuzz < 1) {
+        first = find_first_file(dir, f_fname_trim);
+        last = first;
+        while (last < dir->num_files &&
+               bstr_startswith(dir->files[last].trim, f_fname_trim))
+            last++;
+    }
+
+    for (int i = first; i < last; i++) {
+        struct dir_file *file = &dir->files[i];
+        struct bstr tmp_fname_trim = file->trim;
 
         // check what it is (most likely)
-        int type = test_ext(tmp_fname_ext);
+        int type = file->type;
         char **langs = NULL;
         int fuzz = -1;
         switch (type) {
@@ -163,7 +314,7 @@ static void append_dir_subtitles(struct mpv_global *global,
         }
 
         if (fuzz < 0 || (limit_type >= 0 && limit_type != type))
-            goto next_sub;
+            continue;
 
         // we have a (likely) subtitle file
         // 0 = nothing
@@ -195,12 +346,12 @@ static void append_dir_subtitles(struct mpv_global *global,
             }
         }
 
-        mp_dbg(log, "Potential external file: \"%s\"  Priority: %d\n",
-               de->d_name, prio);
+        mp_dbg(log, "Potential external file: \"%.*s\"  Priority: %d\n",
+               BSTR_P(file->name), prio);
 
         if (prio) {
             prio += prio;
-            char *subpath = mp_path_join_bstr(*slist, path, dename);
+            char *subpath = mp_path_join_bstr(*slist, path, file->name);
             if (mp_path_exists(subpath)) {
                 MP_TARRAY_GROW(NULL, *slist, *nsub);
                 struct subfn *sub = *slist + (*nsub)++;
@@ -216,11 +367,7 @@ static void append_dir_subtitles(struct mpv_global *global,
             } else
                 talloc_free(subpath);
         }
-
-    next_sub:
-        talloc_free(tmpmem2);
     }
-    closedir(d);
 
  out:
     talloc_free(tmpmem);
@@ -253,16 +400,17 @@ static void filter_subidx(struct subfn **slist, int *nsub)
     }
 }
 
-static void load_paths(struct mpv_global *global, struct subfn **slist,
-                       int *nsubs, const char *fname, char **paths,
-                       char *cfg_path, int type)
+static void load_paths(struct mpv_global *global,
+                       struct external_files_cache *cache,
+                       struct subfn **slist, int *nsubs, const char *fname,
+                       char **paths, char *cfg_path, int type)
 {
     for (int i = 0; paths && paths[i]; i++) {
         char *expanded_path = mp_get_user_path(NULL, global, paths[i]);
         char *path = mp_path_join_bstr(
             *slist, mp_dirname(fname),
             bstr0(expanded_path ? expanded_path : paths[i]));
-        append_dir_subtitles(global, slist, nsubs, bstr0(path),
+        append_dir_subtitles(global, cache, slist, nsubs, bstr0(path),
                              fname, 0, type);
         talloc_free(expanded_path);
     }
@@ -270,32 +418,36 @@ static void load_paths(struct mpv_global *global, struct subfn **slist,
     // Load subtitles in ~/.mpv/sub (or similar) limiting sub fuzziness
     char *mp_subdir = mp_find_config_file(NULL, global, cfg_path);
     if (mp_subdir) {
-        append_dir_subtitles(global, slist, nsubs, bstr0(mp_subdir), fname, 1,
-                             type);
+        append_dir_subtitles(global, cache, slist, nsubs, bstr0(mp_subdir),
+                             fname, 1, type);
     }
     talloc_free(mp_subdir);
 }
 
 // Return a list of subtitles and audio files found, sorted by priority.
 // Last element is terminated with a fname==NULL entry.
-struct subfn *find_external_files(struct mpv_global *global, const char *fname)
+// cache can be NULL, in which case all directories are read again.
+struct subfn *find_external_files(struct mpv_global *global,
+                                  struct external_files_cache *cache,
+                                  const char *fname)
 {
     struct MPOpts *opts = global->opts;
     struct subfn *slist = talloc_array_ptrtype(NULL, slist, 1);
     int n = 0;
 
     // Load subtitles from current media directory
-    append_dir_subtitles(global, &slist, &n, mp_dirname(fname), fname, 0, -1);
+    append_dir_subtitles(global, cache, &slist, &n, mp_dirname(fname), fname,
+                         0, -1);
 
     // Load subtitles in dirs specified by sub-paths option
     if (opts->sub_auto >= 0) {
-        load_paths(global, &slist, &n, fname, opts->sub_paths, "sub",
+        load_paths(global, cache, &slist, &n, fname, opts->sub_paths, "sub",
                    STREAM_SUB);
     }
 
     if (opts->audiofile_auto >= 0) {
-        load_paths(global, &slist, &n, fname, opts->audiofile_paths, "audio",
-                   STREAM_AUDIO);
+        load_paths(global, cache, &slist, &n, fname, opts->audiofile_paths,
+                   "audio", STREAM_AUDIO);
     }
 
     // Sort by name for filter_subidx()
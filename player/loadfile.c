@@ -283,6 +283,7 @@ static struct track *add_stream_track(struct MPContext *mpctx,
         .lang = stream->lang,
         .demuxer = demuxer,
         .stream = stream,
+        .sub_prune_pts = MP_NOPTS_VALUE,
     };
     MP_TARRAY_APPEND(mpctx, mpctx->tracks, mpctx->num_tracks, track);
 
@@ -670,7 +671,11 @@ void autoload_external_files(struct MPContext *mpctx)
                                     &stream_filename) > 0)
             base_filename = talloc_steal(tmp, stream_filename);
     }
-    struct subfn *list = find_external_files(mpctx->global, base_filename);
+    if (!mpctx->external_files_cache)
+        mpctx->external_files_cache = external_files_cache_create(mpctx);
+    struct subfn *list = find_external_files(mpctx->global,
+                                             mpctx->external_files_cache,
+                                             base_filename);
     talloc_steal(tmp, list);
 
     int sc[STREAM_TYPE_COUNT] = {0};
@@ -799,143 +804,225 @@ static void load_per_file_options(m_config_t *conf,
 
 static void *open_demux_thread(void *ctx)
 {
-    struct MPContext *mpctx = ctx;
+    struct open_job *job = ctx;
+    struct MPContext *mpctx = job->mpctx;
 
     mpthread_set_name("opener");
 
     struct demuxer_params p = {
-        .force_format = mpctx->open_format,
-        .stream_flags = mpctx->open_url_flags,
+        .force_format = job->format,
+        .stream_flags = job->url_flags,
         .initial_readahead = true,
     };
-    mpctx->open_res_demuxer =
-        demux_open_url(mpctx->open_url, &p, mpctx->open_cancel, mpctx->global);
+    job->res_demuxer = demux_open_url(job->url, &p, job->cancel, mpctx->global);
 
-    if (mpctx->open_res_demuxer) {
-        MP_VERBOSE(mpctx, "Opening done: %s\n", mpctx->open_url);
+    if (job->res_demuxer) {
+        MP_VERBOSE(mpctx, "Opening done: %s\n", job->url);
+        if (job->warmup)
+            demux_start_prefetch(job->res_demuxer, job->max_bytes);
     } else {
-        MP_VERBOSE(mpctx, "Opening failed or was aborted: %s\n", mpctx->open_url);
+        MP_VERBOSE(mpctx, "Opening failed or was aborted: %s\n", job->url);
 
         if (p.demuxer_failed) {
-            mpctx->open_res_error = MPV_ERROR_UNKNOWN_FORMAT;
+            job->res_error = MPV_ERROR_UNKNOWN_FORMAT;
         } else {
-            mpctx->open_res_error = MPV_ERROR_LOADING_FAILED;
+            job->res_error = MPV_ERROR_LOADING_FAILED;
         }
     }
 
-    atomic_store(&mpctx->open_done, true);
+    atomic_store(&job->done, true);
     mp_wakeup_core(mpctx);
     return NULL;
 }
 
-static void cancel_open(struct MPContext *mpctx)
+// Abort and destroy mpctx->open_jobs[index].
+static void remove_open_job(struct MPContext *mpctx, int index)
 {
-    if (mpctx->open_cancel)
-        mp_cancel_trigger(mpctx->open_cancel);
+    struct open_job *job = mpctx->open_jobs[index];
+
+    if (job->cancel)
+        mp_cancel_trigger(job->cancel);
 
-    if (mpctx->open_active)
-        pthread_join(mpctx->open_thread, NULL);
-    mpctx->open_active = false;
+    if (job->active)
+        pthread_join(job->thread, NULL);
 
-    TA_FREEP(&mpctx->open_cancel);
-    TA_FREEP(&mpctx->open_url);
-    TA_FREEP(&mpctx->open_format);
+    if (job->res_demuxer)
+        free_demuxer_and_stream(job->res_demuxer);
 
-    if (mpctx->open_res_demuxer)
-        free_demuxer_and_stream(mpctx->open_res_demuxer);
-    mpctx->open_res_demuxer = NULL;
+    talloc_free(job->cancel);
+    talloc_free(job);
+
+    MP_TARRAY_REMOVE_AT(mpctx->open_jobs, mpctx->num_open_jobs, index);
+}
+
+static void cancel_open(struct MPContext *mpctx)
+{
+    // Trigger all first, so that the threads can exit in parallel.
+    for (int n = 0; n < mpctx->num_open_jobs; n++) {
+        if (mpctx->open_jobs[n]->cancel)
+            mp_cancel_trigger(mpctx->open_jobs[n]->cancel);
+    }
 
-    atomic_store(&mpctx->open_done, false);
+    while (mpctx->num_open_jobs)
+        remove_open_job(mpctx, mpctx->num_open_jobs - 1);
 }
 
 // Setup all the field to open this url, and make sure a thread is running.
-static void start_open(struct MPContext *mpctx, char *url, int url_flags)
+// If prefetch is set, the job is for a playlist entry to be played later.
+static struct open_job *start_open(struct MPContext *mpctx, char *url,
+                                   int url_flags, bool prefetch)
 {
-    cancel_open(mpctx);
+    struct MPOpts *opts = mpctx->opts;
 
-    assert(!mpctx->open_active);
-    assert(!mpctx->open_cancel);
-    assert(!mpctx->open_res_demuxer);
-    assert(!atomic_load(&mpctx->open_done));
+    struct open_job *job = talloc_zero(NULL, struct open_job);
+    job->mpctx = mpctx;
+    job->cancel = mp_cancel_new(NULL);
+    job->url = talloc_strdup(job, url);
+    job->format = talloc_strdup(job, opts->demuxer_name);
+    job->url_flags = url_flags;
+    if (opts->load_unsafe_playlists)
+        job->url_flags = 0;
+    job->warmup = prefetch && opts->prefetch_warmup && opts->demuxer_thread;
+    job->max_bytes = opts->prefetch_max_bytes;
+
+    MP_TARRAY_APPEND(mpctx, mpctx->open_jobs, mpctx->num_open_jobs, job);
+
+    if (pthread_create(&job->thread, NULL, open_demux_thread, job)) {
+        remove_open_job(mpctx, mpctx->num_open_jobs - 1);
+        return NULL;
+    }
 
-    mpctx->open_cancel = mp_cancel_new(NULL);
-    mpctx->open_url = talloc_strdup(NULL, url);
-    mpctx->open_format = talloc_strdup(NULL, mpctx->opts->demuxer_name);
-    mpctx->open_url_flags = url_flags;
-    if (mpctx->opts->load_unsafe_playlists)
-        mpctx->open_url_flags = 0;
+    job->active = true;
+    return job;
+}
 
-    if (pthread_create(&mpctx->open_thread, NULL, open_demux_thread, mpctx)) {
-        cancel_open(mpctx);
-        return;
+static int find_open_job(struct MPContext *mpctx, const char *url)
+{
+    for (int n = 0; n < mpctx->num_open_jobs; n++) {
+        if (strcmp(mpctx->open_jobs[n]->url, url) == 0)
+            return n;
+    }
+    return -1;
+}
+
+#define MAX_PREFETCH_ENTRIES 16
+
+// Return the playlist entries which are supposed to be prefetched, in playlist
+// order. This doesn't wrap around the end of the playlist after the first
+// entry.
+static int get_prefetch_entries(struct MPContext *mpctx,
+                                struct playlist_entry **entries)
+{
+    if (!mpctx->opts->prefetch_open)
+        return 0;
+
+    int max = MPMIN(mpctx->opts->prefetch_entries, MAX_PREFETCH_ENTRIES);
+    int num = 0;
+    struct playlist_entry *e = mp_next_file(mpctx, +1, false, false);
+    while (e && e != mpctx->playing && num < max) {
+        if (e->filename)
+            entries[num++] = e;
+        e = e->next;
     }
+    return num;
+}
 
-    mpctx->open_active = true;
+// Cancel all open jobs which are neither for url, nor for one of the playlist
+// entries to prefetch.
+static void prune_open_jobs(struct MPContext *mpctx, const char *url)
+{
+    struct playlist_entry *entries[MAX_PREFETCH_ENTRIES];
+    int num_entries = get_prefetch_entries(mpctx, entries);
+
+    for (int n = mpctx->num_open_jobs - 1; n >= 0; n--) {
+        struct open_job *job = mpctx->open_jobs[n];
+        bool keep = url && strcmp(job->url, url) == 0;
+        for (int i = 0; i < num_entries; i++)
+            keep |= strcmp(job->url, entries[i]->filename) == 0;
+        if (!keep) {
+            if (atomic_load(&job->done)) {
+                MP_VERBOSE(mpctx, "Dropping finished prefetch of wrong URL.\n");
+            } else {
+                MP_VERBOSE(mpctx, "Aborting ongoing prefetch of wrong URL.\n");
+            }
+            remove_open_job(mpctx, n);
+        }
+    }
 }
 
 static void open_demux_reentrant(struct MPContext *mpctx)
 {
     char *url = mpctx->stream_open_filename;
 
-    if (mpctx->open_active) {
-        bool done = atomic_load(&mpctx->open_done);
-        bool failed = done && !mpctx->open_res_demuxer;
-        bool correct_url = strcmp(mpctx->open_url, url) == 0;
+    prune_open_jobs(mpctx, url);
 
-        if (correct_url && !failed) {
-            MP_VERBOSE(mpctx, "Using prefetched/prefetching URL.\n");
-        } else if (correct_url && failed) {
+    struct open_job *job = NULL;
+    int index = find_open_job(mpctx, url);
+    if (index >= 0) {
+        job = mpctx->open_jobs[index];
+        bool failed = atomic_load(&job->done) && !job->res_demuxer;
+        if (failed) {
             MP_VERBOSE(mpctx, "Prefetched URL failed, retrying.\n");
-            cancel_open(mpctx);
+            remove_open_job(mpctx, index);
+            job = NULL;
         } else {
-            if (done) {
-                MP_VERBOSE(mpctx, "Dropping finished prefetch of wrong URL.\n");
-            } else {
-                MP_VERBOSE(mpctx, "Aborting ongoing prefetch of wrong URL.\n");
-            }
-            cancel_open(mpctx);
+            MP_VERBOSE(mpctx, "Using prefetched/prefetching URL.\n");
         }
     }
 
-    if (!mpctx->open_active)
-        start_open(mpctx, url, mpctx->playing->stream_flags);
+    if (!job)
+        job = start_open(mpctx, url, mpctx->playing->stream_flags, false);
+    if (!job) {
+        mpctx->error_playing = MPV_ERROR_LOADING_FAILED;
+        return;
+    }
 
     // User abort should cancel the opener now.
     pthread_mutex_lock(&mpctx->lock);
-    mpctx->demuxer_cancel = mpctx->open_cancel;
+    mpctx->demuxer_cancel = job->cancel;
     pthread_mutex_unlock(&mpctx->lock);
 
-    while (!atomic_load(&mpctx->open_done)) {
+    while (!atomic_load(&job->done)) {
         mp_idle(mpctx);
 
         if (mpctx->stop_play)
             mp_abort_playback_async(mpctx);
     }
 
-    if (mpctx->open_res_demuxer) {
-        assert(mpctx->demuxer_cancel == mpctx->open_cancel);
-        mpctx->demuxer = mpctx->open_res_demuxer;
-        mpctx->open_res_demuxer = NULL;
-        mpctx->open_cancel = NULL;
+    if (job->res_demuxer) {
+        assert(mpctx->demuxer_cancel == job->cancel);
+        mpctx->demuxer = job->res_demuxer;
+        job->res_demuxer = NULL;
+        job->cancel = NULL;
+        if (job->warmup)
+            demux_stop_prefetch(mpctx->demuxer);
     } else {
-        mpctx->error_playing = mpctx->open_res_error;
+        mpctx->error_playing = job->res_error;
         pthread_mutex_lock(&mpctx->lock);
         mpctx->demuxer_cancel = NULL;
         pthread_mutex_unlock(&mpctx->lock);
     }
 
-    cancel_open(mpctx); // cleanup
+    // cleanup
+    for (int n = 0; n < mpctx->num_open_jobs; n++) {
+        if (mpctx->open_jobs[n] == job) {
+            remove_open_job(mpctx, n);
+            break;
+        }
+    }
 }
 
 void prefetch_next(struct MPContext *mpctx)
 {
-    if (!mpctx->opts->prefetch_open)
-        return;
-
-    struct playlist_entry *new_entry = mp_next_file(mpctx, +1, false, false);
-    if (new_entry && !mpctx->open_active && new_entry->filename) {
-        MP_VERBOSE(mpctx, "Prefetching: %s\n", new_entry->filename);
-        start_open(mpctx, new_entry->filename, new_entry->stream_flags);
+    struct playlist_entry *entries[MAX_PREFETCH_ENTRIES];
+    int num_entries = get_prefetch_entries(mpctx, entries);
+
+    for (int n = 0; n < num_entries; n++) {
+        struct playlist_entry *e = entries[n];
+        if (find_open_job(mpctx, e->filename) < 0) {
+            MP_VERBOSE(mpctx, "Prefetching: %s\n", e->filename);
+            start_open(mpctx, e->filename, e->stream_flags, true);
+        }
     }
 }
 
@@ -1131,6 +1218,24 @@ void update_lavfi_complex(struct MPContext *mpctx)
     }
 }
 
+// If the outputs are not paced by a clock (encoding, --ao=pcm, --untimed), the
+// file is processed as fast as possible. Report how fast that was.
+static void report_processing_speed(struct MPContext *mpctx, double wall_start,
+                                    double media_start)
+{
+    bool untimed = mpctx->opts->untimed || mpctx->encode_lavc_ctx ||
+                   (mpctx->ao && ao_untimed(mpctx->ao));
+    double media_end = get_current_time(mpctx);
+    double wall = mp_time_sec() - wall_start;
+    if (!untimed || media_end == MP_NOPTS_VALUE || wall <= 0)
+        return;
+    double media = media_end - media_start;
+    if (media <= 0)
+        return;
+    MP_INFO(mpctx, "Processed %.3f seconds of media in %.3f seconds "
+            "(%.2fx realtime).\n", media, wall, media / wall);
+}
+
 // Start playing the current playlist entry.
 // Handle initialization and deinitialization.
 static void play_current_file(struct MPContext *mpctx)
@@ -1309,6 +1414,12 @@ reopen_file:
                                  mpctx->demuxer->metadata);
     }
 
+    if (opts->rgain_mode && opts->rgain_scan) {
+        mpctx->scanned_rgain =
+            mp_rgain_scan_lookup(NULL, mpctx, mpctx->playing->filename);
+    }
+    mp_rgain_scan_update(mpctx);
+
     update_playback_speed(mpctx);
 
     reinit_video_chain(mpctx);
@@ -1359,6 +1470,9 @@ reopen_file:
 
     open_recorder(mpctx, true);
 
+    if (play_start_pts == MP_NOPTS_VALUE)
+        play_start_pts = opts->rebase_start_time ? 0 : mpctx->demuxer->start_time;
+
     playback_start = mp_time_sec();
     mpctx->error_playing = 0;
     mpctx->in_playloop = true;
@@ -1366,6 +1480,8 @@ reopen_file:
         run_playloop(mpctx);
     mpctx->in_playloop = false;
 
+    report_processing_speed(mpctx, playback_start, play_start_pts);
+
     MP_VERBOSE(mpctx, "EOF code: %d  \n", mpctx->stop_play);
 
 terminate_playback:
@@ -1407,6 +1523,7 @@ terminate_playback:
     m_config_restore_backups(mpctx->mconfig);
 
     TA_FREEP(&mpctx->filter_root);
+    TA_FREEP(&mpctx->scanned_rgain);
     talloc_free(mpctx->filtered_tags);
     mpctx->filtered_tags = NULL;
 
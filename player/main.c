@@ -170,6 +170,9 @@ void mp_destroy(struct MPContext *mpctx)
 
     command_uninit(mpctx);
 
+    mp_rgain_scan_uninit(mpctx);
+    mp_storyboard_uninit(mpctx);
+
     mp_clients_destroy(mpctx);
 
     osd_free(mpctx->osd);
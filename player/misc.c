@@ -359,3 +359,26 @@ void merge_playlist_files(struct playlist *pl)
     playlist_add_file(pl, edl);
     talloc_free(edl);
 }
+
+// Run a filter graph until out returns a frame of the given type or EOF, and
+// return it. Other frames are discarded. The graph must not contain anything
+// asynchronous, such as a demuxer thread. Returns MP_NO_FRAME on errors, or if
+// cancel is triggered.
+struct mp_frame read_frame_sync(struct mp_filter *root, struct mp_pin *out,
+                                enum mp_frame_type type,
+                                struct mp_cancel *cancel)
+{
+    // Nothing in the graph is asynchronous, so running it always either
+    // yields data or EOF, unless it failed.
+    while (!mp_cancel_test(cancel)) {
+        mp_pin_out_request_data(out);
+        mp_filter_run(root);
+        if (!mp_pin_out_has_data(out))
+            break;
+        struct mp_frame frame = mp_pin_out_read(out);
+        if (frame.type == type || frame.type == MP_FRAME_EOF)
+            return frame;
+        mp_frame_unref(&frame);
+    }
+    return MP_NO_FRAME;
+}
@@ -322,7 +322,11 @@ static void mp_seek(MPContext *mpctx, struct seek_params seek)
     struct track *external_audio = NULL;
     for (int t = 0; t < mpctx->num_tracks; t++) {
         struct track *track = mpctx->tracks[t];
-        if (track->selected && track->is_external && track->demuxer) {
+        // A subtitle file being preloaded is read from start to end by the
+        // preload thread. Seeking would skip parts of it.
+        if (track->selected && track->is_external && track->demuxer &&
+            !track->sub_preloading)
+        {
             double main_new_pos = demux_pts;
             if (!hr_seek || track->is_external)
                 main_new_pos += get_track_seek_offset(mpctx, track);
@@ -1068,6 +1072,26 @@ static void handle_eof(struct MPContext *mpctx)
     }
 }
 
+// If no output is paced by a clock (encoding, --ao=pcm, --untimed with no
+// audio, image output, ...), process everything as fast as possible. The
+// playloop then never waits for a timer or for an output to ask for more
+// data, only for the demuxer and decoders.
+static void update_offline_mode(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    bool audio_untimed = !mpctx->ao_chain ||
+                         (mpctx->ao && ao_untimed(mpctx->ao));
+    bool video_untimed = !mpctx->vo_chain || opts->untimed ||
+                         mpctx->video_out->driver->untimed;
+    bool offline = (mpctx->ao_chain || mpctx->vo_chain) && audio_untimed &&
+                   video_untimed;
+    if (offline != mpctx->offline) {
+        MP_VERBOSE(mpctx, "%s offline mode.\n",
+                   offline ? "Enabling" : "Disabling");
+        mpctx->offline = offline;
+    }
+}
+
 void run_playloop(struct MPContext *mpctx)
 {
     if (encode_lavc_didfail(mpctx->encode_lavc_ctx)) {
@@ -1075,6 +1099,8 @@ void run_playloop(struct MPContext *mpctx)
         return;
     }
 
+    update_offline_mode(mpctx);
+
     update_demuxer_properties(mpctx);
 
     handle_cursor_autohide(mpctx);
@@ -1096,6 +1122,7 @@ void run_playloop(struct MPContext *mpctx)
     handle_dummy_ticks(mpctx);
 
     update_osd_msg(mpctx);
+    handle_sub_preload(mpctx);
     if (mpctx->video_status == STATUS_EOF)
         update_subtitles(mpctx, mpctx->playback_pts);
 
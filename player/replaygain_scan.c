@@ -0,0 +1,439 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <libavutil/md5.h>
+
+#include "config.h"
+#include "mpv_talloc.h"
+
+#include "osdep/io.h"
+#include "osdep/threads.h"
+
+#include "audio/aframe.h"
+#include "audio/chmap.h"
+#include "audio/format.h"
+#include "audio/loudness.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "common/playlist.h"
+#include "demux/demux.h"
+#include "demux/stheader.h"
+#include "filters/f_autoconvert.h"
+#include "filters/f_decoder_wrapper.h"
+#include "filters/filter.h"
+#include "misc/thread_pool.h"
+#include "options/options.h"
+#include "options/path.h"
+#include "stream/stream.h"
+
+#include "core.h"
+
+#define CACHE_DIR "replaygain_cache"
+
+// ReplayGain 2.0 reference loudness.
+#define REFERENCE_LUFS -18.0
+
+// Maximum number of scan results kept in memory. Older ones are still found
+// in the cache directory.
+#define MAX_ENTRIES 256
+
+struct rgain_entry {
+    char *key;
+    bool pending;       // queued or being scanned
+    bool valid;         // rg is set
+    struct replaygain_data rg;
+};
+
+struct rgain_scan {
+    struct mp_log *log;
+    struct mpv_global *global;
+    struct mp_cancel *cancel;
+    struct mp_thread_pool *pool;
+    char *cache_dir;
+
+    pthread_mutex_t lock;
+    // --- the following fields are protected by lock
+    struct rgain_entry **entries;
+    int num_entries;
+};
+
+struct scan_job {
+    struct rgain_scan *ctx;
+    char *url;
+    int url_flags;
+    char *key;
+};
+
+// Return a string identifying the file contents: the absolute path plus size
+// and modification time for local files, the URL for anything else.
+static char *get_file_key(void *talloc_ctx, const char *url)
+{
+    void *tmp = talloc_new(NULL);
+    char *res = talloc_strdup(talloc_ctx, url);
+    char *path = mp_file_get_path(tmp, bstr0(url));
+    if (path) {
+        char *cwd = mp_getcwd(tmp);
+        if (cwd)
+            path = mp_path_join(tmp, cwd, path);
+    }
+    struct stat st;
+    if (path && stat(path, &st) == 0) {
+        res = talloc_asprintf(talloc_ctx, "%s\n%lld\n%lld", path,
+                              (long long)st.st_size, (long long)st.st_mtime);
+    }
+    talloc_free(tmp);
+    return res;
+}
+
+static char *get_cache_filename(void *talloc_ctx, struct rgain_scan *ctx,
+                                const char *key)
+{
+    if (!ctx->cache_dir)
+        return NULL;
+    uint8_t md5[16];
+    av_md5_sum(md5, key, strlen(key));
+    char name[33];
+    for (int i = 0; i < 16; i++)
+        snprintf(name + i * 2, 3, "%02X", md5[i]);
+    return mp_path_join(talloc_ctx, ctx->cache_dir, name);
+}
+
+static bool read_cache(struct rgain_scan *ctx, const char *key,
+                       struct replaygain_data *rg)
+{
+    char *filename = get_cache_filename(NULL, ctx, key);
+    FILE *f = filename ? fopen(filename, "rb") : NULL;
+    talloc_free(filename);
+    if (!f)
+        return false;
+    bool ok = false;
+    char line[256];
+    while (!ok && fgets(line, sizeof(line), f)) {
+        if (line[0] == '#')
+            continue;
+        float gain, peak;
+        if (sscanf(line, "%f %f", &gain, &peak) == 2 && isfinite(gain) &&
+            isfinite(peak) && peak > 0)
+        {
+            *rg = (struct replaygain_data){gain, peak, gain, peak};
+            ok = true;
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+static void write_cache(struct rgain_scan *ctx, struct scan_job *job,
+                        struct replaygain_data *rg)
+{
+    char *filename = get_cache_filename(NULL, ctx, job->key);
+    if (!filename)
+        return;
+    mp_mkdirp(ctx->cache_dir);
+    FILE *f = fopen(filename, "wb");
+    if (f) {
+        fprintf(f, "# ");
+        for (int n = 0; job->url[n]; n++)
+            fputc((unsigned char)job->url[n] < 32 ? '_' : job->url[n], f);
+        fprintf(f, "\n%f %f\n", rg->track_gain, rg->track_peak);
+        fclose(f);
+    } else {
+        MP_WARN(ctx, "Could not write %s.\n", filename);
+    }
+    talloc_free(filename);
+}
+
+// Must be called locked. The entries are in least recently used order, so
+// this moves the found entry to the end.
+static struct rgain_entry *find_entry(struct rgain_scan *ctx, const char *key)
+{
+    for (int n = 0; n < ctx->num_entries; n++) {
+        struct rgain_entry *e = ctx->entries[n];
+        if (strcmp(e->key, key) == 0) {
+            MP_TARRAY_REMOVE_AT(ctx->entries, ctx->num_entries, n);
+            MP_TARRAY_APPEND(ctx, ctx->entries, ctx->num_entries, e);
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// Must be called locked. Drop the least recently used entries that are not
+// being scanned, until there is room for a new one.
+static void prune_entries(struct rgain_scan *ctx)
+{
+    for (int n = 0; n < ctx->num_entries && ctx->num_entries >= MAX_ENTRIES;) {
+        struct rgain_entry *e = ctx->entries[n];
+        if (e->pending) {
+            n++;
+            continue;
+        }
+        MP_TARRAY_REMOVE_AT(ctx->entries, ctx->num_entries, n);
+        talloc_free(e);
+    }
+}
+
+static struct sh_stream *select_audio_stream(struct demuxer *demuxer)
+{
+    struct sh_stream *res = NULL;
+    for (int n = 0; n < demux_get_num_stream(demuxer); n++) {
+        struct sh_stream *sh = demux_get_stream(demuxer, n);
+        if (sh->type == STREAM_AUDIO && (!res || (sh->default_track &&
+                                                  !res->default_track)))
+            res = sh;
+    }
+    return res;
+}
+
+// Decode the default audio stream of the file, and measure its loudness.
+static bool scan_file(struct rgain_scan *ctx, struct scan_job *job,
+                      struct replaygain_data *rg)
+{
+    struct demuxer_params params = {
+        .stream_flags = job->url_flags,
+        .disable_cache = true,
+    };
+    struct demuxer *demuxer =
+        demux_open_url(job->url, &params, ctx->cancel, ctx->global);
+    if (!demuxer)
+        return false;
+
+    bool ok = false;
+    struct mp_filter *root = NULL;
+    struct mp_loudness *meter = NULL;
+    struct mp_chmap chmap = {0};
+    int rate = 0;
+
+    struct sh_stream *sh = select_audio_stream(demuxer);
+    if (!sh) {
+        MP_VERBOSE(ctx, "No audio in %s\n", job->url);
+        goto done;
+    }
+    if (sh->codec->replaygain_data) {
+        MP_VERBOSE(ctx, "%s is already tagged.\n", job->url);
+        goto done;
+    }
+
+    demuxer_select_track(demuxer, sh, MP_NOPTS_VALUE, true);
+
+    root = mp_filter_create_root(ctx->global);
+    struct mp_decoder_wrapper *dec = mp_decoder_wrapper_create(root, sh);
+    struct mp_autoconvert *conv = mp_autoconvert_create(root);
+    if (!dec || !conv)
+        goto done;
+    mp_autoconvert_add_afmt(conv, AF_FORMAT_FLOATP);
+    mp_pin_connect(conv->f->pins[0], dec->f->pins[0]);
+    struct mp_pin *out = conv->f->pins[1];
+
+    for (;;) {
+        struct mp_frame frame = read_frame_sync(root, out, MP_FRAME_AUDIO,
+                                                ctx->cancel);
+        if (frame.type == MP_FRAME_EOF) {
+            ok = meter != NULL;
+            break;
+        }
+        if (frame.type != MP_FRAME_AUDIO)
+            break;
+        struct mp_aframe *aframe = frame.data;
+        struct mp_chmap fchmap = {0};
+        mp_aframe_get_chmap(aframe, &fchmap);
+        int frate = mp_aframe_get_rate(aframe);
+        if (!meter) {
+            chmap = fchmap;
+            rate = frate;
+            meter = mp_loudness_create(root, rate, &chmap);
+        } else if (rate != frate || !mp_chmap_equals(&chmap, &fchmap)) {
+            MP_VERBOSE(ctx, "Audio format changed in %s, giving up.\n",
+                       job->url);
+            mp_frame_unref(&frame);
+            break;
+        }
+        mp_loudness_add_planar(meter, (float **)mp_aframe_get_data_ro(aframe),
+                               mp_aframe_get_size(aframe));
+        mp_frame_unref(&frame);
+    }
+
+    if (ok) {
+        double lufs = mp_loudness_integrated(meter);
+        double peak = mp_loudness_true_peak(meter);
+        if (isfinite(lufs) && peak > 0) {
+            float gain = REFERENCE_LUFS - lufs;
+            *rg = (struct replaygain_data){gain, peak, gain, peak};
+            MP_VERBOSE(ctx, "%s: %f LUFS, true peak %f\n", job->url, lufs, peak);
+        } else {
+            MP_VERBOSE(ctx, "%s is silent.\n", job->url);
+            ok = false;
+        }
+    }
+
+done:
+    talloc_free(root);
+    free_demuxer_and_stream(demuxer);
+    return ok;
+}
+
+static void scan_thread(void *arg)
+{
+    struct scan_job *job = arg;
+    struct rgain_scan *ctx = job->ctx;
+
+    struct replaygain_data rg;
+    bool ok = !mp_cancel_test(ctx->cancel) && scan_file(ctx, job, &rg);
+    if (ok)
+        write_cache(ctx, job, &rg);
+
+    pthread_mutex_lock(&ctx->lock);
+    struct rgain_entry *e = find_entry(ctx, job->key);
+    if (e) {
+        e->pending = false;
+        e->valid = ok;
+        if (ok)
+            e->rg = rg;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    talloc_free(job);
+}
+
+static struct rgain_scan *get_ctx(struct MPContext *mpctx)
+{
+    if (mpctx->rgain_scan)
+        return mpctx->rgain_scan;
+
+    struct rgain_scan *ctx = talloc_zero(NULL, struct rgain_scan);
+    ctx->log = mp_log_new(ctx, mpctx->log, "rgain-scan");
+    ctx->global = mpctx->global;
+    ctx->cancel = mp_cancel_new(ctx);
+    ctx->cache_dir = mp_find_user_config_file(ctx, mpctx->global, CACHE_DIR);
+    pthread_mutex_init(&ctx->lock, NULL);
+    mpctx->rgain_scan = ctx;
+    return ctx;
+}
+
+// Return the scanned replaygain data for the given playlist entry filename,
+// or NULL if it wasn't scanned (yet).
+struct replaygain_data *mp_rgain_scan_lookup(void *talloc_ctx,
+                                             struct MPContext *mpctx,
+                                             const char *url)
+{
+    struct rgain_scan *ctx = get_ctx(mpctx);
+    char *key = get_file_key(NULL, url);
+    struct replaygain_data rg;
+
+    pthread_mutex_lock(&ctx->lock);
+    struct rgain_entry *e = find_entry(ctx, key);
+    bool found = e && e->valid;
+    if (found)
+        rg = e->rg;
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (!found && !(e && e->pending))
+        found = read_cache(ctx, key, &rg);
+
+    talloc_free(key);
+
+    if (!found)
+        return NULL;
+    MP_VERBOSE(mpctx, "Using scanned replaygain for %s\n", url);
+    return talloc_memdup(talloc_ctx, &rg, sizeof(rg));
+}
+
+static void queue_scan(struct MPContext *mpctx, struct rgain_scan *ctx,
+                       struct playlist_entry *entry)
+{
+    char *key = get_file_key(NULL, entry->filename);
+
+    pthread_mutex_lock(&ctx->lock);
+    bool known = find_entry(ctx, key);
+    pthread_mutex_unlock(&ctx->lock);
+
+    struct replaygain_data rg;
+    if (known || read_cache(ctx, key, &rg)) {
+        talloc_free(key);
+        return;
+    }
+
+    if (!ctx->pool)
+        ctx->pool = mp_thread_pool_create(ctx, mpctx->opts->rgain_scan_threads);
+    if (!ctx->pool) {
+        talloc_free(key);
+        return;
+    }
+
+    struct rgain_entry *e = talloc_zero(ctx, struct rgain_entry);
+    e->key = talloc_steal(e, key);
+    e->pending = true;
+
+    pthread_mutex_lock(&ctx->lock);
+    prune_entries(ctx);
+    MP_TARRAY_APPEND(ctx, ctx->entries, ctx->num_entries, e);
+    pthread_mutex_unlock(&ctx->lock);
+
+    struct scan_job *job = talloc_zero(NULL, struct scan_job);
+    *job = (struct scan_job){
+        .ctx = ctx,
+        .url = talloc_strdup(job, entry->filename),
+        .url_flags = entry->stream_flags,
+        .key = talloc_strdup(job, e->key),
+    };
+    if (mpctx->opts->load_unsafe_playlists)
+        job->url_flags = 0;
+
+    MP_VERBOSE(mpctx, "Queuing replaygain scan: %s\n", entry->filename);
+    mp_thread_pool_queue(ctx->pool, scan_thread, job);
+}
+
+// Queue the --replaygain-scan-ahead playlist entries following the currently
+// playing one for scanning, unless they're scanned already. The playing entry
+// itself is not scanned: that would decode it a second time, and the result
+// is only applied when playback of a file starts.
+void mp_rgain_scan_update(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    if (!opts->rgain_scan || !mpctx->playing)
+        return;
+
+    struct rgain_scan *ctx = get_ctx(mpctx);
+    struct playlist_entry *e = mpctx->playing->next;
+    for (int n = 0; e && n < opts->rgain_scan_ahead; n++) {
+        if (e->filename)
+            queue_scan(mpctx, ctx, e);
+        e = e->next;
+    }
+}
+
+// Abort all scans, and wait until the worker threads have exited.
+void mp_rgain_scan_uninit(struct MPContext *mpctx)
+{
+    struct rgain_scan *ctx = mpctx->rgain_scan;
+    if (!ctx)
+        return;
+
+    mp_cancel_trigger(ctx->cancel);
+    TA_FREEP(&ctx->pool);
+    pthread_mutex_destroy(&ctx->lock);
+    talloc_free(ctx);
+    mpctx->rgain_scan = NULL;
+}
@@ -29,7 +29,6 @@
 #include "command.h"
 #include "misc/bstr.h"
 #include "misc/dispatch.h"
-#include "misc/thread_pool.h"
 #include "common/msg.h"
 #include "options/path.h"
 #include "video/mp_image.h"
@@ -51,8 +50,6 @@ typedef struct screenshot_ctx {
     bool osd;
 
     int frameno;
-
-    struct mp_thread_pool *thread_pool;
 } screenshot_ctx;
 
 void screenshot_init(struct MPContext *mpctx)
@@ -62,6 +59,8 @@ void screenshot_init(struct MPContext *mpctx)
         .mpctx = mpctx,
         .frameno = 1,
     };
+    mpctx->image_writer_queue =
+        image_writer_queue_create(mpctx, mpctx->global, mpctx->log);
 }
 
 static void screenshot_msg(screenshot_ctx *ctx, int status, const char *msg,
@@ -93,72 +92,66 @@ static char *stripext(void *talloc_ctx, const char *s)
 }
 
 struct screenshot_item {
-    bool on_thread;
     struct MPContext *mpctx;
-    const char *filename;
-    struct mp_image *img;
-    struct image_writer_opts opts;
+    bool success;
 };
 
-#define LOCK(item) if (item->on_thread) mp_dispatch_lock(item->mpctx->dispatch);
-#define UNLOCK(item) if (item->on_thread) mp_dispatch_unlock(item->mpctx->dispatch);
-
-static void write_screenshot_thread(void *arg)
+// Called on the core thread.
+static void write_screenshot_finish(void *arg)
 {
     struct screenshot_item *item = arg;
-    screenshot_ctx *ctx = item->mpctx->screenshot_ctx;
-
-    LOCK(item)
-    screenshot_msg(ctx, MSGL_INFO, "Screenshot: '%s'", item->filename);
-    UNLOCK(item)
+    struct MPContext *mpctx = item->mpctx;
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
 
-    if (!item->img || !write_image(item->img, &item->opts, item->filename,
-                                   item->mpctx->log))
-    {
-        LOCK(item)
+    if (!item->success)
         screenshot_msg(ctx, MSGL_ERR, "Error writing screenshot!");
-        UNLOCK(item)
-    }
-
-    if (item->on_thread) {
-        mp_dispatch_lock(item->mpctx->dispatch);
-        screenshot_msg(ctx, MSGL_V, "Screenshot writing done.");
-        item->mpctx->outstanding_async -= 1;
-        mp_wakeup_core(item->mpctx);
-        mp_dispatch_unlock(item->mpctx->dispatch);
-    }
+    screenshot_msg(ctx, MSGL_V, "Screenshot writing done.");
+    mpctx->outstanding_async -= 1;
+    mp_wakeup_core(mpctx);
 
     talloc_free(item);
 }
 
+// Called on a worker thread of the image writer queue. This must not wait for
+// the core thread: it might be blocked in image_writer_queue_add() until a
+// worker becomes free.
+static void write_screenshot_done(void *arg, bool success)
+{
+    struct screenshot_item *item = arg;
+
+    item->success = success;
+    mp_dispatch_enqueue(item->mpctx->dispatch, write_screenshot_finish, item);
+}
+
 static void write_screenshot(struct MPContext *mpctx, struct mp_image *img,
                              const char *filename, struct image_writer_opts *opts,
                              bool async)
 {
     screenshot_ctx *ctx = mpctx->screenshot_ctx;
     struct image_writer_opts *gopts = mpctx->opts->screenshot_image_opts;
+    if (!opts)
+        opts = gopts;
 
-    struct screenshot_item *item = talloc_zero(NULL, struct screenshot_item);
-    *item = (struct screenshot_item){
-        .mpctx = mpctx,
-        .filename = talloc_strdup(item, filename),
-        .img = talloc_steal(item, mp_image_new_ref(img)),
-        .opts = opts ? *opts : *gopts,
-    };
+    screenshot_msg(ctx, MSGL_INFO, "Screenshot: '%s'", filename);
 
-    if (async) {
-        if (!ctx->thread_pool)
-            ctx->thread_pool = mp_thread_pool_create(ctx, 1);
-        if (ctx->thread_pool) {
-            item->on_thread = true;
-            mpctx->outstanding_async += 1;
-            mp_thread_pool_queue(ctx->thread_pool, write_screenshot_thread, item);
-            item = NULL;
-        }
+    if (!async) {
+        if (!write_image(img, opts, filename, mpctx->log))
+            screenshot_msg(ctx, MSGL_ERR, "Error writing screenshot!");
+        return;
     }
 
-    if (item)
-        write_screenshot_thread(item);
+    // This blocks if too many screenshots are being encoded, which throttles
+    // the playloop in each-frame mode.
+    struct screenshot_item *item = talloc_ptrtype(NULL, item);
+    *item = (struct screenshot_item){ .mpctx = mpctx };
+    mpctx->outstanding_async += 1;
+    if (!image_writer_queue_add(mpctx->image_writer_queue, img, opts, filename,
+                                write_screenshot_done, item))
+    {
+        mpctx->outstanding_async -= 1;
+        talloc_free(item);
+        screenshot_msg(ctx, MSGL_WARN, "Screenshot '%s' dropped.", filename);
+    }
 }
 
 #ifdef _WIN32
@@ -511,5 +504,5 @@ void screenshot_flip(struct MPContext *mpctx)
         return;
 
     ctx->each_frame = false;
-    screenshot_request(mpctx, ctx->mode, true, ctx->osd, false);
+    screenshot_request(mpctx, ctx->mode, true, ctx->osd, true);
 }
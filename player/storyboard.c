@@ -0,0 +1,388 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "mpv_talloc.h"
+
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "demux/demux.h"
+#include "demux/stheader.h"
+#include "filters/f_decoder_wrapper.h"
+#include "filters/filter.h"
+#include "misc/thread_pool.h"
+#include "options/options.h"
+#include "options/path.h"
+#include "stream/stream.h"
+#include "video/image_writer.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "video/mp_image_pool.h"
+#include "video/sws_utils.h"
+
+#include "core.h"
+
+struct storyboard_ctx {
+    struct mp_log *log;
+    struct mpv_global *global;
+    struct mp_cancel *cancel;
+    struct mp_thread_pool *pool;
+    int threads;
+
+    pthread_mutex_t lock;
+    // --- the following fields are protected by lock
+    int pending;                // storyboards not written yet
+};
+
+struct storyboard {
+    struct storyboard_ctx *ctx;
+    char *url;
+    char *filename;
+    struct image_writer_opts opts;
+    int cols, rows;
+    int tile_w, tile_h;
+
+    // Set by the first job, which opens the file and queues the others.
+    double start, duration;
+    struct mp_image *sheet;
+    double *pts;                // actual time of each tile (or MP_NOPTS_VALUE)
+
+    int parts_left;             // protected by ctx->lock
+};
+
+struct storyboard_part {
+    struct storyboard *sb;
+    int first, last;            // range of tiles decoded by this job
+};
+
+static struct sh_stream *select_video_stream(struct demuxer *demuxer)
+{
+    struct sh_stream *res = NULL;
+    for (int n = 0; n < demux_get_num_stream(demuxer); n++) {
+        struct sh_stream *sh = demux_get_stream(demuxer, n);
+        if (sh->type == STREAM_VIDEO && !sh->attached_picture &&
+            (!res || (sh->default_track && !res->default_track)))
+            res = sh;
+    }
+    return res;
+}
+
+static struct demuxer *open_file(struct storyboard *sb, struct sh_stream **sh)
+{
+    struct storyboard_ctx *ctx = sb->ctx;
+    struct demuxer_params params = {
+        .disable_cache = true,
+    };
+    struct demuxer *demuxer =
+        demux_open_url(sb->url, &params, ctx->cancel, ctx->global);
+    if (!demuxer)
+        return NULL;
+    *sh = select_video_stream(demuxer);
+    if (!*sh || !demuxer->seekable) {
+        MP_ERR(ctx, "%s has no seekable video.\n", sb->url);
+        free_demuxer_and_stream(demuxer);
+        return NULL;
+    }
+    demuxer_select_track(demuxer, *sh, MP_NOPTS_VALUE, true);
+    return demuxer;
+}
+
+// Seek to the keyframe before each tile's time, decode only that keyframe, and
+// scale it into the sheet. Different jobs write disjoint parts of the sheet.
+static void decode_tiles(struct storyboard *sb, struct demuxer *demuxer,
+                         struct sh_stream *sh, int first, int last)
+{
+    struct storyboard_ctx *ctx = sb->ctx;
+    struct mp_filter *root = mp_filter_create_root(ctx->global);
+    struct mp_decoder_wrapper *dec = mp_decoder_wrapper_create(root, sh);
+    if (!dec)
+        goto done;
+    dec->keyframes_only = true;
+
+    struct mp_sws_context *sws = mp_sws_alloc(root);
+    sws->log = ctx->log;
+    mp_sws_set_from_cmdline(sws, ctx->global);
+
+    int num_tiles = sb->cols * sb->rows;
+    for (int n = first; n < last && !mp_cancel_test(ctx->cancel); n++) {
+        double target = sb->start + sb->duration * (n + 0.5) / num_tiles;
+        demux_seek(demuxer, target, 0);
+        mp_filter_reset(root);
+
+        struct mp_frame frame = read_frame_sync(root, dec->f->pins[0],
+                                                MP_FRAME_VIDEO, ctx->cancel);
+        struct mp_image *img = NULL;
+        if (frame.type == MP_FRAME_VIDEO) {
+            img = frame.data;
+        } else {
+            mp_frame_unref(&frame);
+        }
+        if (img && IMGFMT_IS_HWACCEL(img->imgfmt)) {
+            struct mp_image *sw = mp_image_hw_download(img, NULL);
+            talloc_free(img);
+            img = sw;
+        }
+        if (!img) {
+            MP_VERBOSE(ctx, "No frame for tile %d at %f.\n", n, target);
+            continue;
+        }
+
+        int x = (n % sb->cols) * sb->tile_w;
+        int y = (n / sb->cols) * sb->tile_h;
+        struct mp_image tile = *sb->sheet;
+        mp_image_crop(&tile, x, y, x + sb->tile_w, y + sb->tile_h);
+        if (mp_sws_scale(sws, &tile, img) >= 0)
+            sb->pts[n] = img->pts;
+        talloc_free(img);
+    }
+
+done:
+    talloc_free(root);
+}
+
+static void write_timestamp(FILE *f, double t)
+{
+    int64_t ms = llrint(MPMAX(t, 0) * 1000);
+    fprintf(f, "%02d:%02d:%02d.%03d", (int)(ms / 3600000),
+            (int)(ms / 60000 % 60), (int)(ms / 1000 % 60), (int)(ms % 1000));
+}
+
+// Write a WebVTT file, which maps time ranges to sheet tiles as media
+// fragments. Each tile is shown up to the actual frame time of the next tile;
+// tiles that repeat the previous keyframe are skipped.
+static bool write_vtt(struct storyboard *sb, const char *filename)
+{
+    FILE *f = fopen(filename, "wb");
+    if (!f)
+        return false;
+    char *image = mp_basename(sb->filename);
+    int num_tiles = sb->cols * sb->rows;
+    fprintf(f, "WEBVTT\n");
+    double prev_end = sb->start;
+    for (int n = 0; n < num_tiles; n++) {
+        if (sb->pts[n] == MP_NOPTS_VALUE)
+            continue;
+        double end = sb->start + sb->duration;
+        for (int i = n + 1; i < num_tiles; i++) {
+            if (sb->pts[i] != MP_NOPTS_VALUE && sb->pts[i] > sb->pts[n]) {
+                end = sb->pts[i];
+                break;
+            }
+        }
+        if (end <= prev_end)
+            continue;
+        fprintf(f, "\n");
+        write_timestamp(f, prev_end - sb->start);
+        fprintf(f, " --> ");
+        write_timestamp(f, end - sb->start);
+        fprintf(f, "\n%s#xywh=%d,%d,%d,%d\n", image,
+                (n % sb->cols) * sb->tile_w, (n / sb->cols) * sb->tile_h,
+                sb->tile_w, sb->tile_h);
+        prev_end = end;
+    }
+    return fclose(f) == 0;
+}
+
+static void finish(struct storyboard *sb)
+{
+    struct storyboard_ctx *ctx = sb->ctx;
+
+    if (sb->sheet && !mp_cancel_test(ctx->cancel)) {
+        bstr root = bstr0(sb->filename);
+        mp_splitext(sb->filename, &root);
+        char *vtt = talloc_asprintf(sb, "%.*s.vtt", BSTR_P(root));
+        if (write_image(sb->sheet, &sb->opts, sb->filename, ctx->log) &&
+            write_vtt(sb, vtt))
+        {
+            MP_INFO(ctx, "Storyboard written to %s and %s\n", sb->filename,
+                    vtt);
+        } else {
+            MP_ERR(ctx, "Writing storyboard %s failed.\n", sb->filename);
+        }
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->pending -= 1;
+    pthread_mutex_unlock(&ctx->lock);
+
+    talloc_free(sb);
+}
+
+static void part_done(struct storyboard *sb)
+{
+    struct storyboard_ctx *ctx = sb->ctx;
+    pthread_mutex_lock(&ctx->lock);
+    bool last = --sb->parts_left == 0;
+    pthread_mutex_unlock(&ctx->lock);
+    if (last)
+        finish(sb);
+}
+
+static void part_thread(void *arg)
+{
+    struct storyboard_part *part = arg;
+    struct storyboard *sb = part->sb;
+
+    struct sh_stream *sh;
+    struct demuxer *demuxer = NULL;
+    if (!mp_cancel_test(sb->ctx->cancel))
+        demuxer = open_file(sb, &sh);
+    if (demuxer) {
+        decode_tiles(sb, demuxer, sh, part->first, part->last);
+        free_demuxer_and_stream(demuxer);
+    }
+
+    talloc_free(part);
+    part_done(sb);
+}
+
+// Open the file, set up the sheet, and split the tiles into ranges, which are
+// decoded in parallel, each with its own demuxer and decoder.
+static void storyboard_thread(void *arg)
+{
+    struct storyboard *sb = arg;
+    struct storyboard_ctx *ctx = sb->ctx;
+
+    struct sh_stream *sh;
+    struct demuxer *demuxer = NULL;
+    if (!mp_cancel_test(ctx->cancel))
+        demuxer = open_file(sb, &sh);
+    if (!demuxer || demuxer->duration <= 0) {
+        if (demuxer)
+            MP_ERR(ctx, "Unknown duration for %s.\n", sb->url);
+        free_demuxer_and_stream(demuxer);
+        finish(sb);
+        return;
+    }
+
+    struct mp_codec_params *c = sh->codec;
+    double aspect = c->disp_w > 0 && c->disp_h > 0
+                  ? c->disp_w / (double)c->disp_h : 16 / 9.0;
+    if (c->par_w > 0 && c->par_h > 0)
+        aspect = aspect * c->par_w / c->par_h;
+    sb->tile_h = MPMAX(lrint(sb->tile_w / aspect), 1);
+    sb->start = demuxer->start_time;
+    sb->duration = demuxer->duration;
+
+    int num_tiles = sb->cols * sb->rows;
+    sb->pts = talloc_array(sb, double, num_tiles);
+    for (int n = 0; n < num_tiles; n++)
+        sb->pts[n] = MP_NOPTS_VALUE;
+    sb->sheet = mp_image_alloc(IMGFMT_BGR0, sb->cols * sb->tile_w,
+                               sb->rows * sb->tile_h);
+    if (!sb->sheet) {
+        free_demuxer_and_stream(demuxer);
+        finish(sb);
+        return;
+    }
+    talloc_steal(sb, sb->sheet);
+    mp_image_clear(sb->sheet, 0, 0, sb->sheet->w, sb->sheet->h);
+
+    int num_parts = MPMIN(ctx->threads, num_tiles);
+    sb->parts_left = num_parts;
+    for (int n = 1; n < num_parts; n++) {
+        struct storyboard_part *part = talloc_ptrtype(NULL, part);
+        *part = (struct storyboard_part){
+            .sb = sb,
+            .first = num_tiles * n / num_parts,
+            .last = num_tiles * (n + 1) / num_parts,
+        };
+        mp_thread_pool_queue(ctx->pool, part_thread, part);
+    }
+
+    decode_tiles(sb, demuxer, sh, 0, num_tiles / num_parts);
+    free_demuxer_and_stream(demuxer);
+    part_done(sb);
+}
+
+static struct storyboard_ctx *get_ctx(struct MPContext *mpctx)
+{
+    if (mpctx->storyboard_ctx)
+        return mpctx->storyboard_ctx;
+
+    struct storyboard_ctx *ctx = talloc_zero(NULL, struct storyboard_ctx);
+    ctx->log = mp_log_new(ctx, mpctx->log, "storyboard");
+    ctx->global = mpctx->global;
+    ctx->cancel = mp_cancel_new(ctx);
+    ctx->threads = mpctx->opts->storyboard_threads;
+    ctx->pool = mp_thread_pool_create(ctx, ctx->threads);
+    pthread_mutex_init(&ctx->lock, NULL);
+    mpctx->storyboard_ctx = ctx;
+    return ctx;
+}
+
+// Start writing a cols x rows sheet of tile_w wide thumbnails of url to
+// filename in the background. Returns false if it could not be started.
+bool mp_storyboard_start(struct MPContext *mpctx, const char *url,
+                         const char *filename, int cols, int rows, int tile_w)
+{
+    struct storyboard_ctx *ctx = get_ctx(mpctx);
+    if (!ctx->pool)
+        return false;
+
+    struct storyboard *sb = talloc_zero(NULL, struct storyboard);
+    *sb = (struct storyboard){
+        .ctx = ctx,
+        .url = talloc_strdup(sb, url),
+        .filename = talloc_strdup(sb, filename),
+        .opts = *mpctx->opts->screenshot_image_opts,
+        .cols = cols,
+        .rows = rows,
+        .tile_w = tile_w,
+    };
+    int format = image_writer_format_from_ext(mp_splitext(filename, NULL));
+    if (format)
+        sb->opts.format = format;
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->pending += 1;
+    pthread_mutex_unlock(&ctx->lock);
+
+    MP_VERBOSE(ctx, "Queuing storyboard for %s\n", url);
+    mp_thread_pool_queue(ctx->pool, storyboard_thread, sb);
+    return true;
+}
+
+// Number of storyboards that were started, but are not written yet.
+int mp_storyboard_pending(struct MPContext *mpctx)
+{
+    struct storyboard_ctx *ctx = mpctx->storyboard_ctx;
+    if (!ctx)
+        return 0;
+    pthread_mutex_lock(&ctx->lock);
+    int res = ctx->pending;
+    pthread_mutex_unlock(&ctx->lock);
+    return res;
+}
+
+// Abort all storyboards, and wait until the worker threads have exited.
+void mp_storyboard_uninit(struct MPContext *mpctx)
+{
+    struct storyboard_ctx *ctx = mpctx->storyboard_ctx;
+    if (!ctx)
+        return;
+
+    mp_cancel_trigger(ctx->cancel);
+    TA_FREEP(&ctx->pool);
+    pthread_mutex_destroy(&ctx->lock);
+    talloc_free(ctx);
+    mpctx->storyboard_ctx = NULL;
+}
@@ -34,6 +34,7 @@
 #include "demux/demux.h"
 #include "video/mp_image.h"
 
+#include "command.h"
 #include "core.h"
 
 // 0: primary sub, 1: secondary sub, -1: not selected
@@ -79,6 +80,83 @@ void uninit_sub_all(struct MPContext *mpctx)
         uninit_sub(mpctx, mpctx->tracks[n]);
 }
 
+// Start reading the whole subtitle file in the background, if possible.
+static void start_preload(struct MPContext *mpctx, struct track *track)
+{
+    struct dec_sub *dec_sub = track->d_sub;
+
+    if (!track->demuxer->fully_read || !sub_can_preload(dec_sub))
+        return;
+
+    // Assume fully_read implies no interleaved audio/video streams.
+    // (Reading packets will change the demuxer position.)
+    demux_seek(track->demuxer, 0, 0);
+    int64_t size = -1;
+    if (track->demuxer->stream)
+        size = stream_get_size(track->demuxer->stream);
+    track->sub_preloading = true;
+    sub_preload(dec_sub, size, mp_wakeup_core_cb, mpctx);
+    mp_notify_property(mpctx, "sub-preload-progress");
+}
+
+// Redraw once a subtitle track finished preloading, so that its subtitles
+// show up even while paused.
+void handle_sub_preload(struct MPContext *mpctx)
+{
+    for (int n = 0; n < mpctx->num_tracks; n++) {
+        struct track *track = mpctx->tracks[n];
+        if (!track->sub_preloading || !track->d_sub ||
+            sub_get_preload_progress(track->d_sub) < 1)
+            continue;
+        track->sub_preloading = false;
+        osd_changed(mpctx->osd);
+        mp_notify_property(mpctx, "sub-preload-progress");
+    }
+}
+
+// Subtitle events that ended this long (in seconds) before the playback
+// position are kept even if they are not cached, e.g. for sub-step.
+#define SUB_EVENT_HISTORY 60
+
+// Don't prune again until playback advanced this much (in seconds).
+#define SUB_PRUNE_INTERVAL 10
+
+// Let the decoder discard events that can't be shown again without reading
+// their packets again, so that endless streams don't use more and more memory.
+static void prune_subtitle_events(struct MPContext *mpctx, struct track *track,
+                                  double video_pts)
+{
+    struct demuxer *demuxer = track->demuxer;
+    int prune = mpctx->opts->subs_rend->sub_prune_events;
+    // By default only for streams that can't be seeked in normally, such as
+    // live streams. In seekable files, sub-step and seeking back would lose
+    // events that started before the seek target.
+    if (prune < 0) {
+        prune = !demuxer->seekable || demuxer->partially_seekable ||
+                demuxer->duration < 0;
+    }
+    if (!prune)
+        return;
+
+    if (track->sub_prune_pts != MP_NOPTS_VALUE &&
+        video_pts >= track->sub_prune_pts &&
+        video_pts < track->sub_prune_pts + SUB_PRUNE_INTERVAL)
+        return;
+    track->sub_prune_pts = video_pts;
+
+    double pts = video_pts;
+    struct demux_ctrl_reader_state s;
+    if (demux_control(demuxer, DEMUXER_CTRL_GET_READER_STATE, &s) > 0) {
+        for (int n = 0; n < s.num_seek_ranges; n++) {
+            struct demux_seek_range *r = &s.seek_ranges[n];
+            if (r->start <= video_pts && video_pts <= r->end)
+                pts = MPMIN(pts, r->start);
+        }
+    }
+    pts -= SUB_EVENT_HISTORY;
+    sub_control(track->d_sub, SD_CTRL_PRUNE_EVENTS, &pts);
+}
+
 static bool update_subtitle(struct MPContext *mpctx, double video_pts,
                             struct track *track)
 {
@@ -93,16 +171,13 @@ static bool update_subtitle(struct MPContext *mpctx, double video_pts,
             sub_control(dec_sub, SD_CTRL_SET_VIDEO_PARAMS, &params);
     }
 
-    if (track->demuxer->fully_read && sub_can_preload(dec_sub)) {
-        // Assume fully_read implies no interleaved audio/video streams.
-        // (Reading packets will change the demuxer position.)
-        demux_seek(track->demuxer, 0, 0);
-        sub_preload(dec_sub);
-    }
+    start_preload(mpctx, track);
 
     if (!sub_read_packets(dec_sub, video_pts))
         return false;
 
+    prune_subtitle_events(mpctx, track, video_pts);
+
     // Handle displaying subtitles on terminal; never done for secondary subs
     if (mpctx->current_track[0][STREAM_SUB] == track && !mpctx->video_out)
         term_osd_set_subs(mpctx, sub_get_text(dec_sub, video_pts));
@@ -133,6 +208,16 @@ bool update_subtitles(struct MPContext *mpctx, double video_pts)
     return ok;
 }
 
+// Hint the future video frame timestamps for --sub-prerender.
+void prerender_subtitles(struct MPContext *mpctx, double *video_pts, int num_pts)
+{
+    for (int n = 0; n < NUM_PTRACKS; n++) {
+        struct track *track = mpctx->current_track[n][STREAM_SUB];
+        if (track && track->d_sub)
+            sub_prerender(track->d_sub, video_pts, num_pts);
+    }
+}
+
 static struct attachment_list *get_all_attachments(struct MPContext *mpctx)
 {
     struct attachment_list *list = talloc_zero(NULL, struct attachment_list);
@@ -192,6 +277,8 @@ void reinit_sub(struct MPContext *mpctx, struct track *track)
     osd_set_sub(mpctx->osd, order, track->d_sub);
     sub_control(track->d_sub, SD_CTRL_SET_TOP, &(bool){!!order});
 
+    start_preload(mpctx, track);
+
     if (mpctx->playback_initialized)
         update_subtitles(mpctx, mpctx->playback_pts);
 }
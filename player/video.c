@@ -222,6 +222,7 @@ void reinit_video_chain_src(struct MPContext *mpctx, struct track *track)
             .input_ctx = mpctx->input,
             .osd = mpctx->osd,
             .encode_lavc_ctx = mpctx->encode_lavc_ctx,
+            .image_writer_queue = mpctx->image_writer_queue,
             .wakeup_cb = mp_wakeup_core_cb,
             .wakeup_ctx = mpctx,
         };
@@ -394,6 +395,15 @@ static void shift_frames(struct MPContext *mpctx)
     mpctx->num_next_frames -= 1;
 }
 
+static bool have_subtitles(struct MPContext *mpctx)
+{
+    for (int n = 0; n < NUM_PTRACKS; n++) {
+        if (mpctx->current_track[n][STREAM_SUB])
+            return true;
+    }
+    return false;
+}
+
 static int get_req_frames(struct MPContext *mpctx, bool eof)
 {
     // On EOF, drain all frames.
@@ -414,6 +424,9 @@ static int get_req_frames(struct MPContext *mpctx, bool eof)
         return mpctx->opts->video_sync == VS_DEFAULT ? 1 : min;
 
     int req = vo_get_num_req_frames(mpctx->video_out);
+    // Decode ahead so that the subtitles for these frames can be prerendered.
+    if (mpctx->opts->subs_rend->sub_prerender && have_subtitles(mpctx))
+        req = MPMAX(req, mpctx->opts->subs_rend->sub_prerender + 1);
     return MPCLAMP(req, min, MP_ARRAY_SIZE(mpctx->next_frames) - 1);
 }
 
@@ -1013,7 +1026,7 @@ void write_video(struct MPContext *mpctx)
                 mpctx->time_frame = 0;
             }
             // Encode mode can't honor this; it'll only delay finishing.
-            if (mpctx->encode_lavc_ctx)
+            if (mpctx->encode_lavc_ctx || mpctx->offline)
                 mpctx->time_frame = 0;
         }
 
@@ -1141,8 +1154,21 @@ void write_video(struct MPContext *mpctx)
     mpctx->osd_force_update = true;
     update_osd_msg(mpctx);
 
+    if (opts->subs_rend->sub_prerender) {
+        double prerender_pts[MP_ARRAY_SIZE(mpctx->next_frames) + 1];
+        int num_pts = 0;
+        prerender_pts[num_pts++] = mpctx->video_pts;
+        for (int n = 0; n < mpctx->num_next_frames; n++)
+            prerender_pts[num_pts++] = mpctx->next_frames[n]->pts;
+        prerender_subtitles(mpctx, prerender_pts, num_pts);
+    }
+
     vo_queue_frame(vo, frame);
 
+    // The VO might be ready for the next frame immediately.
+    if (mpctx->offline)
+        mp_wakeup_core(mpctx);
+
     check_framedrop(mpctx, vo_c);
 
     // The frames were shifted down; "initialize" the new first entry.
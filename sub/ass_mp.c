@@ -34,6 +34,7 @@
 #include "ass_mp.h"
 #include "img_convert.h"
 #include "osd.h"
+#include "osdep/atomic.h"
 #include "stream/stream.h"
 #include "options/options.h"
 #include "video/out/bitmap_packer.h"
@@ -192,13 +193,23 @@ struct mp_ass_packer {
     bool cached_subs_valid;
     struct sub_bitmap rgba_imgs[MP_SUB_BB_LIST_MAX];
     struct bitmap_packer *packer;
+    // SUBBITMAP_LIBASS: persistent atlas, updated incrementally
+    struct bitmap_atlas *atlas;
+    struct bitmap_atlas_item *atlas_items;
+    struct sub_bitmap *atlas_parts; // parts being packed (for atlas_same_content)
+    struct mp_image *atlas_img;
+    uint64_t atlas_version;
 };
 
+// Globally unique, so that consumers never confuse versions of two packers.
+static atomic_ullong atlas_version_counter = ATOMIC_VAR_INIT(0);
+
 // Free with talloc_free().
 struct mp_ass_packer *mp_ass_packer_alloc(void *ta_parent)
 {
     struct mp_ass_packer *p = talloc_zero(ta_parent, struct mp_ass_packer);
     p->packer = talloc_zero(p, struct bitmap_packer);
+    p->atlas = talloc_zero(p, struct bitmap_atlas);
     return p;
 }
 
@@ -242,23 +253,82 @@ static bool pack(struct mp_ass_packer *p, struct sub_bitmaps *res, int imgfmt)
     return true;
 }
 
+static bool atlas_same_content(void *ctx, struct bitmap_atlas_item *item)
+{
+    struct mp_ass_packer *p = ctx;
+    struct sub_bitmap *b = &p->atlas_parts[item - p->atlas_items];
+    struct mp_image *img = p->atlas_img;
+    for (int y = 0; y < b->h; y++) {
+        uint8_t *a = img->planes[0] + (item->pos.y + y) * img->stride[0] +
+                     item->pos.x;
+        if (memcmp(a, (uint8_t *)b->bitmap + y * b->stride, b->w))
+            return false;
+    }
+    return true;
+}
+
+// Bitmaps returned by libass are mostly the same between renders, so keep them
+// in the atlas, and only copy (and let the VO upload) the new ones.
 static bool pack_libass(struct mp_ass_packer *p, struct sub_bitmaps *res)
 {
-    if (!pack(p, res, IMGFMT_Y8))
+    if (res->num_parts == 0)
+        return false;
+
+    MP_TARRAY_GROW(p, p->atlas_items, res->num_parts);
+    for (int n = 0; n < res->num_parts; n++) {
+        struct sub_bitmap *b = &res->parts[n];
+        p->atlas_items[n] = (struct bitmap_atlas_item){
+            .key = b->bitmap,
+            .w = b->w,
+            .h = b->h,
+        };
+    }
+    p->atlas_parts = res->parts;
+
+    int r = bitmap_atlas_pack(p->atlas, p->atlas_items, res->num_parts,
+                              atlas_same_content, p);
+    if (r < 0)
         return false;
 
+    struct bitmap_atlas *a = p->atlas;
+    if (!p->atlas_img || p->atlas_img->w != a->w || p->atlas_img->h != a->h) {
+        assert(r > 0);
+        talloc_free(p->atlas_img);
+        p->atlas_img = mp_image_alloc(IMGFMT_Y8, a->w, a->h);
+        if (!p->atlas_img) {
+            bitmap_atlas_reset(a);
+            return false;
+        }
+        talloc_steal(p, p->atlas_img);
+    }
+
+    res->packed = p->atlas_img;
+    res->packed_w = a->used_width;
+    res->packed_h = a->used_height;
+
+    int stride = res->packed->stride[0];
     for (int n = 0; n < res->num_parts; n++) {
         struct sub_bitmap *b = &res->parts[n];
+        struct bitmap_atlas_item *item = &p->atlas_items[n];
 
-        int stride = res->packed->stride[0];
-        void *pdata =
-            (uint8_t *)res->packed->planes[0] + b->src_y * stride + b->src_x;
-        memcpy_pic(pdata, b->bitmap, b->w, b->h, stride, b->stride);
+        b->src_x = item->pos.x;
+        b->src_y = item->pos.y;
+
+        void *pdata = (uint8_t *)res->packed->planes[0] + b->src_y * stride +
+                      b->src_x;
+        if (item->is_new)
+            memcpy_pic(pdata, b->bitmap, b->w, b->h, stride, b->stride);
 
         b->bitmap = pdata;
         b->stride = stride;
     }
 
+    res->packed_prev_version = r == 0 ? p->atlas_version : 0;
+    p->atlas_version = atomic_fetch_add(&atlas_version_counter, 1) + 1;
+    res->packed_version = p->atlas_version;
+    res->packed_dirty = a->dirty;
+    res->num_packed_dirty = a->num_dirty;
+
     return true;
 }
 
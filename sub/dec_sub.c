@@ -32,6 +32,7 @@
 #include "common/msg.h"
 #include "common/recorder.h"
 #include "osdep/threads.h"
+#include "video/mp_image.h"
 
 extern const struct sd_functions sd_ass;
 extern const struct sd_functions sd_lavc;
@@ -44,6 +45,18 @@ static const struct sd_functions *const sd_list[] = {
     NULL
 };
 
+// Subtitle bitmaps rendered by the prerender thread, with copies of all data.
+// Consecutive frames with the same contents share the same instance.
+struct prerendered {
+    struct sub_bitmaps imgs;
+    int refcount;
+};
+
+struct prerender_frame {
+    double pts;                 // in subtitle time
+    struct prerendered *res;    // NULL if not rendered yet
+};
+
 struct dec_sub {
     pthread_mutex_t lock;
 
@@ -69,8 +82,222 @@ struct dec_sub {
     struct sd *sd;
 
     struct demux_packet *new_segment;
+
+    // For sub_preload(). While preloading is true, the thread owns the demuxer
+    // stream, and no subtitles are shown.
+    pthread_t preload_thread;
+    bool preload_thread_valid;
+    bool preloading;
+    bool preload_exit;
+    int64_t preload_size;       // size of the source file, or -1
+    int64_t preload_pos;        // file position of the last packet read
+    void (*preload_wakeup)(void *ctx);
+    void *preload_wakeup_ctx;
+
+    // For --sub-prerender. The thread renders frames[] that have no res yet,
+    // using the parameters of the last sub_get_bitmaps() call.
+    pthread_t prerender_thread;
+    bool prerender_thread_valid;
+    bool prerender_exit;
+    pthread_cond_t prerender_wakeup;
+    struct mp_osd_res prerender_dim;
+    int prerender_format;       // 0 if not known yet
+    struct prerender_frame *prerender_frames; // sorted by pts
+    int num_prerender_frames;
+    struct prerendered *prerender_last;  // last frame the thread rendered
+    uint64_t prerender_gen;     // incremented if the busy frame is invalid
+    struct sd *prerender_busy_sd;   // decoder the thread renders with unlocked
+    double prerender_busy_pts;      // frame the thread renders unlocked
+    struct sd *prerender_free_sd;   // replaced while busy, freed by the thread
+    struct prerendered *prerender_shown; // returned by sub_get_bitmaps()
+    double prerender_shown_pts;
+    bool prerender_force_change;
+    struct mp_image_params video_params;
 };
 
+static struct prerendered *prerendered_ref(struct prerendered *p)
+{
+    p->refcount++;
+    return p;
+}
+
+static void prerendered_unref(struct prerendered *p)
+{
+    if (p && --p->refcount == 0)
+        talloc_free(p);
+}
+
+// Copy the result of sd get_bitmaps(), which is only valid until the next
+// decoder call. Returns NULL if the format is not supported.
+static struct prerendered *copy_bitmaps(struct sub_bitmaps *in)
+{
+    if (in->num_parts && !in->packed)
+        return NULL;
+
+    struct prerendered *p = talloc_zero(NULL, struct prerendered);
+    p->refcount = 1;
+    struct sub_bitmaps *out = &p->imgs;
+    *out = *in;
+    out->parts = talloc_memdup(p, in->parts,
+                               in->num_parts * sizeof(in->parts[0]));
+    out->packed_dirty = talloc_memdup(p, in->packed_dirty,
+                        in->num_packed_dirty * sizeof(in->packed_dirty[0]));
+    out->packed = NULL;
+    if (!in->num_parts)
+        return p;
+
+    // Only the used area of the packed image is copied. The coordinates stay
+    // the same, so that packed_dirty remains valid.
+    struct mp_image *src = in->packed;
+    out->packed = mp_image_alloc(src->imgfmt, MPMAX(in->packed_w, 1),
+                                 MPMAX(in->packed_h, 1));
+    if (!out->packed) {
+        talloc_free(p);
+        return NULL;
+    }
+    talloc_steal(p, out->packed);
+    int bpp = src->fmt.bpp[0] / 8;
+    memcpy_pic(out->packed->planes[0], src->planes[0], in->packed_w * bpp,
+               in->packed_h, out->packed->stride[0], src->stride[0]);
+    for (int n = 0; n < out->num_parts; n++) {
+        struct sub_bitmap *b = &out->parts[n];
+        ptrdiff_t offset = (uint8_t *)b->bitmap - src->planes[0];
+        int y = offset / src->stride[0];
+        int x = offset % src->stride[0];
+        b->bitmap = out->packed->planes[0] + y * out->packed->stride[0] + x;
+        b->stride = out->packed->stride[0];
+    }
+    return p;
+}
+
+// Drop all prerendered frames. Called locked, whenever the results could
+// change (seeking, option changes, etc.). See prerender_invalidate().
+static void prerender_clear(struct dec_sub *sub)
+{
+    for (int n = 0; n < sub->num_prerender_frames; n++)
+        prerendered_unref(sub->prerender_frames[n].res);
+    sub->num_prerender_frames = 0;
+    prerendered_unref(sub->prerender_last);
+    sub->prerender_last = NULL;
+    // prerender_shown must stay valid until the next sub_get_bitmaps() call.
+    sub->prerender_shown_pts = MP_NOPTS_VALUE;
+    // A frame being rendered right now must not be used.
+    sub->prerender_gen++;
+}
+
+// Drop the prerendered frames with a pts in [start, end), because new
+// subtitle events changed what is shown there. They are rendered again.
+// Called locked.
+static void prerender_invalidate(struct dec_sub *sub, double start, double end)
+{
+    bool changed = false;
+    for (int n = 0; n < sub->num_prerender_frames; n++) {
+        struct prerender_frame *frame = &sub->prerender_frames[n];
+        if (frame->pts >= start && frame->pts < end && frame->res) {
+            prerendered_unref(frame->res);
+            frame->res = NULL;
+            changed = true;
+        }
+    }
+    if (sub->prerender_shown_pts >= start && sub->prerender_shown_pts < end)
+        sub->prerender_shown_pts = MP_NOPTS_VALUE;
+    if (sub->prerender_busy_sd && sub->prerender_busy_pts >= start &&
+        sub->prerender_busy_pts < end)
+    {
+        sub->prerender_gen++;
+        changed = true;
+    }
+    if (changed)
+        pthread_cond_signal(&sub->prerender_wakeup);
+}
+
+static void free_decoder(struct sd *sd)
+{
+    sd->driver->uninit(sd);
+    talloc_free(sd);
+}
+
+static struct prerender_frame *find_unrendered_frame(struct dec_sub *sub,
+                                                     double pts)
+{
+    for (int n = 0; n < sub->num_prerender_frames; n++) {
+        struct prerender_frame *frame = &sub->prerender_frames[n];
+        if (!frame->res && (pts == MP_NOPTS_VALUE || frame->pts == pts))
+            return frame;
+    }
+    return NULL;
+}
+
+static void *prerender_thread(void *p)
+{
+    struct dec_sub *sub = p;
+    mpthread_set_name("subprerender");
+
+    pthread_mutex_lock(&sub->lock);
+    while (!sub->prerender_exit) {
+        struct prerender_frame *frame =
+            find_unrendered_frame(sub, MP_NOPTS_VALUE);
+        if (!frame || !sub->prerender_format || !sub->sd->prerender_ok ||
+            !sub->sd->driver->prerender_prepare || sub->preloading)
+        {
+            pthread_cond_wait(&sub->prerender_wakeup, &sub->lock);
+            continue;
+        }
+
+        struct sd *sd = sub->sd;
+        double pts = frame->pts;
+        void *job = sd->driver->prerender_prepare(sd, sub->prerender_dim,
+                                                  sub->prerender_format, pts);
+        if (!job) {
+            int index = frame - sub->prerender_frames;
+            MP_TARRAY_REMOVE_AT(sub->prerender_frames,
+                                sub->num_prerender_frames, index);
+            continue;
+        }
+        uint64_t gen = sub->prerender_gen;
+        sub->prerender_busy_sd = sd;
+        sub->prerender_busy_pts = pts;
+        pthread_mutex_unlock(&sub->lock);
+
+        // The job uses its own renderer and a copy of the subtitle events, so
+        // other threads can use the decoder meanwhile.
+        struct sub_bitmaps res = {0};
+        sd->driver->prerender_render(job, &res);
+        struct prerendered *r = res.change_id ? copy_bitmaps(&res) : NULL;
+        talloc_free(job);
+
+        pthread_mutex_lock(&sub->lock);
+        sub->prerender_busy_sd = NULL;
+        if (sub->prerender_free_sd) {
+            free_decoder(sub->prerender_free_sd);
+            sub->prerender_free_sd = NULL;
+        }
+
+        // The renderer's notion of "unchanged" refers to prerender_last, so
+        // it must be dropped along with a result that can't be used.
+        frame = gen == sub->prerender_gen ? find_unrendered_frame(sub, pts)
+                                          : NULL;
+        if (!frame) {
+            prerendered_unref(r);
+            r = NULL;
+        } else if (!res.change_id) {
+            r = sub->prerender_last ? prerendered_ref(sub->prerender_last)
+                                    : copy_bitmaps(&res);
+        }
+        prerendered_unref(sub->prerender_last);
+        sub->prerender_last = r ? prerendered_ref(r) : NULL;
+        if (frame && !r) {
+            int index = frame - sub->prerender_frames;
+            MP_TARRAY_REMOVE_AT(sub->prerender_frames,
+                                sub->num_prerender_frames, index);
+        } else if (frame) {
+            frame->res = r;
+        }
+    }
+    pthread_mutex_unlock(&sub->lock);
+    return NULL;
+}
+
 static void update_subtitle_speed(struct dec_sub *sub)
 {
     struct mp_subtitle_opts *opts = sub->opts;
@@ -119,13 +346,44 @@ void sub_unlock(struct dec_sub *sub)
     pthread_mutex_unlock(&sub->lock);
 }
 
+// Stop the preload thread. If it did not finish, preloading can be started
+// again later. Must be called unlocked.
+static void preload_stop(struct dec_sub *sub)
+{
+    pthread_mutex_lock(&sub->lock);
+    bool valid = sub->preload_thread_valid;
+    sub->preload_exit = true;
+    pthread_mutex_unlock(&sub->lock);
+
+    if (valid)
+        pthread_join(sub->preload_thread, NULL);
+
+    pthread_mutex_lock(&sub->lock);
+    sub->preload_thread_valid = false;
+    sub->preload_exit = false;
+    if (sub->preloading) {
+        sub->preloading = false;
+        sub->preload_attempted = false;
+    }
+    pthread_mutex_unlock(&sub->lock);
+}
+
 void sub_destroy(struct dec_sub *sub)
 {
     if (!sub)
         return;
+    preload_stop(sub);
+    if (sub->prerender_thread_valid) {
+        pthread_mutex_lock(&sub->lock);
+        sub->prerender_exit = true;
+        pthread_cond_signal(&sub->prerender_wakeup);
+        pthread_mutex_unlock(&sub->lock);
+        pthread_join(sub->prerender_thread, NULL);
+    }
     sub_reset(sub);
-    sub->sd->driver->uninit(sub->sd);
-    talloc_free(sub->sd);
+    prerendered_unref(sub->prerender_shown);
+    free_decoder(sub->sd);
+    pthread_cond_destroy(&sub->prerender_wakeup);
     pthread_mutex_destroy(&sub->lock);
     talloc_free(sub);
 }
@@ -178,9 +436,11 @@ struct dec_sub *sub_create(struct mpv_global *global, struct sh_stream *sh,
         .last_vo_pts = MP_NOPTS_VALUE,
         .start = MP_NOPTS_VALUE,
         .end = MP_NOPTS_VALUE,
+        .prerender_shown_pts = MP_NOPTS_VALUE,
     };
     sub->opts = sub->opts_cache->opts;
     mpthread_mutex_init_recursive(&sub->lock);
+    pthread_cond_init(&sub->prerender_wakeup, NULL);
 
     sub->sd = init_decoder(sub);
     if (sub->sd) {
@@ -188,6 +448,8 @@ struct dec_sub *sub_create(struct mpv_global *global, struct sh_stream *sh,
         return sub;
     }
 
+    pthread_cond_destroy(&sub->prerender_wakeup);
+    pthread_mutex_destroy(&sub->lock);
     talloc_free(sub);
     return NULL;
 }
@@ -201,13 +463,17 @@ static void update_segment(struct dec_sub *sub)
         MP_VERBOSE(sub, "Switch segment: %f at %f\n", sub->new_segment->start,
                    sub->last_vo_pts);
 
+        prerender_clear(sub);
         sub->codec = sub->new_segment->codec;
         sub->start = sub->new_segment->start;
         sub->end = sub->new_segment->end;
         struct sd *new = init_decoder(sub);
         if (new) {
-            sub->sd->driver->uninit(sub->sd);
-            talloc_free(sub->sd);
+            if (sub->sd == sub->prerender_busy_sd) {
+                sub->prerender_free_sd = sub->sd;
+            } else {
+                free_decoder(sub->sd);
+            }
             sub->sd = new;
             update_subtitle_speed(sub);
         } else {
@@ -230,23 +496,92 @@ bool sub_can_preload(struct dec_sub *sub)
     return r;
 }
 
-void sub_preload(struct dec_sub *sub)
+static void *preload_thread(void *p)
 {
-    pthread_mutex_lock(&sub->lock);
-
-    sub->preload_attempted = true;
+    struct dec_sub *sub = p;
+    mpthread_set_name("subpreload");
 
+    bool aborted = false;
     for (;;) {
+        pthread_mutex_lock(&sub->lock);
+        aborted = sub->preload_exit;
+        pthread_mutex_unlock(&sub->lock);
+        if (aborted)
+            break;
+
+        // Reading can block, so it's done unlocked. Nothing else reads from
+        // the stream while preloading.
         struct demux_packet *pkt = demux_read_packet(sub->sh);
         if (!pkt)
             break;
+
+        // Decoding packet by packet keeps the time other threads wait short.
+        pthread_mutex_lock(&sub->lock);
         sub->sd->driver->decode(sub->sd, pkt);
+        if (pkt->pos >= 0)
+            sub->preload_pos = pkt->pos;
+        pthread_mutex_unlock(&sub->lock);
         talloc_free(pkt);
     }
 
+    if (!aborted) {
+        pthread_mutex_lock(&sub->lock);
+        sub->preloading = false;
+        prerender_clear(sub);
+        pthread_cond_signal(&sub->prerender_wakeup);
+        pthread_mutex_unlock(&sub->lock);
+        if (sub->preload_wakeup)
+            sub->preload_wakeup(sub->preload_wakeup_ctx);
+    }
+    return NULL;
+}
+
+// Read and decode all packets of the stream on a separate thread. No subtitles
+// are shown until this is done; then wakeup is called (from the thread). size
+// is the size of the file read from, for sub_get_preload_progress(), or -1.
+// Falls back to preloading synchronously if the thread can't be created.
+void sub_preload(struct dec_sub *sub, int64_t size,
+                 void (*wakeup)(void *ctx), void *wakeup_ctx)
+{
+    preload_stop(sub);
+
+    pthread_mutex_lock(&sub->lock);
+
+    sub->preload_attempted = true;
+    sub->preloading = true;
+    sub->preload_size = size;
+    sub->preload_pos = 0;
+    sub->preload_wakeup = wakeup;
+    sub->preload_wakeup_ctx = wakeup_ctx;
+
+    if (pthread_create(&sub->preload_thread, NULL, preload_thread, sub)) {
+        MP_WARN(sub, "Could not create preload thread.\n");
+        sub->preload_wakeup = NULL;
+        preload_thread(sub);
+    } else {
+        sub->preload_thread_valid = true;
+    }
+
     pthread_mutex_unlock(&sub->lock);
 }
 
+// Return the progress of sub_preload() as value between 0 and 1, or -1 if
+// preloading was never started.
+double sub_get_preload_progress(struct dec_sub *sub)
+{
+    double r = -1;
+    pthread_mutex_lock(&sub->lock);
+    if (sub->preloading) {
+        r = 0;
+        if (sub->preload_size > 0)
+            r = MPCLAMP(sub->preload_pos / (double)sub->preload_size, 0, 0.99);
+    } else if (sub->preload_attempted) {
+        r = 1;
+    }
+    pthread_mutex_unlock(&sub->lock);
+    return r;
+}
+
 static bool is_new_segment(struct dec_sub *sub, struct demux_packet *p)
 {
     return p->segmented &&
@@ -261,7 +596,7 @@ bool sub_read_packets(struct dec_sub *sub, double video_pts)
     bool r = true;
     pthread_mutex_lock(&sub->lock);
     video_pts = pts_to_subtitle(sub, video_pts);
-    while (1) {
+    while (!sub->preloading) {
         bool read_more = true;
         if (sub->sd->driver->accepts_packet)
             read_more = sub->sd->driver->accepts_packet(sub->sd, video_pts);
@@ -302,8 +637,21 @@ bool sub_read_packets(struct dec_sub *sub, double video_pts)
             break;
         }
 
-        if (!(sub->preload_attempted && sub->sd->preload_ok))
+        if (!(sub->preload_attempted && sub->sd->preload_ok)) {
+            // Only frames the new events can show up on are rendered again.
+            // --sub-fix-timing can change the timing of events that are up to
+            // SUB_GAP_THRESHOLD apart. (Read before decoding, which can change
+            // the duration.)
+            double start = pkt->pts, end = INFINITY;
+            if (pkt->pts != MP_NOPTS_VALUE && pkt->duration >= 0)
+                end = pkt->pts + pkt->duration + SUB_GAP_THRESHOLD;
             sub->sd->driver->decode(sub->sd, pkt);
+            if (start == MP_NOPTS_VALUE) {
+                prerender_clear(sub);
+            } else {
+                prerender_invalidate(sub, start - SUB_GAP_THRESHOLD, end);
+            }
+        }
 
         talloc_free(pkt);
     }
@@ -311,6 +659,42 @@ bool sub_read_packets(struct dec_sub *sub, double video_pts)
     return r;
 }
 
+// Return a frame rendered by the prerender thread, if available.
+static bool get_prerendered(struct dec_sub *sub, struct mp_osd_res dim,
+                            int format, double pts, struct sub_bitmaps *res)
+{
+    if (!osd_res_equals(dim, sub->prerender_dim) ||
+        format != sub->prerender_format)
+    {
+        prerender_clear(sub);
+        sub->prerender_dim = dim;
+        sub->prerender_format = format;
+    }
+
+    struct prerendered *prev = sub->prerender_shown;
+    struct prerendered *cur = NULL;
+    if (prev && pts == sub->prerender_shown_pts)
+        cur = prerendered_ref(prev); // redraw
+    while (sub->num_prerender_frames && sub->prerender_frames[0].pts <= pts) {
+        struct prerendered *r = sub->prerender_frames[0].res;
+        if (!cur && r && sub->prerender_frames[0].pts == pts)
+            cur = prerendered_ref(r);
+        prerendered_unref(r);
+        MP_TARRAY_REMOVE_AT(sub->prerender_frames, sub->num_prerender_frames,
+                            0);
+    }
+
+    sub->prerender_shown = cur;
+    sub->prerender_shown_pts = cur ? pts : MP_NOPTS_VALUE;
+    if (cur) {
+        *res = cur->imgs;
+        res->change_id = cur != prev;
+        sub->prerender_force_change = true;
+    }
+    prerendered_unref(prev);
+    return !!cur;
+}
+
 // You must call sub_lock/sub_unlock if more than 1 thread access sub.
 // The issue is that *res will contain decoder allocated data, which might
 // be deallocated on the next decoder access.
@@ -327,8 +711,75 @@ void sub_get_bitmaps(struct dec_sub *sub, struct mp_osd_res dim, int format,
     if (sub->end != MP_NOPTS_VALUE && pts >= sub->end)
         return;
 
-    if (opts->sub_visibility && sub->sd->driver->get_bitmaps)
-        sub->sd->driver->get_bitmaps(sub->sd, dim, format, pts, res);
+    if (!opts->sub_visibility || !sub->sd->driver->get_bitmaps ||
+        sub->preloading)
+        return;
+
+    if (opts->sub_prerender && pts != MP_NOPTS_VALUE &&
+        get_prerendered(sub, dim, format, pts, res))
+        return;
+
+    sub->sd->driver->get_bitmaps(sub->sd, dim, format, pts, res);
+
+    // The decoder compares with what it rendered last, which is not
+    // necessarily what the caller got last.
+    if (sub->prerender_force_change) {
+        res->change_id = 1;
+        sub->prerender_force_change = false;
+    }
+}
+
+// Render subtitles for the given future video timestamps ahead of time on a
+// separate thread, if enabled with --sub-prerender. sub_get_bitmaps() returns
+// the prerendered bitmaps if it is called with the same parameters.
+void sub_prerender(struct dec_sub *sub, double *video_pts, int num_pts)
+{
+    pthread_mutex_lock(&sub->lock);
+    struct mp_subtitle_opts *opts = sub->opts;
+
+    if (!opts->sub_prerender || !opts->sub_visibility ||
+        !sub->sd->prerender_ok || !sub->sd->driver->prerender_prepare)
+        goto done;
+
+    if (!sub->prerender_thread_valid) {
+        if (pthread_create(&sub->prerender_thread, NULL, prerender_thread,
+                           sub))
+        {
+            MP_ERR(sub, "Could not create prerender thread.\n");
+            goto done;
+        }
+        sub->prerender_thread_valid = true;
+    }
+
+    for (int n = 0; n < num_pts; n++) {
+        double pts = pts_to_subtitle(sub, video_pts[n]);
+        if (pts == MP_NOPTS_VALUE ||
+            (sub->last_vo_pts != MP_NOPTS_VALUE && pts <= sub->last_vo_pts) ||
+            (sub->end != MP_NOPTS_VALUE && pts >= sub->end) ||
+            (sub->new_segment && pts >= sub->new_segment->start))
+            continue;
+        int i = 0;
+        while (i < sub->num_prerender_frames &&
+               sub->prerender_frames[i].pts < pts)
+            i++;
+        if (i < sub->num_prerender_frames &&
+            sub->prerender_frames[i].pts == pts)
+            continue;
+        MP_TARRAY_INSERT_AT(sub, sub->prerender_frames,
+                            sub->num_prerender_frames, i,
+                            (struct prerender_frame){.pts = pts});
+    }
+
+    // Keep only the nearest frames.
+    while (sub->num_prerender_frames > opts->sub_prerender + 1) {
+        int last = sub->num_prerender_frames - 1;
+        prerendered_unref(sub->prerender_frames[last].res);
+        sub->num_prerender_frames = last;
+    }
+
+    pthread_cond_signal(&sub->prerender_wakeup);
+done:
+    pthread_mutex_unlock(&sub->lock);
 }
 
 // See sub_get_bitmaps() for locking requirements.
@@ -345,7 +796,7 @@ char *sub_get_text(struct dec_sub *sub, double pts)
     sub->last_vo_pts = pts;
     update_segment(sub);
 
-    if (opts->sub_visibility && sub->sd->driver->get_text)
+    if (opts->sub_visibility && sub->sd->driver->get_text && !sub->preloading)
         text = sub->sd->driver->get_text(sub->sd, pts);
     pthread_mutex_unlock(&sub->lock);
     return text;
@@ -354,8 +805,11 @@ char *sub_get_text(struct dec_sub *sub, double pts)
 void sub_reset(struct dec_sub *sub)
 {
     pthread_mutex_lock(&sub->lock);
-    if (sub->sd->driver->reset)
+    // The preload thread is still decoding the whole file; a reset would drop
+    // events that are never read again.
+    if (sub->sd->driver->reset && !sub->preloading)
         sub->sd->driver->reset(sub->sd);
+    prerender_clear(sub);
     sub->last_pkt_pts = MP_NOPTS_VALUE;
     sub->last_vo_pts = MP_NOPTS_VALUE;
     talloc_free(sub->new_segment);
@@ -365,9 +819,15 @@ void sub_reset(struct dec_sub *sub)
 
 void sub_select(struct dec_sub *sub, bool selected)
 {
+    // The demuxer stream is going to be deselected, which would end the
+    // preloading early.
+    if (!selected)
+        preload_stop(sub);
+
     pthread_mutex_lock(&sub->lock);
     if (sub->sd->driver->select)
         sub->sd->driver->select(sub->sd, selected);
+    prerender_clear(sub);
     pthread_mutex_unlock(&sub->lock);
 }
 
@@ -379,6 +839,7 @@ int sub_control(struct dec_sub *sub, enum sd_ctrl cmd, void *arg)
     case SD_CTRL_SET_VIDEO_DEF_FPS:
         sub->video_fps = *(double *)arg;
         update_subtitle_speed(sub);
+        prerender_clear(sub);
         break;
     case SD_CTRL_SUB_STEP: {
         double *a = arg;
@@ -390,9 +851,32 @@ int sub_control(struct dec_sub *sub, enum sd_ctrl cmd, void *arg)
             a[0] = pts_from_subtitle(sub, arg2[0]);
         break;
     }
+    case SD_CTRL_PRUNE_EVENTS: {
+        // Preloaded subtitles can't be read again.
+        if (sub->preload_attempted)
+            break;
+        double pts = pts_to_subtitle(sub, *(double *)arg);
+        if (sub->sd->driver->control)
+            r = sub->sd->driver->control(sub->sd, cmd, &pts);
+        break;
+    }
+    case SD_CTRL_GET_MEMORY_USAGE:
+        if (sub->sd->driver->control)
+            r = sub->sd->driver->control(sub->sd, cmd, arg);
+        break;
+    case SD_CTRL_SET_VIDEO_PARAMS:
+        // This is set on every video frame.
+        if (!mp_image_params_equal(&sub->video_params, arg)) {
+            sub->video_params = *(struct mp_image_params *)arg;
+            prerender_clear(sub);
+        }
+        if (sub->sd->driver->control)
+            r = sub->sd->driver->control(sub->sd, cmd, arg);
+        break;
     default:
         if (sub->sd->driver->control)
             r = sub->sd->driver->control(sub->sd, cmd, arg);
+        prerender_clear(sub);
     }
     pthread_mutex_unlock(&sub->lock);
     return r;
@@ -401,8 +885,10 @@ int sub_control(struct dec_sub *sub, enum sd_ctrl cmd, void *arg)
 void sub_update_opts(struct dec_sub *sub)
 {
     pthread_mutex_lock(&sub->lock);
-    if (m_config_cache_update(sub->opts_cache))
+    if (m_config_cache_update(sub->opts_cache)) {
         update_subtitle_speed(sub);
+        prerender_clear(sub);
+    }
     pthread_mutex_unlock(&sub->lock);
 }
 
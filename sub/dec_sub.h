@@ -19,6 +19,8 @@ enum sd_ctrl {
     SD_CTRL_SET_VIDEO_PARAMS,
     SD_CTRL_SET_TOP,
     SD_CTRL_SET_VIDEO_DEF_FPS,
+    SD_CTRL_PRUNE_EVENTS,       // double*: discard events ending before this
+    SD_CTRL_GET_MEMORY_USAGE,   // int64_t*: approximate size in bytes
 };
 
 struct attachment_list {
@@ -33,10 +35,13 @@ void sub_lock(struct dec_sub *sub);
 void sub_unlock(struct dec_sub *sub);
 
 bool sub_can_preload(struct dec_sub *sub);
-void sub_preload(struct dec_sub *sub);
+void sub_preload(struct dec_sub *sub, int64_t size,
+                 void (*wakeup)(void *ctx), void *wakeup_ctx);
+double sub_get_preload_progress(struct dec_sub *sub);
 bool sub_read_packets(struct dec_sub *sub, double video_pts);
 void sub_get_bitmaps(struct dec_sub *sub, struct mp_osd_res dim, int format,
                      double pts, struct sub_bitmaps *res);
+void sub_prerender(struct dec_sub *sub, double *video_pts, int num_pts);
 char *sub_get_text(struct dec_sub *sub, double pts);
 void sub_reset(struct dec_sub *sub);
 void sub_select(struct dec_sub *sub, bool selected);
@@ -39,6 +39,11 @@ const bool mp_draw_sub_formats[SUBBITMAP_COUNT] = {
 
 struct sub_cache {
     struct mp_image *i, *a;
+    // Direct blending into subsampled formats: alpha (ca) and alpha weighted
+    // chroma (planes 1 and 2 of ci) averaged over each chroma sample. (cx, cy)
+    // is the position of the first sample in the destination chroma planes.
+    struct mp_image *ci, *ca;
+    int cx, cy;
 };
 
 struct part {
@@ -75,6 +80,34 @@ static bool get_sub_area(struct mp_rect bb, struct mp_image *temp,
         dst_r[x] = (srcp * srcap + dst_r[x] * (65025 - srcap) + 32512) / 65025; \
     }
 
+// Same as (v + 127) / 255 for 0 <= v <= 255 * 255, but without division.
+#define DIV255(v) (((v) + 128 + (((v) + 128) >> 8)) >> 8)
+
+// The 8 bit kernels work on blocks of this many pixels. Blocks that are fully
+// transparent are skipped; the loops inside a block have no branches, so the
+// compiler can vectorize them.
+#define BLEND_BLOCK 64
+
+static bool block_transparent(const uint8_t *srca, int w)
+{
+    uint8_t any = 0;
+    for (int x = 0; x < w; x++)
+        any |= srca[x];
+    return !any;
+}
+
+static void blend_const_alpha8(uint8_t *restrict dst, int srcp,
+                               const uint8_t *restrict srca, uint8_t srcamul,
+                               int w)
+{
+    // Round only once, so the result is the same as BLEND_CONST_ALPHA's.
+    // Compilers vectorize the division by a constant.
+    for (int x = 0; x < w; x++) {
+        uint32_t a = srca[x] * srcamul;
+        dst[x] = (srcp * a + dst[x] * (65025 - a) + 32512) / 65025;
+    }
+}
+
 // dst = srcp * (srca * srcamul) + dst * (1 - (srca * srcamul))
 static void blend_const_alpha(void *dst, int dst_stride, int srcp,
                               uint8_t *srca, int srca_stride, uint8_t srcamul,
@@ -88,7 +121,12 @@ static void blend_const_alpha(void *dst, int dst_stride, int srcp,
         if (bytes == 2) {
             BLEND_CONST_ALPHA(uint16_t)
         } else if (bytes == 1) {
-            BLEND_CONST_ALPHA(uint8_t)
+            uint8_t *dst_r = dst_rp;
+            for (int x = 0; x < w; x += BLEND_BLOCK) {
+                int bw = MPMIN(w - x, BLEND_BLOCK);
+                if (!block_transparent(srca_r + x, bw))
+                    blend_const_alpha8(dst_r + x, srcp, srca_r + x, srcamul, bw);
+            }
         }
     }
 }
@@ -101,6 +139,15 @@ static void blend_const_alpha(void *dst, int dst_stride, int srcp,
         dst_r[x] = (src_r[x] * srcap + dst_r[x] * (255 - srcap) + 127) / 255;   \
     }
 
+static void blend_src_alpha8(uint8_t *restrict dst, const uint8_t *restrict src,
+                             const uint8_t *restrict srca, int w)
+{
+    for (int x = 0; x < w; x++) {
+        uint16_t v = src[x] * srca[x] + dst[x] * (255 - srca[x]);
+        dst[x] = DIV255(v);
+    }
+}
+
 // dst = src * srca + dst * (1 - srca)
 static void blend_src_alpha(void *dst, int dst_stride, void *src,
                             int src_stride, uint8_t *srca, int srca_stride,
@@ -113,7 +160,12 @@ static void blend_src_alpha(void *dst, int dst_stride, void *src,
         if (bytes == 2) {
             BLEND_SRC_ALPHA(uint16_t)
         } else if (bytes == 1) {
-            BLEND_SRC_ALPHA(uint8_t)
+            uint8_t *dst_r = dst_rp, *src_r = src_rp;
+            for (int x = 0; x < w; x += BLEND_BLOCK) {
+                int bw = MPMIN(w - x, BLEND_BLOCK);
+                if (!block_transparent(srca_r + x, bw))
+                    blend_src_alpha8(dst_r + x, src_r + x, srca_r + x, bw);
+            }
         }
     }
 }
@@ -246,21 +298,55 @@ static void draw_rgba(struct mp_draw_sub_cache *cache, struct mp_rect bb,
     }
 }
 
-static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
-                     struct mp_image *temp, int bits, struct sub_bitmaps *sbs)
+struct ass_color_conv {
+    bool need_conv;
+    int texture_bits;
+    struct mp_cmat rgb2yuv;
+};
+
+static void init_ass_color_conv(struct ass_color_conv *conv,
+                                struct mp_image *img, int bits)
 {
     struct mp_csp_params cspar = MP_CSP_PARAMS_DEFAULTS;
-    mp_csp_set_image_params(&cspar, &temp->params);
+    mp_csp_set_image_params(&cspar, &img->params);
     cspar.levels_out = MP_CSP_LEVELS_PC; // RGB (libass.color)
     cspar.input_bits = bits;
     cspar.texture_bits = (bits + 7) / 8 * 8;
 
-    struct mp_cmat yuv2rgb, rgb2yuv;
-    bool need_conv = temp->fmt.flags & MP_IMGFLAG_YUV;
-    if (need_conv) {
+    *conv = (struct ass_color_conv){
+        .need_conv = img->fmt.flags & MP_IMGFLAG_YUV,
+        .texture_bits = cspar.texture_bits,
+    };
+    if (conv->need_conv) {
+        struct mp_cmat yuv2rgb;
         mp_get_csp_matrix(&cspar, &yuv2rgb);
-        mp_invert_cmat(&rgb2yuv, &yuv2rgb);
+        mp_invert_cmat(&conv->rgb2yuv, &yuv2rgb);
+    }
+}
+
+// Return the alpha of sb, and its color in the plane order of the target.
+static int get_ass_color(struct ass_color_conv *conv, struct sub_bitmap *sb,
+                         int color[3])
+{
+    int r = (sb->libass.color >> 24) & 0xFF;
+    int g = (sb->libass.color >> 16) & 0xFF;
+    int b = (sb->libass.color >> 8) & 0xFF;
+    if (conv->need_conv) {
+        int rgb[3] = {r, g, b};
+        mp_map_fixp_color(&conv->rgb2yuv, 8, rgb, conv->texture_bits, color);
+    } else {
+        color[0] = g;
+        color[1] = b;
+        color[2] = r;
     }
+    return 255 - (sb->libass.color & 0xFF);
+}
+
+static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
+                     struct mp_image *temp, int bits, struct sub_bitmaps *sbs)
+{
+    struct ass_color_conv conv;
+    init_ass_color_conv(&conv, temp, bits);
 
     for (int i = 0; i < sbs->num_parts; ++i) {
         struct sub_bitmap *sb = &sbs->parts[i];
@@ -270,19 +356,8 @@ static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
         if (!get_sub_area(bb, temp, sb, &dst, &src_x, &src_y))
             continue;
 
-        int r = (sb->libass.color >> 24) & 0xFF;
-        int g = (sb->libass.color >> 16) & 0xFF;
-        int b = (sb->libass.color >> 8) & 0xFF;
-        int a = 255 - (sb->libass.color & 0xFF);
         int color_yuv[3];
-        if (need_conv) {
-            int rgb[3] = {r, g, b};
-            mp_map_fixp_color(&rgb2yuv, 8, rgb, cspar.texture_bits, color_yuv);
-        } else {
-            color_yuv[0] = g;
-            color_yuv[1] = b;
-            color_yuv[2] = r;
-        }
+        int a = get_ass_color(&conv, sb, color_yuv);
 
         int bytes = (bits + 7) / 8;
         uint8_t *alpha_p = (uint8_t *)sb->bitmap + src_y * sb->stride + src_x;
@@ -297,6 +372,197 @@ static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
     }
 }
 
+// Whether subtitles can be blended into img without going through a 4:4:4
+// temporary image. Chroma is blended at its native resolution instead, using
+// alpha averaged over the luma pixels each chroma sample covers. This gives
+// the same result as upsampling with SWS_POINT and downsampling with SWS_AREA.
+static bool can_draw_direct(struct mp_image *img)
+{
+    struct mp_imgfmt_desc *desc = &img->fmt;
+    if (!(desc->flags & MP_IMGFLAG_YUV_P) || desc->num_planes != 3 ||
+        desc->component_bits != 8 || desc->chroma_xs > 2 || desc->chroma_ys > 2)
+        return false;
+    for (int p = 0; p < desc->num_planes; p++) {
+        if (desc->bytes[p] != 1)
+            return false;
+    }
+    return true;
+}
+
+// Floor division by 1 << shift, also for negative coordinates.
+static int shift_floor(int v, int shift)
+{
+    return v >= 0 ? v >> shift : -((-v + (1 << shift) - 1) >> shift);
+}
+
+// Average the w*h alpha map a (and, if src is set, the alpha weighted chroma
+// planes of src) over the chroma samples of a frame with the given subsampling.
+// (x, y) is the position of the bitmap in the frame.
+static bool make_chroma_cache(struct sub_cache *c, int xs, int ys, int x, int y,
+                              int w, int h, uint8_t *a, int a_stride,
+                              struct mp_image *src)
+{
+    c->cx = shift_floor(x, xs);
+    c->cy = shift_floor(y, ys);
+    int ox = x - (c->cx << xs);
+    int oy = y - (c->cy << ys);
+    int cw = (ox + w + (1 << xs) - 1) >> xs;
+    int ch = (oy + h + (1 << ys) - 1) >> ys;
+
+    c->ca = mp_image_alloc(IMGFMT_Y8, cw, ch);
+    if (src)
+        c->ci = mp_image_alloc(IMGFMT_444P, cw, ch);
+    if (!c->ca || (src && !c->ci)) {
+        TA_FREEP(&c->ca);
+        TA_FREEP(&c->ci);
+        return false;
+    }
+
+    int n = 1 << (xs + ys);
+    for (int cy = 0; cy < ch; cy++) {
+        uint8_t *ca_r = c->ca->planes[0] + cy * c->ca->stride[0];
+        int y0 = MPMAX((cy << ys) - oy, 0);
+        int y1 = MPMIN(((cy + 1) << ys) - oy, h);
+        for (int cx = 0; cx < cw; cx++) {
+            int x0 = MPMAX((cx << xs) - ox, 0);
+            int x1 = MPMIN(((cx + 1) << xs) - ox, w);
+            unsigned sum_a = 0, sum_u = 0, sum_v = 0;
+            for (int py = y0; py < y1; py++) {
+                for (int px = x0; px < x1; px++) {
+                    unsigned pa = a[py * a_stride + px];
+                    sum_a += pa;
+                    if (src) {
+                        sum_u += pa * src->planes[1][py * src->stride[1] + px];
+                        sum_v += pa * src->planes[2][py * src->stride[2] + px];
+                    }
+                }
+            }
+            ca_r[cx] = (sum_a + n / 2) / n;
+            if (src) {
+                uint8_t *u = c->ci->planes[1] + cy * c->ci->stride[1];
+                uint8_t *v = c->ci->planes[2] + cy * c->ci->stride[2];
+                u[cx] = sum_a ? (sum_u + sum_a / 2) / sum_a : 0;
+                v[cx] = sum_a ? (sum_v + sum_a / 2) / sum_a : 0;
+            }
+        }
+    }
+    return true;
+}
+
+// Blend all sub-bitmaps into the clip area of dst, which must satisfy
+// can_draw_direct(). The converted bitmaps are cached across calls as long as
+// change_id is the same.
+static void draw_direct(struct mp_draw_sub_cache *cache, struct mp_image *dst,
+                        struct sub_bitmaps *sbs, struct mp_rect clip)
+{
+    struct part *part = get_cache(cache, sbs, dst);
+    assert(part);
+
+    int xs = dst->fmt.chroma_xs, ys = dst->fmt.chroma_ys;
+    bool subsampled = xs || ys;
+    struct mp_rect bb = clip;
+
+    // Luma plane only, so that it can be cropped at any pixel position.
+    struct mp_image luma = *dst;
+    mp_image_setfmt(&luma, IMGFMT_Y8);
+    mp_image_set_size(&luma, dst->w, dst->h);
+    mp_image_crop_rc(&luma, bb);
+
+    struct ass_color_conv conv;
+    if (sbs->format == SUBBITMAP_LIBASS)
+        init_ass_color_conv(&conv, dst, 8);
+
+    // Format for the converted RGBA bitmaps; chroma is averaged from it.
+    struct mp_image fmt_444 = {0};
+    mp_image_setfmt(&fmt_444, IMGFMT_444P);
+    fmt_444.params.color = dst->params.color;
+
+    for (int i = 0; i < sbs->num_parts; ++i) {
+        struct sub_bitmap *sb = &sbs->parts[i];
+        struct sub_cache *c = &part->imgs[i];
+
+        if (sb->w < 1 || sb->h < 1)
+            continue;
+
+        struct mp_image area;
+        int src_x, src_y;
+        if (!get_sub_area(bb, &luma, sb, &area, &src_x, &src_y))
+            continue;
+
+        uint8_t *alpha;
+        int alpha_stride;
+        if (sbs->format == SUBBITMAP_RGBA) {
+            if (!(c->i && c->a)) {
+                scale_sb_rgba(sb, &fmt_444, &c->i, &c->a);
+                talloc_steal(part, c->i);
+                talloc_steal(part, c->a);
+            }
+            // on OOM, skip drawing
+            if (!(c->i && c->a))
+                continue;
+            alpha = c->a->planes[0];
+            alpha_stride = c->a->stride[0];
+        } else {
+            alpha = sb->bitmap;
+            alpha_stride = sb->stride;
+        }
+
+        if (subsampled && !c->ca) {
+            if (!make_chroma_cache(c, xs, ys, sb->x, sb->y, sb->dw, sb->dh,
+                                   alpha, alpha_stride, c->i))
+                continue;
+            talloc_steal(part, c->ca);
+            talloc_steal(part, c->ci);
+        }
+
+        uint8_t *alpha_p = alpha + src_y * alpha_stride + src_x;
+
+        // Area covered in the chroma planes, and the matching position in the
+        // chroma data (which is the full resolution data if not subsampled).
+        int x0 = sb->x + src_x, y0 = sb->y + src_y;
+        int cx0 = x0 >> xs;
+        int cy0 = y0 >> ys;
+        int cx1 = MPMIN((x0 + area.w + (1 << xs) - 1) >> xs,
+                        mp_image_plane_w(dst, 1));
+        int cy1 = MPMIN((y0 + area.h + (1 << ys) - 1) >> ys,
+                        mp_image_plane_h(dst, 1));
+        struct mp_image *ci = c->i;
+        uint8_t *ca_p = alpha_p;
+        int ca_stride = alpha_stride;
+        int ca_x = src_x, ca_y = src_y;
+        if (subsampled) {
+            ci = c->ci;
+            ca_x = cx0 - c->cx;
+            ca_y = cy0 - c->cy;
+            ca_stride = c->ca->stride[0];
+            ca_p = c->ca->planes[0] + ca_y * ca_stride + ca_x;
+        }
+
+        if (sbs->format == SUBBITMAP_RGBA) {
+            blend_src_alpha(area.planes[0], area.stride[0],
+                            c->i->planes[0] + src_y * c->i->stride[0] + src_x,
+                            c->i->stride[0], alpha_p, alpha_stride,
+                            area.w, area.h, 1);
+            for (int p = 1; p < 3; p++) {
+                uint8_t *d = dst->planes[p] + cy0 * dst->stride[p] + cx0;
+                uint8_t *s = ci->planes[p] + ca_y * ci->stride[p] + ca_x;
+                blend_src_alpha(d, dst->stride[p], s, ci->stride[p], ca_p,
+                                ca_stride, cx1 - cx0, cy1 - cy0, 1);
+            }
+        } else {
+            int color[3];
+            int a = get_ass_color(&conv, sb, color);
+            blend_const_alpha(area.planes[0], area.stride[0], color[0],
+                              alpha_p, alpha_stride, a, area.w, area.h, 1);
+            for (int p = 1; p < 3; p++) {
+                uint8_t *d = dst->planes[p] + cy0 * dst->stride[p] + cx0;
+                blend_const_alpha(d, dst->stride[p], color[p], ca_p, ca_stride,
+                                  a, cx1 - cx0, cy1 - cy0, 1);
+            }
+        }
+    }
+}
+
 static void get_swscale_alignment(const struct mp_image *img, int *out_xstep,
                                   int *out_ystep)
 {
@@ -358,36 +624,31 @@ static void get_closest_y444_format(int imgfmt, int *out_format, int *out_bits)
 static struct part *get_cache(struct mp_draw_sub_cache *cache,
                               struct sub_bitmaps *sbs, struct mp_image *format)
 {
-    struct part *part = NULL;
-
-    bool use_cache = sbs->format == SUBBITMAP_RGBA;
-    if (use_cache) {
-        part = cache->parts[sbs->render_index];
-        if (part) {
-            if (part->change_id != sbs->change_id
-                || part->imgfmt != format->imgfmt
-                || part->colorspace != format->params.color.space
-                || part->levels != format->params.color.levels)
-            {
-                talloc_free(part);
-                part = NULL;
-            }
-        }
-        if (!part) {
-            part = talloc(cache, struct part);
-            *part = (struct part) {
-                .change_id = sbs->change_id,
-                .num_imgs = sbs->num_parts,
-                .imgfmt = format->imgfmt,
-                .levels = format->params.color.levels,
-                .colorspace = format->params.color.space,
-            };
-            part->imgs = talloc_zero_array(part, struct sub_cache,
-                                           part->num_imgs);
+    struct part *part = cache->parts[sbs->render_index];
+    if (part) {
+        if (part->change_id != sbs->change_id
+            || part->imgfmt != format->imgfmt
+            || part->colorspace != format->params.color.space
+            || part->levels != format->params.color.levels)
+        {
+            talloc_free(part);
+            part = NULL;
         }
-        assert(part->num_imgs == sbs->num_parts);
-        cache->parts[sbs->render_index] = part;
     }
+    if (!part) {
+        part = talloc(cache, struct part);
+        *part = (struct part) {
+            .change_id = sbs->change_id,
+            .num_imgs = sbs->num_parts,
+            .imgfmt = format->imgfmt,
+            .levels = format->params.color.levels,
+            .colorspace = format->params.color.space,
+        };
+        part->imgs = talloc_zero_array(part, struct sub_cache,
+                                       part->num_imgs);
+    }
+    assert(part->num_imgs == sbs->num_parts);
+    cache->parts[sbs->render_index] = part;
 
     return part;
 }
@@ -490,11 +751,28 @@ static void chroma_down(struct mp_image *old_src, struct mp_image *temp)
     }
 }
 
+// Extend rc so that mp_draw_sub_bitmaps_clip() can draw exactly the area it
+// covers, and clip it to img. Returns false if nothing is left.
+bool mp_draw_sub_align_rect(struct mp_image *img, struct mp_rect *rc)
+{
+    return align_bbox_for_swscale(img, rc);
+}
+
 // cache: if not NULL, the function will set *cache to a talloc-allocated cache
 //        containing scaled versions of sbs contents - free the cache with
 //        talloc_free()
 void mp_draw_sub_bitmaps(struct mp_draw_sub_cache **cache, struct mp_image *dst,
                          struct sub_bitmaps *sbs)
+{
+    struct mp_rect all = {0, 0, dst->w, dst->h};
+    mp_draw_sub_bitmaps_clip(cache, dst, sbs, all);
+}
+
+// Like mp_draw_sub_bitmaps(), but leave dst outside of clip untouched. clip
+// must have been aligned with mp_draw_sub_align_rect().
+void mp_draw_sub_bitmaps_clip(struct mp_draw_sub_cache **cache,
+                              struct mp_image *dst, struct sub_bitmaps *sbs,
+                              struct mp_rect clip)
 {
     assert(mp_draw_sub_formats[sbs->format]);
     if (!mp_sws_supported_format(dst->imgfmt))
@@ -504,6 +782,12 @@ void mp_draw_sub_bitmaps(struct mp_draw_sub_cache **cache, struct mp_image *dst,
     if (!cache_)
         cache_ = talloc_zero(NULL, struct mp_draw_sub_cache);
 
+    if (can_draw_direct(dst)) {
+        if (mp_rect_intersection(&clip, &(struct mp_rect){0, 0, dst->w, dst->h}))
+            draw_direct(cache_, dst, sbs, clip);
+        goto done;
+    }
+
     int format, bits;
     get_closest_y444_format(dst->imgfmt, &format, &bits);
 
@@ -514,7 +798,9 @@ void mp_draw_sub_bitmaps(struct mp_draw_sub_cache **cache, struct mp_image *dst,
         struct mp_rect bb = rc_list[r];
 
         if (!align_bbox_for_swscale(dst, &bb))
-            return;
+            break;
+        if (!mp_rect_intersection(&bb, &clip))
+            continue;
 
         struct mp_image dst_region = *dst;
         mp_image_crop_rc(&dst_region, bb);
@@ -531,6 +817,7 @@ void mp_draw_sub_bitmaps(struct mp_draw_sub_cache **cache, struct mp_image *dst,
         chroma_down(&dst_region, temp);
     }
 
+done:
     if (cache) {
         *cache = cache_;
     } else {
@@ -6,8 +6,13 @@
 struct mp_image;
 struct sub_bitmaps;
 struct mp_draw_sub_cache;
+struct mp_rect;
 void mp_draw_sub_bitmaps(struct mp_draw_sub_cache **cache, struct mp_image *dst,
                          struct sub_bitmaps *sbs);
+void mp_draw_sub_bitmaps_clip(struct mp_draw_sub_cache **cache,
+                              struct mp_image *dst, struct sub_bitmaps *sbs,
+                              struct mp_rect clip);
+bool mp_draw_sub_align_rect(struct mp_image *img, struct mp_rect *rc);
 
 extern const bool mp_draw_sub_formats[SUBBITMAP_COUNT];
 
@@ -30,21 +30,32 @@
 #include "video/mp_image.h"
 #include "video/sws_utils.h"
 
-void mp_blur_rgba_sub_bitmap(struct sub_bitmap *d, double gblur)
+// *tmp is a scratch image, which is reallocated if it's too small. It can be
+// reused for further calls, and must be freed with talloc_free() by the caller.
+void mp_blur_rgba_sub_bitmap(struct sub_bitmap *d, double gblur,
+                             struct mp_image **tmp)
 {
-    struct mp_image *tmp1 = mp_image_alloc(IMGFMT_BGRA, d->w, d->h);
-    if (tmp1) { // on OOM, skip region
-        struct mp_image s = {0};
-        mp_image_setfmt(&s, IMGFMT_BGRA);
-        mp_image_set_size(&s, d->w, d->h);
-        s.stride[0] = d->stride;
-        s.planes[0] = d->bitmap;
+    if (!*tmp || (*tmp)->w < d->w || (*tmp)->h < d->h) {
+        int w = *tmp ? MPMAX((*tmp)->w, d->w) : d->w;
+        int h = *tmp ? MPMAX((*tmp)->h, d->h) : d->h;
+        talloc_free(*tmp);
+        *tmp = mp_image_alloc(IMGFMT_BGRA, w, h);
+        if (!*tmp) // on OOM, skip region
+            return;
+    }
 
-        mp_image_copy(tmp1, &s);
+    struct mp_image tmp1 = **tmp;
+    mp_image_set_size(&tmp1, d->w, d->h);
 
-        mp_image_sw_blur_scale(&s, tmp1, gblur);
-    }
-    talloc_free(tmp1);
+    struct mp_image s = {0};
+    mp_image_setfmt(&s, IMGFMT_BGRA);
+    mp_image_set_size(&s, d->w, d->h);
+    s.stride[0] = d->stride;
+    s.planes[0] = d->bitmap;
+
+    mp_image_copy(&tmp1, &s);
+
+    mp_image_sw_blur_scale(&s, &tmp1, gblur);
 }
 
 bool mp_sub_bitmaps_bb(struct sub_bitmaps *imgs, struct mp_rect *out_bb)
@@ -6,9 +6,11 @@
 struct sub_bitmaps;
 struct sub_bitmap;
 struct mp_rect;
+struct mp_image;
 
 // Sub postprocessing
-void mp_blur_rgba_sub_bitmap(struct sub_bitmap *d, double gblur);
+void mp_blur_rgba_sub_bitmap(struct sub_bitmap *d, double gblur,
+                             struct mp_image **tmp);
 
 bool mp_sub_bitmaps_bb(struct sub_bitmaps *imgs, struct mp_rect *out_bb);
 
@@ -213,14 +213,22 @@ void osd_set_progbar(struct osd_state *osd, struct osd_progbar_state *s)
 {
     pthread_mutex_lock(&osd->lock);
     struct osd_object *osd_obj = osd->objs[OSDTYPE_OSD];
-    osd_obj->progbar_state.type = s->type;
-    osd_obj->progbar_state.value = s->value;
-    osd_obj->progbar_state.num_stops = s->num_stops;
-    MP_TARRAY_GROW(osd_obj, osd_obj->progbar_state.stops, s->num_stops);
-    memcpy(osd_obj->progbar_state.stops, s->stops,
-           sizeof(osd_obj->progbar_state.stops[0]) * s->num_stops);
-    osd_obj->osd_changed = true;
-    osd->want_redraw_notification = true;
+    struct osd_progbar_state *cur = &osd_obj->progbar_state;
+    size_t stops_size = sizeof(cur->stops[0]) * s->num_stops;
+    // The OSD is re-rendered on every change; avoid it if nothing changed.
+    if (cur->type != s->type || cur->value != s->value ||
+        cur->num_stops != s->num_stops ||
+        (stops_size && memcmp(cur->stops, s->stops, stops_size) != 0))
+    {
+        cur->type = s->type;
+        cur->value = s->value;
+        cur->num_stops = s->num_stops;
+        MP_TARRAY_GROW(osd_obj, cur->stops, s->num_stops);
+        if (stops_size)
+            memcpy(cur->stops, s->stops, stops_size);
+        osd_obj->osd_changed = true;
+        osd->want_redraw_notification = true;
+    }
     pthread_mutex_unlock(&osd->lock);
 }
 
@@ -293,6 +301,20 @@ static void render_object(struct osd_state *osd, struct osd_object *obj,
     out_imgs->change_id = obj->vo_change_id;
 }
 
+static bool want_object(struct osd_state *osd, struct osd_object *obj,
+                        int draw_flags)
+{
+    // Object is drawn into the video frame itself; don't draw twice
+    if (osd->render_subs_in_filter && obj->is_sub &&
+        !(draw_flags & OSD_DRAW_SUB_FILTER))
+        return false;
+    if ((draw_flags & OSD_DRAW_SUB_ONLY) && !obj->is_sub)
+        return false;
+    if ((draw_flags & OSD_DRAW_OSD_ONLY) && obj->is_sub)
+        return false;
+    return true;
+}
+
 // draw_flags is a bit field of OSD_DRAW_* constants
 void osd_draw(struct osd_state *osd, struct mp_osd_res res,
               double video_pts, int draw_flags,
@@ -310,13 +332,7 @@ void osd_draw(struct osd_state *osd, struct mp_osd_res res,
     for (int n = 0; n < MAX_OSD_PARTS; n++) {
         struct osd_object *obj = osd->objs[n];
 
-        // Object is drawn into the video frame itself; don't draw twice
-        if (osd->render_subs_in_filter && obj->is_sub &&
-            !(draw_flags & OSD_DRAW_SUB_FILTER))
-            continue;
-        if ((draw_flags & OSD_DRAW_SUB_ONLY) && !obj->is_sub)
-            continue;
-        if ((draw_flags & OSD_DRAW_OSD_ONLY) && obj->is_sub)
+        if (!want_object(osd, obj, draw_flags))
             continue;
 
         if (obj->sub)
@@ -388,6 +404,144 @@ void osd_draw_on_image_p(struct osd_state *osd, struct mp_osd_res res,
              &draw_on_image, &closure);
 }
 
+#define DAMAGE_OBJ_RECTS (OSD_DAMAGE_MAX_RECTS / MAX_OSD_PARTS / 2)
+
+// What osd_draw_on_image_damage() drew the last time.
+struct osd_damage {
+    bool valid;
+    struct mp_osd_res res;
+    int draw_flags;
+    int w, h;
+    struct {
+        int change_id;
+        struct mp_rect rc[DAMAGE_OBJ_RECTS];
+        int num_rc;
+    } objs[MAX_OSD_PARTS];
+};
+
+struct osd_damage *osd_damage_create(void *ta_parent)
+{
+    return talloc_zero(ta_parent, struct osd_damage);
+}
+
+// Forget the previous state, e.g. because a new video frame was drawn.
+void osd_damage_reset(struct osd_damage *damage)
+{
+    damage->valid = false;
+}
+
+// Add rc to the list, merging it with the rectangles it overlaps, so that no
+// pixel is restored or drawn twice.
+static void add_damage_rect(struct mp_image *dest, struct mp_rect *list,
+                            int *num, struct mp_rect rc)
+{
+    if (!mp_draw_sub_align_rect(dest, &rc))
+        return;
+    for (int n = 0; n < *num; n++) {
+        struct mp_rect tmp = list[n];
+        if (mp_rect_intersection(&tmp, &rc)) {
+            mp_rect_union(&rc, &list[n]);
+            MP_TARRAY_REMOVE_AT(list, *num, n);
+            n = -1; // the grown rectangle might overlap earlier ones
+        }
+    }
+    assert(*num < OSD_DAMAGE_MAX_RECTS);
+    list[(*num)++] = rc;
+}
+
+// Like osd_draw_on_image(), but only redraw what changed since the previous
+// call with the same damage state. dest must be writeable.
+// If restore is NULL, dest must not contain any OSD yet (e.g. a new video
+// frame was just drawn into it), and the OSD is drawn completely. Otherwise,
+// dest must still contain what the previous call drew, and each changed area
+// is passed to restore(), which must put back the image contents without OSD,
+// before the OSD is drawn into it again. After osd_damage_reset(), this is
+// done for the whole image.
+// The changed areas are written to out_rc (OSD_DAMAGE_MAX_RECTS entries), and
+// their number is returned.
+int osd_draw_on_image_damage(struct osd_state *osd, struct mp_osd_res res,
+                             double video_pts, int draw_flags,
+                             struct mp_image *dest, struct osd_damage *damage,
+                             void (*restore)(void *ctx, struct mp_rect rc),
+                             void *restore_ctx, struct mp_rect *out_rc)
+{
+    struct sub_bitmaps imgs[MAX_OSD_PARTS] = {0};
+    struct osd_damage state = {
+        .valid = true,
+        .res = res,
+        .draw_flags = draw_flags,
+        .w = dest->w,
+        .h = dest->h,
+    };
+    int num_rc = 0;
+
+    pthread_mutex_lock(&osd->lock);
+
+    if (osd->force_video_pts != MP_NOPTS_VALUE)
+        video_pts = osd->force_video_pts;
+
+    for (int n = 0; n < MAX_OSD_PARTS; n++) {
+        struct osd_object *obj = osd->objs[n];
+        if (!want_object(osd, obj, draw_flags))
+            continue;
+        if (obj->sub)
+            sub_lock(obj->sub);
+        render_object(osd, obj, res, video_pts, mp_draw_sub_formats, &imgs[n]);
+        if (imgs[n].num_parts > 0 && !mp_draw_sub_formats[imgs[n].format]) {
+            MP_ERR(osd, "Can't render OSD part %d (format %d).\n",
+                   obj->type, imgs[n].format);
+            imgs[n].num_parts = 0;
+        }
+        state.objs[n].change_id = obj->vo_change_id;
+        state.objs[n].num_rc = mp_get_sub_bb_list(&imgs[n], state.objs[n].rc,
+                                                  DAMAGE_OBJ_RECTS);
+    }
+
+    bool full = !restore || !damage->valid ||
+                damage->draw_flags != draw_flags ||
+                !osd_res_equals(damage->res, res) ||
+                damage->w != dest->w || damage->h != dest->h;
+    if (full) {
+        add_damage_rect(dest, out_rc, &num_rc,
+                        (struct mp_rect){0, 0, dest->w, dest->h});
+    } else {
+        for (int n = 0; n < MAX_OSD_PARTS; n++) {
+            if (damage->objs[n].change_id == state.objs[n].change_id &&
+                damage->objs[n].num_rc == state.objs[n].num_rc)
+                continue;
+            for (int i = 0; i < damage->objs[n].num_rc; i++)
+                add_damage_rect(dest, out_rc, &num_rc, damage->objs[n].rc[i]);
+            for (int i = 0; i < state.objs[n].num_rc; i++)
+                add_damage_rect(dest, out_rc, &num_rc, state.objs[n].rc[i]);
+        }
+    }
+
+    for (int r = 0; r < num_rc; r++) {
+        if (restore)
+            restore(restore_ctx, out_rc[r]);
+        for (int n = 0; n < MAX_OSD_PARTS; n++) {
+            if (imgs[n].num_parts > 0)
+                mp_draw_sub_bitmaps_clip(&osd->draw_cache, dest, &imgs[n],
+                                         out_rc[r]);
+        }
+    }
+    talloc_steal(osd, osd->draw_cache);
+
+    for (int n = 0; n < MAX_OSD_PARTS; n++) {
+        struct osd_object *obj = osd->objs[n];
+        if (want_object(osd, obj, draw_flags) && obj->sub)
+            sub_unlock(obj->sub);
+    }
+
+    if (!(draw_flags & OSD_DRAW_SUB_FILTER))
+        osd->want_redraw_notification = false;
+
+    pthread_mutex_unlock(&osd->lock);
+
+    *damage = state;
+    return num_rc;
+}
+
 // Setup the OSD resolution to render into an image with the given parameters.
 // The interesting part about this is that OSD has to compensate the aspect
 // ratio if the image does not have a 1:1 pixel aspect ratio.
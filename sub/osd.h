@@ -73,6 +73,14 @@ struct sub_bitmaps {
     // box. (The origin of the box is at (0,0).)
     int packed_w, packed_h;
 
+    // Versions of the packed image contents (0 if unknown). If
+    // packed_prev_version is not 0 and equals the packed_version of the
+    // previous sub_bitmaps a consumer has seen from the same source, then only
+    // the packed_dirty rectangles differ from what it already has.
+    uint64_t packed_version, packed_prev_version;
+    struct mp_rect *packed_dirty;
+    int num_packed_dirty;
+
     int change_id;  // Incremented on each change
 };
 
@@ -191,6 +199,19 @@ void osd_draw_on_image_p(struct osd_state *osd, struct mp_osd_res res,
                          double video_pts, int draw_flags,
                          struct mp_image_pool *pool, struct mp_image *dest);
 
+// Maximum number of rectangles returned by osd_draw_on_image_damage().
+#define OSD_DAMAGE_MAX_RECTS 40
+
+struct mp_rect;
+struct osd_damage;
+struct osd_damage *osd_damage_create(void *ta_parent);
+void osd_damage_reset(struct osd_damage *damage);
+int osd_draw_on_image_damage(struct osd_state *osd, struct mp_osd_res res,
+                             double video_pts, int draw_flags,
+                             struct mp_image *dest, struct osd_damage *damage,
+                             void (*restore)(void *ctx, struct mp_rect rc),
+                             void *restore_ctx, struct mp_rect *out_rc);
+
 void osd_resize(struct osd_state *osd, struct mp_osd_res res);
 
 struct mp_image_params;
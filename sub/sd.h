@@ -23,6 +23,10 @@ struct sd {
     // Set to false as soon as the decoder discards old subtitle events.
     // (only needed if sd_functions.accept_packets_in_advance == false)
     bool preload_ok;
+
+    // Set by the decoder if subtitles for future timestamps can be rendered
+    // ahead of time (for --sub-prerender, see prerender_prepare()).
+    bool prerender_ok;
 };
 
 struct sd_functions {
@@ -39,6 +43,15 @@ struct sd_functions {
 
     void (*get_bitmaps)(struct sd *sd, struct mp_osd_res dim, int format,
                         double pts, struct sub_bitmaps *res);
+
+    // For --sub-prerender. prerender_prepare() returns a copy of the state
+    // needed to render pts with a separate renderer (free with talloc_free()).
+    // prerender_render() renders it without accessing sd, so it can be called
+    // unlocked. Both must always be called from the same thread, and a job
+    // must be rendered or freed before the next one is prepared.
+    void *(*prerender_prepare)(struct sd *sd, struct mp_osd_res dim, int format,
+                               double pts);
+    void (*prerender_render)(void *job, struct sub_bitmaps *res);
     char *(*get_text)(struct sd *sd, double pts);
 };
 
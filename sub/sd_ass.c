@@ -36,11 +36,38 @@
 #include "ass_mp.h"
 #include "sd.h"
 
+// ass_track events sorted by start time, with a max-end segment tree over
+// them for overlap queries. New events are added lazily on the next query.
+struct event_index {
+    struct event_ref {
+        long long start;
+        int event;          // index into ASS_Track.events
+    } *refs;
+    int num_refs;           // number of indexed events
+    long long *max_end;     // segment tree, 2 * size entries, root at 1
+    int size;               // number of leaves (power of 2, >= num_refs)
+    bool valid;             // if false, the index is rebuilt from scratch
+};
+
+// Renderer for --sub-prerender. Only the prerender thread uses it, so that it
+// can render while the decoder is used by other threads. Nothing is shared
+// with the decoder's libass state, not even the library.
+struct prerenderer {
+    struct ass_library *library;
+    struct ass_renderer *renderer;
+    struct ass_track *ass_track;    // header of the decoder's tracks, with
+    struct ass_track *shadow_track; // copies of the events of the current job
+    struct mp_ass_packer *packer;
+    struct sub_bitmap *bs;
+};
+
 struct sd_ass_priv {
     struct ass_library *ass_library;
     struct ass_renderer *ass_renderer;
     struct ass_track *ass_track;
     struct ass_track *shadow_track; // for --sub-ass=no rendering
+    char *header;                   // codec private data parsed by libass
+    int header_size;
     bool is_converted;
     struct lavc_conv *converter;
     bool on_top;
@@ -49,13 +76,31 @@ struct sd_ass_priv {
     char last_text[500];
     struct mp_image_params video_params;
     struct mp_image_params last_params;
-    int64_t *seen_packets;
+    struct seen_packet {
+        uint64_t key;           // packet file position + 1, 0 if unused
+        long long end;          // end time of the packet in ms
+    } *seen_packets;            // hash set
     int num_seen_packets;
+    int seen_packets_size;      // power of 2, or 0
+    long long prune_ts;         // last time events were pruned
     bool duration_unknown;
+    struct event_index index;
+    int *found_events;
+    int num_found_events;
+    struct prerenderer *prerenderer;
+};
+
+// Conversion applied by mangle_colors().
+struct color_mangle {
+    struct mp_cmat vs_rgb2yuv;
+    struct mp_cmat vs2rgb;
 };
 
+static bool get_color_mangle(struct sd *sd, struct color_mangle *m);
+static void apply_color_mangle(struct color_mangle *m, struct sub_bitmaps *parts);
 static void mangle_colors(struct sd *sd, struct sub_bitmaps *parts);
 static void fill_plaintext(struct sd *sd, double pts);
+static void update_index_event(struct sd_ass_priv *ctx, int n);
 
 // Add default styles, if the track does not have any styles yet.
 // Apply style overrides if the user provides any.
@@ -117,19 +162,60 @@ static bool attachment_is_font(struct mp_log *log, struct demux_attachment *f)
     return false;
 }
 
-static void add_subtitle_fonts(struct sd *sd)
+static void add_subtitle_fonts(struct sd *sd, ASS_Library *library)
 {
-    struct sd_ass_priv *ctx = sd->priv;
     struct mp_subtitle_opts *opts = sd->opts;
     if (!opts->ass_enabled || !opts->use_embedded_fonts || !sd->attachments)
         return;
     for (int i = 0; i < sd->attachments->num_entries; i++) {
         struct demux_attachment *f = &sd->attachments->entries[i];
         if (attachment_is_font(sd->log, f))
-            ass_add_font(ctx->ass_library, f->name, f->data, f->data_size);
+            ass_add_font(library, f->name, f->data, f->data_size);
     }
 }
 
+static ASS_Library *create_library(struct sd *sd)
+{
+    struct mp_subtitle_opts *opts = sd->opts;
+
+    ASS_Library *library = mp_ass_init(sd->global, sd->log);
+    ass_set_extract_fonts(library, opts->use_embedded_fonts);
+
+    add_subtitle_fonts(sd, library);
+
+    if (opts->ass_style_override)
+        ass_set_style_overrides(library, opts->ass_force_style_list);
+
+    return library;
+}
+
+// Create the track and the shadow track (see struct sd_ass_priv) with the
+// header, but without events. Embedded fonts of the header are added to the
+// library.
+static void create_tracks(struct sd *sd, ASS_Library *library,
+                          ASS_Track **out_track, ASS_Track **out_shadow_track)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    struct mp_subtitle_opts *opts = sd->opts;
+
+    ASS_Track *track = ass_new_track(library);
+    if (!ctx->is_converted)
+        track->track_type = TRACK_TYPE_ASS;
+
+    ASS_Track *shadow_track = ass_new_track(library);
+    shadow_track->PlayResX = 384;
+    shadow_track->PlayResY = 288;
+    mp_ass_add_default_styles(shadow_track, opts);
+
+    if (ctx->header)
+        ass_process_codec_private(track, ctx->header, ctx->header_size);
+
+    mp_ass_add_default_styles(track, opts);
+
+    *out_track = track;
+    *out_shadow_track = shadow_track;
+}
+
 static void enable_output(struct sd *sd, bool enable)
 {
     struct sd_ass_priv *ctx = sd->priv;
@@ -148,7 +234,6 @@ static void enable_output(struct sd *sd, bool enable)
 
 static int init(struct sd *sd)
 {
-    struct mp_subtitle_opts *opts = sd->opts;
     struct sd_ass_priv *ctx = talloc_zero(sd, struct sd_ass_priv);
     sd->priv = ctx;
 
@@ -168,27 +253,11 @@ static int init(struct sd *sd)
             ctx->duration_unknown = 1;
     }
 
-    ctx->ass_library = mp_ass_init(sd->global, sd->log);
-    ass_set_extract_fonts(ctx->ass_library, opts->use_embedded_fonts);
+    ctx->header = extradata;
+    ctx->header_size = extradata_size;
 
-    add_subtitle_fonts(sd);
-
-    if (opts->ass_style_override)
-        ass_set_style_overrides(ctx->ass_library, opts->ass_force_style_list);
-
-    ctx->ass_track = ass_new_track(ctx->ass_library);
-    if (!ctx->is_converted)
-        ctx->ass_track->track_type = TRACK_TYPE_ASS;
-
-    ctx->shadow_track = ass_new_track(ctx->ass_library);
-    ctx->shadow_track->PlayResX = 384;
-    ctx->shadow_track->PlayResY = 288;
-    mp_ass_add_default_styles(ctx->shadow_track, opts);
-
-    if (extradata)
-        ass_process_codec_private(ctx->ass_track, extradata, extradata_size);
-
-    mp_ass_add_default_styles(ctx->ass_track, opts);
+    ctx->ass_library = create_library(sd);
+    create_tracks(sd, ctx->ass_library, &ctx->ass_track, &ctx->shadow_track);
 
 #if LIBASS_VERSION >= 0x01302000
     ass_set_check_readorder(ctx->ass_track, sd->opts->sub_clear_on_seek ? 0 : 1);
@@ -198,32 +267,72 @@ static int init(struct sd *sd)
 
     ctx->packer = mp_ass_packer_alloc(ctx);
 
+    // With unknown durations, rendering flushes old events.
+    sd->prerender_ok = !ctx->duration_unknown;
+
     return 0;
 }
 
+static int seen_packets_slot(struct seen_packet *set, int size, uint64_t key)
+{
+    int n = (key * 0x9E3779B97F4A7C15ULL) >> 32 & (size - 1);
+    while (set[n].key && set[n].key != key)
+        n = (n + 1) & (size - 1);
+    return n;
+}
+
+// Replace the seen_packets set with one of the given size, containing the
+// entries that end at or after keep_ts.
+static void rehash_seen_packets(struct sd_ass_priv *priv, int new_size,
+                                long long keep_ts)
+{
+    struct seen_packet *set = talloc_zero_array(priv, struct seen_packet,
+                                                new_size);
+    int num = 0;
+    for (int n = 0; n < priv->seen_packets_size; n++) {
+        struct seen_packet *p = &priv->seen_packets[n];
+        if (p->key && p->end >= keep_ts) {
+            set[seen_packets_slot(set, new_size, p->key)] = *p;
+            num++;
+        }
+    }
+    talloc_free(priv->seen_packets);
+    priv->seen_packets = set;
+    priv->seen_packets_size = new_size;
+    priv->num_seen_packets = num;
+}
+
 // Test if the packet with the given file position (used as unique ID) was
 // already consumed. Return false if the packet is new (and add it to the
-// internal list), and return true if it was already seen.
-static bool check_packet_seen(struct sd *sd, int64_t pos)
+// internal set), and return true if it was already seen.
+static bool check_packet_seen(struct sd *sd, struct demux_packet *packet)
 {
     struct sd_ass_priv *priv = sd->priv;
-    int a = 0;
-    int b = priv->num_seen_packets;
-    while (a < b) {
-        int mid = a + (b - a) / 2;
-        int64_t val = priv->seen_packets[mid];
-        if (pos == val)
-            return true;
-        if (pos > val) {
-            a = mid + 1;
-        } else {
-            b = mid;
-        }
+    uint64_t key = packet->pos + 1;
+    if ((priv->num_seen_packets + 1) * 4 > priv->seen_packets_size * 3) {
+        int new_size = MPMAX(priv->seen_packets_size * 2, 256);
+        rehash_seen_packets(priv, new_size, LLONG_MIN);
     }
-    MP_TARRAY_INSERT_AT(priv, priv->seen_packets, priv->num_seen_packets, a, pos);
+    int n = seen_packets_slot(priv->seen_packets, priv->seen_packets_size, key);
+    if (priv->seen_packets[n].key)
+        return true;
+    long long end = LLONG_MAX;
+    if (packet->pts != MP_NOPTS_VALUE)
+        end = llrint((packet->pts + MPMAX(packet->duration, 0)) * 1000);
+    priv->seen_packets[n] = (struct seen_packet){.key = key, .end = end};
+    priv->num_seen_packets++;
     return false;
 }
 
+static void clear_seen_packets(struct sd_ass_priv *priv)
+{
+    if (priv->num_seen_packets) {
+        memset(priv->seen_packets, 0,
+               priv->seen_packets_size * sizeof(priv->seen_packets[0]));
+    }
+    priv->num_seen_packets = 0;
+}
+
 #define UNKNOWN_DURATION (INT_MAX / 1000)
 
 static void decode(struct sd *sd, struct demux_packet *packet)
@@ -232,15 +341,17 @@ static void decode(struct sd *sd, struct demux_packet *packet)
     ASS_Track *track = ctx->ass_track;
     if (ctx->converter) {
         if (!sd->opts->sub_clear_on_seek && packet->pos >= 0 &&
-            check_packet_seen(sd, packet->pos))
+            check_packet_seen(sd, packet))
             return;
         if (packet->duration < 0) {
             if (!ctx->duration_unknown) {
                 MP_WARN(sd, "Subtitle with unknown duration.\n");
                 ctx->duration_unknown = true;
+                sd->prerender_ok = false;
             }
             packet->duration = UNKNOWN_DURATION;
         }
+        int first_new = track->n_events;
         char **r = lavc_conv_decode(ctx->converter, packet);
         for (int n = 0; r && r[n]; n++) {
             char *ass_line = r[n];
@@ -252,10 +363,13 @@ static void decode(struct sd *sd, struct demux_packet *packet)
                 talloc_free(ass_line);
         }
         if (ctx->duration_unknown) {
-            for (int n = 0; n < track->n_events - 1; n++) {
-                if (track->events[n].Duration == UNKNOWN_DURATION * 1000) {
-                    track->events[n].Duration = track->events[n + 1].Start -
-                                                track->events[n].Start;
+            // Only the event before a new one can still have an unknown
+            // duration; all older ones were fixed when it was added.
+            for (int n = MPMAX(first_new, 1); n < track->n_events; n++) {
+                ASS_Event *prev = &track->events[n - 1];
+                if (prev->Duration == UNKNOWN_DURATION * 1000) {
+                    prev->Duration = track->events[n].Start - prev->Start;
+                    update_index_event(ctx, n - 1);
                 }
             }
         }
@@ -277,12 +391,12 @@ static void decode(struct sd *sd, struct demux_packet *packet)
     }
 }
 
-static void configure_ass(struct sd *sd, struct mp_osd_res *dim,
-                          bool converted, ASS_Track *track)
+static void configure_ass(struct sd *sd, ASS_Renderer *priv,
+                          struct mp_osd_res *dim, bool converted,
+                          ASS_Track *track)
 {
     struct mp_subtitle_opts *opts = sd->opts;
     struct sd_ass_priv *ctx = sd->priv;
-    ASS_Renderer *priv = ctx->ass_renderer;
 
     ass_set_frame_size(priv, dim->w, dim->h);
     ass_set_margins(priv, dim->mt, dim->mb, dim->ml, dim->mr);
@@ -348,6 +462,24 @@ static void configure_ass(struct sd *sd, struct mp_osd_res *dim,
     ass_set_font_scale(priv, set_font_scale);
     ass_set_hinting(priv, set_hinting);
     ass_set_line_spacing(priv, set_line_spacing);
+
+    double scale = dim->display_par;
+    if (!converted && (!opts->ass_style_override ||
+                       opts->ass_vsfilter_aspect_compat))
+    {
+        // Let's use the original video PAR for vsfilter compatibility:
+        double par = ctx->video_params.p_w / (double)ctx->video_params.p_h;
+        if (isnormal(par))
+            scale *= par;
+    }
+    ass_set_pixel_aspect(priv, scale);
+    if (!converted && (!opts->ass_style_override ||
+                       opts->ass_vsfilter_blur_compat))
+    {
+        ass_set_storage_size(priv, ctx->video_params.w, ctx->video_params.h);
+    } else {
+        ass_set_storage_size(priv, 0, 0);
+    }
 }
 
 static bool has_overrides(char *s)
@@ -358,6 +490,160 @@ static bool has_overrides(char *s)
            strstr(s, "\\iclip") || strstr(s, "\\org") || strstr(s, "\\p");
 }
 
+static int compare_event_ref(const void *pa, const void *pb)
+{
+    const struct event_ref *a = pa, *b = pb;
+    if (a->start != b->start)
+        return a->start < b->start ? -1 : 1;
+    return a->event - b->event;
+}
+
+static long long event_end(ASS_Track *track, int n)
+{
+    return track->events[n].Start + track->events[n].Duration;
+}
+
+static void index_rebuild_tree(struct sd_ass_priv *ctx)
+{
+    struct event_index *ix = &ctx->index;
+    ASS_Track *track = ctx->ass_track;
+
+    int size = 16;
+    while (size < ix->num_refs)
+        size *= 2;
+    if (size != ix->size) {
+        ix->size = size;
+        ix->max_end = talloc_realloc(ctx, ix->max_end, long long, size * 2);
+    }
+    for (int n = 0; n < size; n++) {
+        ix->max_end[size + n] = n < ix->num_refs
+            ? event_end(track, ix->refs[n].event) : LLONG_MIN;
+    }
+    for (int n = size - 1; n >= 1; n--)
+        ix->max_end[n] = MPMAX(ix->max_end[n * 2], ix->max_end[n * 2 + 1]);
+}
+
+static void index_set_end(struct event_index *ix, int pos, long long end)
+{
+    int node = ix->size + pos;
+    ix->max_end[node] = end;
+    for (node /= 2; node >= 1; node /= 2) {
+        ix->max_end[node] = MPMAX(ix->max_end[node * 2],
+                                  ix->max_end[node * 2 + 1]);
+    }
+}
+
+// Add events that were added to the track since the last call. Events are
+// normally appended in start time order, so this is O(log n) per event.
+static void update_index(struct sd_ass_priv *ctx)
+{
+    struct event_index *ix = &ctx->index;
+    ASS_Track *track = ctx->ass_track;
+
+    if (!ix->valid || track->n_events < ix->num_refs) {
+        ix->num_refs = 0;
+        ix->size = 0;
+        ix->valid = true;
+    }
+    if (track->n_events == ix->num_refs && ix->size)
+        return;
+
+    int first = ix->num_refs;
+    bool sorted = true;
+    MP_TARRAY_GROW(ctx, ix->refs, track->n_events);
+    for (int n = first; n < track->n_events; n++) {
+        struct event_ref ref = {track->events[n].Start, n};
+        if (ix->num_refs && compare_event_ref(&ix->refs[ix->num_refs - 1],
+                                              &ref) > 0)
+            sorted = false;
+        ix->refs[ix->num_refs++] = ref;
+    }
+
+    if (!sorted) {
+        qsort(ix->refs, ix->num_refs, sizeof(ix->refs[0]), compare_event_ref);
+        index_rebuild_tree(ctx);
+    } else if (ix->num_refs > ix->size) {
+        index_rebuild_tree(ctx);
+    } else {
+        for (int n = first; n < ix->num_refs; n++)
+            index_set_end(ix, n, event_end(track, ix->refs[n].event));
+    }
+}
+
+// Update the end time of the given event, if it is in the index already.
+static void update_index_event(struct sd_ass_priv *ctx, int n)
+{
+    struct event_index *ix = &ctx->index;
+    ASS_Track *track = ctx->ass_track;
+
+    if (!ix->valid || n >= ix->num_refs)
+        return;
+    struct event_ref ref = {track->events[n].Start, n};
+    int a = 0, b = ix->num_refs;
+    while (a < b) {
+        int mid = a + (b - a) / 2;
+        int cmp = compare_event_ref(&ix->refs[mid], &ref);
+        if (cmp == 0) {
+            index_set_end(ix, mid, event_end(track, n));
+            return;
+        }
+        if (cmp < 0) {
+            a = mid + 1;
+        } else {
+            b = mid;
+        }
+    }
+    ix->valid = false; // should not happen
+}
+
+static void collect_events(struct sd_ass_priv *ctx, int node, int l, int r,
+                           int num, long long end_min, int max)
+{
+    struct event_index *ix = &ctx->index;
+    if (l >= num || ix->max_end[node] < end_min || ctx->num_found_events > max)
+        return;
+    if (r - l == 1) {
+        MP_TARRAY_APPEND(ctx, ctx->found_events, ctx->num_found_events,
+                         ix->refs[l].event);
+        return;
+    }
+    int mid = l + (r - l) / 2;
+    collect_events(ctx, node * 2, l, mid, num, end_min, max);
+    collect_events(ctx, node * 2 + 1, mid, r, num, end_min, max);
+}
+
+static int compare_int(const void *pa, const void *pb)
+{
+    return *(const int *)pa - *(const int *)pb;
+}
+
+// Set ctx->found_events to the indexes of all events in ctx->ass_track with
+// Start <= start_max and Start + Duration >= end_min, in track order. Stop
+// searching once more than max events were found. Returns the number found.
+static int find_events(struct sd_ass_priv *ctx, long long start_max,
+                       long long end_min, int max)
+{
+    struct event_index *ix = &ctx->index;
+
+    update_index(ctx);
+    ctx->num_found_events = 0;
+
+    // Only events before this position can start early enough.
+    int a = 0, b = ix->num_refs;
+    while (a < b) {
+        int mid = a + (b - a) / 2;
+        if (ix->refs[mid].start <= start_max) {
+            a = mid + 1;
+        } else {
+            b = mid;
+        }
+    }
+
+    collect_events(ctx, 1, 0, ix->size, a, end_min, max);
+    qsort(ctx->found_events, ctx->num_found_events, sizeof(int), compare_int);
+    return ctx->num_found_events;
+}
+
 #define END(ev) ((ev)->Start + (ev)->Duration)
 
 static long long find_timestamp(struct sd *sd, double pts)
@@ -377,19 +663,11 @@ static long long find_timestamp(struct sd *sd, double pts)
     int keep = SUB_GAP_KEEP * 1000;
 
     // Find the "current" event.
-    ASS_Event *ev[2] = {0};
-    int n_ev = 0;
-    for (int n = 0; n < track->n_events; n++) {
-        ASS_Event *event = &track->events[n];
-        if (ts >= event->Start - threshold && ts <= END(event) + threshold) {
-            if (n_ev >= MP_ARRAY_SIZE(ev))
-                return ts; // multiple overlaps - give up (probably complex subs)
-            ev[n_ev++] = event;
-        }
-    }
-
-    if (n_ev != 2)
+    // Multiple overlaps - give up (probably complex subs).
+    if (find_events(priv, ts + threshold, ts - threshold, 2) != 2)
         return ts;
+    ASS_Event *ev[2] = {&track->events[priv->found_events[0]],
+                        &track->events[priv->found_events[1]]};
 
     // Simple/minor heuristic against destroying typesetting.
     if (ev[0]->Style != ev[1]->Style || has_overrides(ev[0]->Text) ||
@@ -439,28 +717,14 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
     if (pts == MP_NOPTS_VALUE || !renderer)
         return;
 
-    double scale = dim.display_par;
-    if (!converted && (!opts->ass_style_override ||
-                       opts->ass_vsfilter_aspect_compat))
-    {
-        // Let's use the original video PAR for vsfilter compatibility:
-        double par = ctx->video_params.p_w / (double)ctx->video_params.p_h;
-        if (isnormal(par))
-            scale *= par;
-    }
-    configure_ass(sd, &dim, converted, track);
-    ass_set_pixel_aspect(renderer, scale);
-    if (!converted && (!opts->ass_style_override ||
-                       opts->ass_vsfilter_blur_compat))
-    {
-        ass_set_storage_size(renderer, ctx->video_params.w, ctx->video_params.h);
-    } else {
-        ass_set_storage_size(renderer, 0, 0);
-    }
+    configure_ass(sd, renderer, &dim, converted, track);
     long long ts = find_timestamp(sd, pts);
     if (ctx->duration_unknown && pts != MP_NOPTS_VALUE) {
+        int num_events = track->n_events;
         mp_ass_flush_old_events(track, ts);
-        ctx->num_seen_packets = 0;
+        if (track->n_events != num_events)
+            ctx->index.valid = false;
+        clear_seen_packets(ctx);
         sd->preload_ok = false;
     }
 
@@ -481,6 +745,120 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
     }
 }
 
+// Everything prerender_render() needs, copied by prerender_prepare().
+struct prerender_job {
+    struct prerenderer *r;
+    ASS_Track *track;           // one of r's tracks, with the events at ts
+    long long ts;
+    int format;
+    bool mangle;
+    struct color_mangle color;
+};
+
+static char *strdup_null(const char *s)
+{
+    return s ? strdup(s) : NULL;
+}
+
+// Replace the events of dst with copies of the given events (all if events is
+// NULL) of src.
+static void copy_events(ASS_Track *dst, ASS_Track *src, int *events,
+                        int num_events)
+{
+    ass_flush_events(dst);
+    if (!events)
+        num_events = src->n_events;
+    for (int n = 0; n < num_events; n++) {
+        ASS_Event *event = &dst->events[ass_alloc_event(dst)];
+        *event = src->events[events ? events[n] : n];
+        event->Name = strdup_null(event->Name);
+        event->Text = strdup_null(event->Text);
+        event->Effect = strdup_null(event->Effect);
+        event->render_priv = NULL;
+    }
+}
+
+// Called with the decoder locked (like all other sd functions), and always on
+// the same thread as prerender_render(). Return a job to render pts, or NULL.
+// Free with talloc_free().
+static void *prerender_prepare(struct sd *sd, struct mp_osd_res dim,
+                               int format, double pts)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    struct mp_subtitle_opts *opts = sd->opts;
+    bool no_ass = !opts->ass_enabled || ctx->on_top ||
+                  opts->ass_style_override == 5;
+    bool converted = ctx->is_converted || no_ass;
+
+    if (pts == MP_NOPTS_VALUE || !ctx->ass_renderer)
+        return NULL;
+
+    // The header and styles of the tracks don't change after init(), so the
+    // prerenderer's tracks are created from the header once. Parsing it again
+    // also gets a complete copy of the header state, including embedded fonts.
+    if (!ctx->prerenderer) {
+        struct prerenderer *r = talloc_zero(ctx, struct prerenderer);
+        r->library = create_library(sd);
+        r->renderer = ass_renderer_init(r->library);
+        if (!r->renderer) {
+            ass_library_done(r->library);
+            talloc_free(r);
+            return NULL;
+        }
+        mp_ass_configure_fonts(r->renderer, opts->sub_style, sd->global,
+                               sd->log);
+        create_tracks(sd, r->library, &r->ass_track, &r->shadow_track);
+        r->packer = mp_ass_packer_alloc(r);
+        ctx->prerenderer = r;
+    }
+    struct prerenderer *r = ctx->prerenderer;
+
+    long long ts = find_timestamp(sd, pts);
+    ASS_Track *track;
+    if (no_ass) {
+        fill_plaintext(sd, pts);
+        track = r->shadow_track;
+        copy_events(track, ctx->shadow_track, NULL, 0);
+    } else {
+        int num = find_events(ctx, ts, ts + 1, INT_MAX);
+        track = r->ass_track;
+        copy_events(track, ctx->ass_track, ctx->found_events, num);
+    }
+
+    struct prerender_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct prerender_job){
+        .r = r,
+        .track = track,
+        .ts = ts,
+        .format = format,
+    };
+    configure_ass(sd, r->renderer, &dim, converted, track);
+    job->mangle = !converted && get_color_mangle(sd, &job->color);
+    return job;
+}
+
+// Render a job returned by prerender_prepare(). This does not access the
+// decoder, and can be called without holding the decoder lock. *res is valid
+// until the next call.
+static void prerender_render(void *p, struct sub_bitmaps *res)
+{
+    struct prerender_job *job = p;
+    struct prerenderer *r = job->r;
+
+    int changed;
+    ASS_Image *imgs = ass_render_frame(r->renderer, job->track, job->ts,
+                                       &changed);
+    mp_ass_packer_pack(r->packer, &imgs, 1, changed, job->format, res);
+
+    if (job->mangle && res->num_parts > 0) {
+        MP_TARRAY_GROW(r, r->bs, res->num_parts);
+        memcpy(r->bs, res->parts, sizeof(r->bs[0]) * res->num_parts);
+        res->parts = r->bs;
+
+        apply_color_mangle(&job->color, res);
+    }
+}
+
 struct buf {
     char *start;
     int size;
@@ -564,17 +942,16 @@ static char *get_text(struct sd *sd, double pts)
 
     struct buf b = {ctx->last_text, sizeof(ctx->last_text) - 1};
 
-    for (int i = 0; i < track->n_events; ++i) {
-        ASS_Event *event = track->events + i;
-        if (ipts >= event->Start && ipts < event->Start + event->Duration) {
-            if (event->Text) {
-                int start = b.len;
-                ass_to_plaintext(&b, event->Text);
-                if (is_whitespace_only(&b.start[start], b.len - start)) {
-                    b.len = start;
-                } else {
-                    append(&b, '\n');
-                }
+    find_events(ctx, ipts, ipts + 1, INT_MAX - 1);
+    for (int i = 0; i < ctx->num_found_events; ++i) {
+        ASS_Event *event = track->events + ctx->found_events[i];
+        if (event->Text) {
+            int start = b.len;
+            ass_to_plaintext(&b, event->Text);
+            if (is_whitespace_only(&b.start[start], b.len - start)) {
+                b.len = start;
+            } else {
+                append(&b, '\n');
             }
         }
     }
@@ -631,13 +1008,70 @@ static void reset(struct sd *sd)
     struct sd_ass_priv *ctx = sd->priv;
     if (sd->opts->sub_clear_on_seek || ctx->duration_unknown) {
         ass_flush_events(ctx->ass_track);
-        ctx->num_seen_packets = 0;
+        ctx->index.valid = false;
+        clear_seen_packets(ctx);
         sd->preload_ok = false;
     }
     if (ctx->converter)
         lavc_conv_reset(ctx->converter);
 }
 
+// Don't scan the events again until the prune time advanced this much (ms).
+#define PRUNE_INTERVAL 10000
+
+// Discard events that ended before ts, and forget the packets they came from,
+// so that they are decoded again if they are read again after a seek.
+static void prune_events(struct sd *sd, long long ts)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    ASS_Track *track = ctx->ass_track;
+
+    ctx->prune_ts = MPMIN(ctx->prune_ts, ts);
+    if (ts < ctx->prune_ts + PRUNE_INTERVAL)
+        return;
+    ctx->prune_ts = ts;
+
+    int num_events = 0;
+    for (int n = 0; n < track->n_events; n++) {
+        ASS_Event *event = &track->events[n];
+        if (event->Start + event->Duration < ts) {
+            ass_free_event(track, n);
+        } else {
+            track->events[num_events++] = *event;
+        }
+    }
+    if (num_events == track->n_events)
+        return;
+    MP_DBG(sd, "Pruned %d old events.\n", track->n_events - num_events);
+    track->n_events = num_events;
+    ctx->index.valid = false;
+    sd->preload_ok = false;
+
+    if (ctx->seen_packets_size)
+        rehash_seen_packets(ctx, ctx->seen_packets_size, ts);
+}
+
+static int64_t get_memory_usage(struct sd *sd)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    ASS_Track *track = ctx->ass_track;
+
+    int64_t size = track->max_events * sizeof(track->events[0]);
+    for (int n = 0; n < track->n_events; n++) {
+        ASS_Event *event = &track->events[n];
+        if (event->Text)
+            size += strlen(event->Text) + 1;
+        if (event->Name)
+            size += strlen(event->Name) + 1;
+        if (event->Effect)
+            size += strlen(event->Effect) + 1;
+    }
+    size += ctx->seen_packets_size * sizeof(ctx->seen_packets[0]);
+    size += ctx->index.num_refs * sizeof(ctx->index.refs[0]);
+    size += ctx->index.size * 2 * sizeof(ctx->index.max_end[0]);
+    return size;
+}
+
 static void uninit(struct sd *sd)
 {
     struct sd_ass_priv *ctx = sd->priv;
@@ -647,6 +1081,13 @@ static void uninit(struct sd *sd)
     ass_free_track(ctx->ass_track);
     ass_free_track(ctx->shadow_track);
     enable_output(sd, false);
+    if (ctx->prerenderer) {
+        struct prerenderer *r = ctx->prerenderer;
+        ass_free_track(r->ass_track);
+        ass_free_track(r->shadow_track);
+        ass_renderer_done(r->renderer);
+        ass_library_done(r->library);
+    }
     ass_library_done(ctx->ass_library);
 }
 
@@ -669,6 +1110,15 @@ static int control(struct sd *sd, enum sd_ctrl cmd, void *arg)
     case SD_CTRL_SET_TOP:
         ctx->on_top = *(bool *)arg;
         return CONTROL_OK;
+    case SD_CTRL_PRUNE_EVENTS:
+        // Native ASS packets can't be pruned: libass would discard them as
+        // duplicates if they are read again.
+        if (ctx->converter)
+            prune_events(sd, llrint(*(double *)arg * 1000));
+        return CONTROL_OK;
+    case SD_CTRL_GET_MEMORY_USAGE:
+        *(int64_t *)arg = get_memory_usage(sd);
+        return CONTROL_OK;
     default:
         return CONTROL_UNKNOWN;
     }
@@ -680,6 +1130,8 @@ const struct sd_functions sd_ass = {
     .init = init,
     .decode = decode,
     .get_bitmaps = get_bitmaps,
+    .prerender_prepare = prerender_prepare,
+    .prerender_render = prerender_render,
     .get_text = get_text,
     .control = control,
     .reset = reset,
@@ -689,13 +1141,21 @@ const struct sd_functions sd_ass = {
 
 // Disgusting hack for (xy-)vsfilter color compatibility.
 static void mangle_colors(struct sd *sd, struct sub_bitmaps *parts)
+{
+    struct color_mangle m;
+    if (get_color_mangle(sd, &m))
+        apply_color_mangle(&m, parts);
+}
+
+// Return whether colors need to be mangled, and set *m to the conversion.
+static bool get_color_mangle(struct sd *sd, struct color_mangle *m)
 {
     struct mp_subtitle_opts *opts = sd->opts;
     struct sd_ass_priv *ctx = sd->priv;
     enum mp_csp csp = 0;
     enum mp_csp_levels levels = 0;
     if (opts->ass_vsfilter_color_compat == 0) // "no"
-        return;
+        return false;
     bool force_601 = opts->ass_vsfilter_color_compat == 3;
     ASS_Track *track = ctx->ass_track;
     static const int ass_csp[] = {
@@ -719,7 +1179,7 @@ static void mangle_colors(struct sd *sd, struct sub_bitmaps *parts)
         trackcsp = YCBCR_BT601_TV;
     // NONE is a bit random, but the intention is: don't modify colors.
     if (trackcsp == YCBCR_NONE)
-        return;
+        return false;
     if (trackcsp < sizeof(ass_csp) / sizeof(ass_csp[0]))
         csp = ass_csp[trackcsp];
     if (trackcsp < sizeof(ass_levels) / sizeof(ass_levels[0]))
@@ -730,7 +1190,7 @@ static void mangle_colors(struct sd *sd, struct sub_bitmaps *parts)
     }
     // Unknown colorspace (either YCBCR_UNKNOWN, or a valid value unknown to us)
     if (!csp || !levels)
-        return;
+        return false;
 
     struct mp_image_params params = ctx->video_params;
 
@@ -742,7 +1202,7 @@ static void mangle_colors(struct sd *sd, struct sub_bitmaps *parts)
     }
 
     if (csp == params.color.space && levels == params.color.levels)
-        return;
+        return false;
 
     bool basic_conv = params.color.space == MP_CSP_BT_709 &&
                       params.color.levels == MP_CSP_LEVELS_TV &&
@@ -751,7 +1211,7 @@ static void mangle_colors(struct sd *sd, struct sub_bitmaps *parts)
 
     // With "basic", only do as much as needed for basic compatibility.
     if (opts->ass_vsfilter_color_compat == 1 && !basic_conv)
-        return;
+        return false;
 
     if (params.color.space != ctx->last_params.color.space ||
         params.color.levels != ctx->last_params.color.levels)
@@ -770,16 +1230,19 @@ static void mangle_colors(struct sd *sd, struct sub_bitmaps *parts)
     struct mp_csp_params vs_params = MP_CSP_PARAMS_DEFAULTS;
     vs_params.color.space = csp;
     vs_params.color.levels = levels;
-    struct mp_cmat vs_yuv2rgb, vs_rgb2yuv;
+    struct mp_cmat vs_yuv2rgb;
     mp_get_csp_matrix(&vs_params, &vs_yuv2rgb);
-    mp_invert_cmat(&vs_rgb2yuv, &vs_yuv2rgb);
+    mp_invert_cmat(&m->vs_rgb2yuv, &vs_yuv2rgb);
 
     // Proper conversion to RGB
     struct mp_csp_params rgb_params = MP_CSP_PARAMS_DEFAULTS;
     rgb_params.color = params.color;
-    struct mp_cmat vs2rgb;
-    mp_get_csp_matrix(&rgb_params, &vs2rgb);
+    mp_get_csp_matrix(&rgb_params, &m->vs2rgb);
+    return true;
+}
 
+static void apply_color_mangle(struct color_mangle *m, struct sub_bitmaps *parts)
+{
     for (int n = 0; n < parts->num_parts; n++) {
         struct sub_bitmap *sb = &parts->parts[n];
         uint32_t color = sb->libass.color;
@@ -788,8 +1251,8 @@ static void mangle_colors(struct sd *sd, struct sub_bitmaps *parts)
         int b = (color >>  8u) & 0xff;
         int a = 0xff - (color & 0xff);
         int rgb[3] = {r, g, b}, yuv[3];
-        mp_map_fixp_color(&vs_rgb2yuv, 8, rgb, 8, yuv);
-        mp_map_fixp_color(&vs2rgb, 8, yuv, 8, rgb);
+        mp_map_fixp_color(&m->vs_rgb2yuv, 8, rgb, 8, yuv);
+        mp_map_fixp_color(&m->vs2rgb, 8, yuv, 8, rgb);
         sb->libass.color = MP_ASS_RGBA(rgb[0], rgb[1], rgb[2], a);
     }
 }
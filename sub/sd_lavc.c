@@ -32,6 +32,7 @@
 #include "demux/stheader.h"
 #include "options/options.h"
 #include "video/mp_image.h"
+#include "video/mp_image_pool.h"
 #include "video/out/bitmap_packer.h"
 #include "img_convert.h"
 #include "sd.h"
@@ -57,6 +58,23 @@ struct seekpoint {
     double endpts;
 };
 
+// Converted bitmaps of a subtitle event, so that decoding the same event again
+// (e.g. after seeking back) does not redo the conversion.
+struct cached_sub {
+    double pts;
+    uint64_t hash;              // of the AVSubtitle and the options used
+    struct mp_image *data;      // reference shared with struct sub
+    struct sub_bitmap *bitmaps;
+    int count;
+    int bound_w, bound_h;
+    int src_w, src_h;
+    int64_t size;               // of data, in bytes
+    uint64_t last_used;
+};
+
+#define MAX_CACHED_SUBS 16
+#define MAX_CACHE_SIZE (32 * 1024 * 1024)
+
 struct sd_lavc_priv {
     AVCodecContext *avctx;
     AVRational pkt_timebase;
@@ -69,6 +87,12 @@ struct sd_lavc_priv {
     struct seekpoint *seekpoints;
     int num_seekpoints;
     struct bitmap_packer *packer;
+    struct mp_image_pool *pool;
+    struct mp_image *blur_tmp;
+    struct cached_sub *cache;
+    int num_cache;
+    int64_t cache_size;
+    uint64_t cache_counter;
 };
 
 static int init(struct sd *sd)
@@ -109,6 +133,7 @@ static int init(struct sd *sd)
     priv->displayed_id = -1;
     priv->current_pts = MP_NOPTS_VALUE;
     priv->packer = talloc_zero(priv, struct bitmap_packer);
+    priv->pool = mp_image_pool_new(priv);
     return 0;
 
  error:
@@ -143,24 +168,146 @@ static void alloc_sub(struct sd_lavc_priv *priv)
     priv->subs[0].id = priv->new_id++;
 }
 
+// Same as v / 255 for 0 <= v <= 255 * 255.
+static inline unsigned div255(unsigned v)
+{
+    return (v + 1 + (v >> 8)) >> 8;
+}
+
+// Branch-free and without divisions, so that the compiler can vectorize it.
 static void convert_pal(uint32_t *colors, size_t count, bool gray)
 {
-    for (int n = 0; n < count; n++) {
+    for (size_t n = 0; n < count; n++) {
         uint32_t c = colors[n];
-        int b = c & 0xFF;
-        int g = (c >> 8) & 0xFF;
-        int r = (c >> 16) & 0xFF;
-        int a = (c >> 24) & 0xFF;
-        if (gray)
-            r = g = b = (r + g + b) / 3;
+        unsigned b = c & 0xFF;
+        unsigned g = (c >> 8) & 0xFF;
+        unsigned r = (c >> 16) & 0xFF;
+        unsigned a = (c >> 24) & 0xFF;
+        // (r + g + b) / 3
+        unsigned y = ((r + g + b) * 21846) >> 16;
+        b = gray ? y : b;
+        g = gray ? y : g;
+        r = gray ? y : r;
         // from straight to pre-multiplied alpha
-        b = b * a / 255;
-        g = g * a / 255;
-        r = r * a / 255;
+        b = div255(b * a);
+        g = div255(g * a);
+        r = div255(r * a);
         colors[n] = b | (g << 8) | (r << 16) | (a << 24);
     }
 }
 
+// FNV-1a, but on 8 byte words where possible.
+static uint64_t hash_data(uint64_t h, const void *data, size_t size)
+{
+    const uint8_t *p = data;
+    for (; size >= 8; size -= 8, p += 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        h = (h ^ v) * 0x100000001b3ULL;
+    }
+    for (; size > 0; size--)
+        h = (h ^ *p++) * 0x100000001b3ULL;
+    return h;
+}
+
+static uint64_t hash_sub(struct sd *sd, struct sub *sub)
+{
+    struct mp_subtitle_opts *opts = sd->opts;
+    AVSubtitle *avsub = &sub->avsub;
+
+    uint64_t h = 0xcbf29ce484222325ULL;
+    int params[] = {opts->sub_gray, opts->forced_subs_only, avsub->num_rects};
+    h = hash_data(h, params, sizeof(params));
+    h = hash_data(h, &opts->sub_gauss, sizeof(opts->sub_gauss));
+    for (int i = 0; i < avsub->num_rects; i++) {
+        struct AVSubtitleRect *r = avsub->rects[i];
+        int rc[] = {r->type, r->flags, r->x, r->y, r->w, r->h, r->nb_colors};
+        h = hash_data(h, rc, sizeof(rc));
+        if (r->type != SUBTITLE_BITMAP || r->w <= 0 || r->h <= 0)
+            continue;
+        h = hash_data(h, r->data[1], MPCLAMP(r->nb_colors, 0, 256) * 4);
+        for (int y = 0; y < r->h; y++)
+            h = hash_data(h, r->data[0] + y * r->linesize[0], r->w);
+    }
+    return h;
+}
+
+static void remove_cached(struct sd_lavc_priv *priv, int index)
+{
+    struct cached_sub *c = &priv->cache[index];
+    priv->cache_size -= c->size;
+    talloc_free(c->data);
+    talloc_free(c->bitmaps);
+    MP_TARRAY_REMOVE_AT(priv->cache, priv->num_cache, index);
+}
+
+static bool use_cached(struct sd_lavc_priv *priv, struct sub *sub,
+                       uint64_t hash)
+{
+    for (int n = 0; n < priv->num_cache; n++) {
+        struct cached_sub *c = &priv->cache[n];
+        if (c->hash != hash || c->pts != sub->pts)
+            continue;
+        struct mp_image *data = mp_image_new_ref(c->data);
+        if (!data)
+            return false;
+        talloc_free(sub->data);
+        sub->data = talloc_steal(priv, data);
+        MP_TARRAY_GROW(priv, sub->inbitmaps, c->count);
+        memcpy(sub->inbitmaps, c->bitmaps, c->count * sizeof(c->bitmaps[0]));
+        sub->count = c->count;
+        sub->bound_w = c->bound_w;
+        sub->bound_h = c->bound_h;
+        sub->src_w = c->src_w;
+        sub->src_h = c->src_h;
+        c->last_used = ++priv->cache_counter;
+        return true;
+    }
+    return false;
+}
+
+static void add_cached(struct sd_lavc_priv *priv, struct sub *sub,
+                       uint64_t hash)
+{
+    if (!sub->count)
+        return;
+    int64_t size = sub->data->stride[0] * (int64_t)sub->data->h;
+    if (size > MAX_CACHE_SIZE)
+        return;
+
+    while (priv->num_cache &&
+           (priv->num_cache >= MAX_CACHED_SUBS ||
+            priv->cache_size + size > MAX_CACHE_SIZE))
+    {
+        int oldest = 0;
+        for (int n = 1; n < priv->num_cache; n++) {
+            if (priv->cache[n].last_used < priv->cache[oldest].last_used)
+                oldest = n;
+        }
+        remove_cached(priv, oldest);
+    }
+
+    struct mp_image *data = mp_image_new_ref(sub->data);
+    if (!data)
+        return;
+    struct cached_sub c = {
+        .pts = sub->pts,
+        .hash = hash,
+        .data = talloc_steal(priv, data),
+        .bitmaps = talloc_memdup(priv, sub->inbitmaps,
+                                 sub->count * sizeof(sub->inbitmaps[0])),
+        .count = sub->count,
+        .bound_w = sub->bound_w,
+        .bound_h = sub->bound_h,
+        .src_w = sub->src_w,
+        .src_h = sub->src_h,
+        .size = size,
+        .last_used = ++priv->cache_counter,
+    };
+    MP_TARRAY_APPEND(priv, priv->cache, priv->num_cache, c);
+    priv->cache_size += size;
+}
+
 // Initialize sub from sub->avsub.
 static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
 {
@@ -168,6 +315,10 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
     struct sd_lavc_priv *priv = sd->priv;
     AVSubtitle *avsub = &sub->avsub;
 
+    uint64_t hash = hash_sub(sd, sub);
+    if (use_cached(priv, sub, hash))
+        return;
+
     MP_TARRAY_GROW(priv, sub->inbitmaps, avsub->num_rects);
 
     packer_set_size(priv->packer, avsub->num_rects);
@@ -220,9 +371,13 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
     sub->bound_w = bb[1].x;
     sub->bound_h = bb[1].y;
 
-    if (!sub->data || sub->data->w < sub->bound_w || sub->data->h < sub->bound_h) {
+    // The image can't be reused if the cache still references it.
+    if (!sub->data || sub->data->w < sub->bound_w ||
+        sub->data->h < sub->bound_h || !mp_image_is_writeable(sub->data))
+    {
         talloc_free(sub->data);
-        sub->data = mp_image_alloc(IMGFMT_BGRA, priv->packer->w, priv->packer->h);
+        sub->data = mp_image_pool_get(priv->pool, IMGFMT_BGRA,
+                                      priv->packer->w, priv->packer->h);
         if (!sub->data) {
             sub->count = 0;
             return;
@@ -260,17 +415,15 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
 
         for (int y = -padding; y < b->h + padding; y++) {
             uint32_t *out = (uint32_t*)((char*)b->bitmap + y * b->stride);
-            int start = 0;
-            for (int x = -padding; x < 0; x++)
-                out[x] = 0;
-            if (y >= 0 && y < b->h) {
-                uint8_t *in = data[0] + y * linesize[0];
-                for (int x = 0; x < b->w; x++)
-                    *out++ = pal[*in++];
-                start = b->w;
+            if (y < 0 || y >= b->h) {
+                memset(out - padding, 0, (b->w + padding * 2) * 4);
+                continue;
             }
-            for (int x = start; x < b->w + padding; x++)
-                *out++ = 0;
+            memset(out - padding, 0, padding * 4);
+            uint8_t *in = data[0] + y * linesize[0];
+            for (int x = 0; x < b->w; x++)
+                out[x] = pal[in[x]];
+            memset(out + b->w, 0, padding * 4);
         }
 
         b->bitmap = (char*)b->bitmap - extend * b->stride - extend * 4;
@@ -282,8 +435,10 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
         b->h += extend * 2;
 
         if (apply_blur)
-            mp_blur_rgba_sub_bitmap(b, opts->sub_gauss);
+            mp_blur_rgba_sub_bitmap(b, opts->sub_gauss, &priv->blur_tmp);
     }
+
+    add_cached(priv, sub, hash);
 }
 
 static void decode(struct sd *sd, struct demux_packet *packet)
@@ -500,6 +655,9 @@ static void uninit(struct sd *sd)
 
     for (int n = 0; n < MAX_QUEUE; n++)
         clear_sub(&priv->subs[n]);
+    while (priv->num_cache)
+        remove_cached(priv, priv->num_cache - 1);
+    talloc_free(priv->blur_tmp);
     avcodec_free_context(&priv->avctx);
     talloc_free(priv);
 }
@@ -579,6 +737,9 @@ static int control(struct sd *sd, enum sd_ctrl cmd, void *arg)
     case SD_CTRL_SET_VIDEO_PARAMS:
         priv->video_params = *(struct mp_image_params *)arg;
         return CONTROL_OK;
+    case SD_CTRL_GET_MEMORY_USAGE:
+        *(int64_t *)arg = priv->cache_size;
+        return CONTROL_OK;
     default:
         return CONTROL_UNKNOWN;
     }
@@ -0,0 +1,222 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_helpers.h"
+#include "common/common.h"
+#include "mpv_talloc.h"
+#include "osdep/timer.h"
+#include "video/out/bitmap_packer.h"
+
+// Stand-ins for libass bitmaps: the address is the key, the size is derived
+// from the index, and content[] changes when a "bitmap" is reused.
+#define NUM_GLYPHS 400
+static char glyphs[NUM_GLYPHS];
+static int content[NUM_GLYPHS];
+static int content_seen[NUM_GLYPHS];
+
+static unsigned rnd(unsigned *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+static void glyph_size(int g, int *w, int *h) {
+    unsigned seed = g;
+    *w = 4 + rnd(&seed) % 60;
+    *h = 8 + rnd(&seed) % 40;
+    if (g % 50 == 0)
+        *w *= 8; // a wide "line" bitmap now and then
+}
+
+static bool same_content(void *ctx, struct bitmap_atlas_item *item) {
+    int g = (const char *)item->key - glyphs;
+    return content_seen[g] == content[g];
+}
+
+// Simulate karaoke-like subtitles: a few lines of glyphs, where some glyphs
+// are replaced by differently colored/sized versions on every frame, and
+// every now and then a new line replaces an old one.
+struct sequence {
+    unsigned seed;
+    int frame;
+    int cur[64];
+    int num_cur;
+};
+
+static void next_frame(struct sequence *s, struct bitmap_atlas_item *items,
+                       int *num_items) {
+    if (s->frame % 40 == 0 || !s->num_cur) {
+        s->num_cur = 40 + rnd(&s->seed) % 24;
+        int base = rnd(&s->seed) % (NUM_GLYPHS - 64);
+        for (int n = 0; n < s->num_cur; n++)
+            s->cur[n] = base + n;
+    }
+    for (int n = 0; n < 3; n++)
+        s->cur[rnd(&s->seed) % s->num_cur] = rnd(&s->seed) % NUM_GLYPHS;
+    if (s->frame % 17 == 0)
+        content[rnd(&s->seed) % NUM_GLYPHS]++;
+    s->frame++;
+
+    for (int n = 0; n < s->num_cur; n++) {
+        int g = s->cur[n];
+        items[n] = (struct bitmap_atlas_item){.key = &glyphs[g]};
+        glyph_size(g, &items[n].w, &items[n].h);
+    }
+    *num_items = s->num_cur;
+}
+
+static bool rc_inside(struct mp_rect *outer, struct mp_rect *inner) {
+    return inner->x0 >= outer->x0 && inner->y0 >= outer->y0 &&
+           inner->x1 <= outer->x1 && inner->y1 <= outer->y1;
+}
+
+static void check_frame(struct bitmap_atlas *a, struct bitmap_atlas_item *items,
+                        int num_items, int res) {
+    for (int n = 0; n < num_items; n++) {
+        struct bitmap_atlas_item *i = &items[n];
+        struct mp_rect rc = {i->pos.x, i->pos.y, i->pos.x + i->w,
+                             i->pos.y + i->h};
+        assert_true(rc.x0 >= 0 && rc.y0 >= 0);
+        assert_true(rc.x1 <= a->used_width && rc.y1 <= a->used_height);
+        assert_true(a->used_width <= a->w && a->used_height <= a->h);
+
+        for (int m = 0; m < n; m++) {
+            struct bitmap_atlas_item *o = &items[m];
+            if (o->key == i->key) {
+                assert_true(o->pos.x == i->pos.x && o->pos.y == i->pos.y);
+                continue;
+            }
+            struct mp_rect orc = {o->pos.x, o->pos.y, o->pos.x + o->w,
+                                  o->pos.y + o->h};
+            assert_false(mp_rect_intersection(&orc, &rc));
+        }
+
+        if (i->is_new && res == 0) {
+            bool covered = false;
+            for (int d = 0; d < a->num_dirty; d++)
+                covered |= rc_inside(&a->dirty[d], &rc);
+            assert_true(covered);
+        }
+    }
+    assert_true(res != 0 || !a->full_dirty);
+    assert_true(res != 1 || a->full_dirty);
+}
+
+static void test_atlas_sequence(void **state) {
+    struct bitmap_atlas *a = talloc_zero(NULL, struct bitmap_atlas);
+    a->w_max = a->h_max = 4096;
+    struct sequence s = {.seed = 1};
+    struct bitmap_atlas_item items[64], prev[64];
+    int num_items, num_prev = 0;
+    int incremental = 0;
+
+    for (int f = 0; f < 2000; f++) {
+        next_frame(&s, items, &num_items);
+        int res = bitmap_atlas_pack(a, items, num_items, same_content, NULL);
+        assert_true(res >= 0);
+        check_frame(a, items, num_items, res);
+        incremental += res == 0;
+
+        for (int n = 0; n < num_items; n++) {
+            int g = (const char *)items[n].key - glyphs;
+            bool changed = content_seen[g] != content[g];
+            // Unchanged glyphs keep their position on incremental updates.
+            for (int m = 0; m < num_prev && res == 0 && !changed; m++) {
+                if (prev[m].key == items[n].key) {
+                    assert_false(items[n].is_new);
+                    assert_int_equal(prev[m].pos.x, items[n].pos.x);
+                    assert_int_equal(prev[m].pos.y, items[n].pos.y);
+                }
+            }
+        }
+        for (int n = 0; n < num_items; n++) {
+            int g = (const char *)items[n].key - glyphs;
+            content_seen[g] = content[g];
+        }
+        memcpy(prev, items, num_items * sizeof(items[0]));
+        num_prev = num_items;
+    }
+    // Most frames must not need a full repack.
+    assert_true(incremental > 2000 * 3 / 4);
+    talloc_free(a);
+}
+
+static void test_atlas_max_size(void **state) {
+    struct bitmap_atlas *a = talloc_zero(NULL, struct bitmap_atlas);
+    a->w_max = a->h_max = 256;
+    struct bitmap_atlas_item items[5];
+    for (int n = 0; n < 5; n++)
+        items[n] = (struct bitmap_atlas_item){.key = &glyphs[n], 200, 100};
+    assert_int_equal(bitmap_atlas_pack(a, items, 2, NULL, NULL), 1);
+    assert_int_equal(bitmap_atlas_pack(a, items, 5, NULL, NULL), -1);
+    // Recovers once the items fit again.
+    assert_int_equal(bitmap_atlas_pack(a, items + 3, 2, NULL, NULL), 1);
+    assert_int_equal(bitmap_atlas_pack(a, items + 3, 2, NULL, NULL), 0);
+    assert_false(items[3].is_new || items[4].is_new);
+    assert_int_equal(a->num_dirty, 0);
+    talloc_free(a);
+}
+
+// Set MPV_PACKER_BENCHMARK to compare packing time and the area that needs to
+// be uploaded against repacking everything with packer_pack().
+static void test_benchmark(void **state) {
+    if (!getenv("MPV_PACKER_BENCHMARK"))
+        return;
+    int frames = 20000;
+    struct bitmap_atlas_item items[64];
+    int num_items;
+
+    struct bitmap_packer *packer = talloc_zero(NULL, struct bitmap_packer);
+    packer->w_max = packer->h_max = 4096;
+    struct sequence s = {.seed = 2};
+    int64_t area = 0;
+    int64_t start = mp_time_us();
+    for (int f = 0; f < frames; f++) {
+        next_frame(&s, items, &num_items);
+        packer_set_size(packer, num_items);
+        for (int n = 0; n < num_items; n++)
+            packer->in[n] = (struct pos){items[n].w, items[n].h};
+        assert_true(packer_pack(packer) >= 0);
+        area += packer->used_width * (int64_t)packer->used_height;
+    }
+    double secs = (mp_time_us() - start) / 1e6;
+    printf("packer_pack:       %8.2f us/frame, %10.0f pixels/frame uploaded\n",
+           secs / frames * 1e6, area / (double)frames);
+    talloc_free(packer);
+
+    struct bitmap_atlas *a = talloc_zero(NULL, struct bitmap_atlas);
+    a->w_max = a->h_max = 4096;
+    s = (struct sequence){.seed = 2};
+    area = 0;
+    int full = 0;
+    start = mp_time_us();
+    for (int f = 0; f < frames; f++) {
+        next_frame(&s, items, &num_items);
+        int res = bitmap_atlas_pack(a, items, num_items, same_content, NULL);
+        assert_true(res >= 0);
+        if (a->full_dirty) {
+            area += a->used_width * (int64_t)a->used_height;
+            full++;
+        }
+        for (int n = 0; n < a->num_dirty; n++) {
+            area += mp_rect_w(a->dirty[n]) * (int64_t)mp_rect_h(a->dirty[n]);
+        }
+        for (int n = 0; n < num_items; n++) {
+            int g = (const char *)items[n].key - glyphs;
+            content_seen[g] = content[g];
+        }
+    }
+    secs = (mp_time_us() - start) / 1e6;
+    printf("bitmap_atlas_pack: %8.2f us/frame, %10.0f pixels/frame uploaded "
+           "(%d full repacks)\n", secs / frames * 1e6, area / (double)frames,
+           full);
+    talloc_free(a);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_atlas_sequence),
+        cmocka_unit_test(test_atlas_max_size),
+        cmocka_unit_test(test_benchmark),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,116 @@
+#include <string.h>
+
+#include <libavutil/buffer.h>
+#include <libavutil/hwcontext.h>
+
+#include "test_helpers.h"
+#include "common/common.h"
+#include "video/fmt-conversion.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "video/mp_image_pool.h"
+
+// Any device that can be created without special hardware will do; if none
+// is available, the tests do nothing.
+static AVBufferRef *create_frames_ctx(int w, int h) {
+    enum AVHWDeviceType type = AV_HWDEVICE_TYPE_NONE;
+    while ((type = av_hwdevice_iterate_types(type)) != AV_HWDEVICE_TYPE_NONE) {
+        AVBufferRef *dev = NULL;
+        if (av_hwdevice_ctx_create(&dev, type, NULL, NULL, 0) < 0)
+            continue;
+        AVHWFramesConstraints *c = av_hwdevice_get_hwframe_constraints(dev, NULL);
+        enum AVPixelFormat hwfmt = c && c->valid_hw_formats
+                                 ? c->valid_hw_formats[0] : AV_PIX_FMT_NONE;
+        av_hwframe_constraints_free(&c);
+        AVBufferRef *frames = NULL;
+        if (mp_update_av_hw_frames_pool(&frames, dev, pixfmt2imgfmt(hwfmt),
+                                        IMGFMT_NV12, w, h))
+        {
+            av_buffer_unref(&dev);
+            return frames;
+        }
+        av_buffer_unref(&dev);
+    }
+    return NULL;
+}
+
+static void fill_image(struct mp_image *img) {
+    unsigned seed = 1;
+    for (int p = 0; p < img->num_planes; p++) {
+        int bytes = mp_image_plane_w(img, p) * img->fmt.bpp[p] / 8;
+        for (int y = 0; y < mp_image_plane_h(img, p); y++) {
+            uint8_t *line = img->planes[p] + y * img->stride[p];
+            for (int x = 0; x < bytes; x++) {
+                seed = seed * 1103515245 + 12345;
+                line[x] = seed >> 16;
+            }
+        }
+    }
+}
+
+static bool planes_equal(struct mp_image *a, struct mp_image *b) {
+    for (int p = 0; p < a->num_planes; p++) {
+        int bytes = mp_image_plane_w(a, p) * a->fmt.bpp[p] / 8;
+        for (int y = 0; y < mp_image_plane_h(a, p); y++) {
+            if (memcmp(a->planes[p] + y * a->stride[p],
+                       b->planes[p] + y * b->stride[p], bytes))
+                return false;
+        }
+    }
+    return true;
+}
+
+static void test_download(void **state) {
+    AVBufferRef *frames = create_frames_ctx(320, 240);
+    if (!frames)
+        return;
+
+    struct mp_image *src = mp_image_alloc(IMGFMT_NV12, 320, 240);
+    assert_true(src);
+    fill_image(src);
+    struct mp_image *hw = mp_av_pool_image_hw_upload(frames, src);
+    assert_true(hw);
+
+    struct mp_image_pool *pool = mp_image_pool_new(NULL);
+    int fmt = mp_image_hw_download_get_sw_format(pool, hw);
+    assert_true(fmt != 0);
+    // Cached per frames context.
+    assert_int_equal(mp_image_hw_download_get_sw_format(pool, hw), fmt);
+
+    struct mp_image_pool_stats st0, st1;
+    mp_image_pool_get_stats(pool, &st0);
+    for (int n = 0; n < 3; n++) {
+        struct mp_image *dl = mp_image_hw_download(hw, pool);
+        assert_true(dl);
+        assert_int_equal(dl->w, 320);
+        if (dl->imgfmt == IMGFMT_NV12)
+            assert_true(planes_equal(dl, src));
+        talloc_free(dl);
+    }
+    mp_image_pool_get_stats(pool, &st1);
+    assert_true(st1.hits - st0.hits >= 2);
+    assert_int_equal(st1.num_images, st1.misses);
+
+    // Download into a caller provided image.
+    struct mp_image *dst = mp_image_alloc(fmt, 320, 240);
+    assert_true(dst);
+    assert_true(mp_image_hw_download_image(dst, hw));
+    if (fmt == IMGFMT_NV12)
+        assert_true(planes_equal(dst, src));
+    struct mp_image *small = mp_image_alloc(fmt, 160, 120);
+    assert_false(mp_image_hw_download_image(small, hw));
+
+    talloc_free(small);
+    talloc_free(dst);
+    talloc_free(pool);
+    talloc_free(hw);
+    talloc_free(src);
+    av_buffer_unref(&frames);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_download),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,200 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "test_helpers.h"
+#include "audio/fmt-conversion.h"
+#include "audio/format.h"
+#include "audio/sample_conv.h"
+#include "common/common.h"
+#include "osdep/endian.h"
+
+#if !HAVE_LIBAV
+#include <libavutil/channel_layout.h>
+#include <libswresample/swresample.h>
+#endif
+
+#define SAMPLES 1000
+
+static void fill_pattern(uint8_t *data, size_t size, unsigned seed) {
+    for (size_t n = 0; n < size; n++) {
+        seed = seed * 1103515245 + 12345;
+        data[n] = seed >> 16;
+    }
+}
+
+static void fill_float(float *data, int num, unsigned seed) {
+    for (int n = 0; n < num; n++) {
+        seed = seed * 1103515245 + 12345;
+        // Slightly out of range, so that clipping is tested too.
+        data[n] = ((seed >> 8) / (double)(1 << 24) - 0.5) * 2.4;
+    }
+}
+
+static void test_interleave(void **state) {
+    static const int sizes[] = {1, 2, 3, 4, 8};
+    for (int ch = 1; ch <= 8; ch++) {
+        for (int i = 0; i < MP_ARRAY_SIZE(sizes); i++) {
+            int bytes = sizes[i];
+            size_t plane_size = SAMPLES * bytes;
+            uint8_t *planes = malloc(plane_size * ch);
+            uint8_t *packed = malloc(plane_size * ch);
+            uint8_t *planes2 = calloc(ch, plane_size);
+            void *src[8], *dst[8];
+            for (int c = 0; c < ch; c++) {
+                src[c] = planes + c * plane_size;
+                dst[c] = planes2 + c * plane_size;
+            }
+            fill_pattern(planes, plane_size * ch, ch * 10 + bytes);
+
+            mp_interleave(packed, src, ch, SAMPLES, bytes);
+            for (int n = 0; n < SAMPLES; n++) {
+                for (int c = 0; c < ch; c++) {
+                    uint8_t *a = packed + (n * ch + c) * bytes;
+                    uint8_t *b = (uint8_t *)src[c] + n * bytes;
+                    assert_memory_equal(a, b, bytes);
+                }
+            }
+
+            mp_deinterleave(dst, packed, ch, SAMPLES, bytes);
+            assert_memory_equal(planes, planes2, plane_size * ch);
+
+            free(planes);
+            free(packed);
+            free(planes2);
+        }
+    }
+}
+
+static void test_s16_float(void **state) {
+    int num = 1 << 16;
+    int16_t *in = malloc(num * sizeof(in[0]));
+    int16_t *out = malloc(num * sizeof(out[0]));
+    float *f = malloc(num * sizeof(f[0]));
+    for (int n = 0; n < num; n++)
+        in[n] = n - (1 << 15);
+
+    mp_s16_to_float(f, in, num);
+    for (int n = 0; n < num; n++)
+        assert_true(f[n] == in[n] / 32768.0f);
+
+    mp_float_to_s16(out, f, num);
+    assert_memory_equal(in, out, num * sizeof(in[0]));
+
+    float clip[] = {1.0f, 2.0f, -1.0f, -2.0f, 0.5f / 32768, -0.5f / 32768};
+    int16_t expect[] = {INT16_MAX, INT16_MAX, INT16_MIN, INT16_MIN, 0, 0};
+    mp_float_to_s16(out, clip, MP_ARRAY_SIZE(clip));
+    assert_memory_equal(out, expect, sizeof(expect));
+
+    free(in);
+    free(out);
+    free(f);
+}
+
+static void test_s32_to_s24(void **state) {
+    uint32_t in[SAMPLES], data[SAMPLES];
+    fill_pattern((uint8_t *)in, sizeof(in), 1);
+
+    for (int pad = 0; pad < 2; pad++) {
+        int bytes = pad ? 4 : 3;
+        memcpy(data, in, sizeof(in));
+        mp_s32_to_s24(data, SAMPLES, pad);
+        for (int n = 0; n < SAMPLES; n++) {
+            uint8_t *ptr = (uint8_t *)data + n * bytes;
+            uint32_t v = 0;
+            for (int b = 0; b < 3; b++) {
+#if BYTE_ORDER == BIG_ENDIAN
+                v = (v << 8) | ptr[b];
+#else
+                v |= (uint32_t)ptr[b] << (b * 8);
+#endif
+            }
+            assert_int_equal(v, in[n] >> 8);
+            if (pad)
+                assert_int_equal(ptr[3], 0);
+        }
+    }
+}
+
+#if !HAVE_LIBAV
+static const int test_formats[] = {
+    AF_FORMAT_S16, AF_FORMAT_S16P, AF_FORMAT_FLOAT, AF_FORMAT_FLOATP,
+};
+
+static void alloc_planes(void **planes, uint8_t **buf, int format, int ch) {
+    int num_planes = af_fmt_is_planar(format) ? ch : 1;
+    size_t size = (size_t)SAMPLES * ch * af_fmt_to_bytes(format);
+    *buf = calloc(1, size);
+    for (int n = 0; n < num_planes; n++)
+        planes[n] = *buf + n * (size / num_planes);
+}
+
+// Compare mp_sample_convert() against libswresample, which f_swresample uses
+// for all conversions that can't be done directly.
+static void test_convert_vs_swr(void **state) {
+    static const int channels[] = {1, 2, 6, 8};
+    for (int c = 0; c < MP_ARRAY_SIZE(channels); c++) {
+        int ch = channels[c];
+        int64_t layout = av_get_default_channel_layout(ch);
+        for (int i = 0; i < MP_ARRAY_SIZE(test_formats); i++) {
+            for (int o = 0; o < MP_ARRAY_SIZE(test_formats); o++) {
+                int in_fmt = test_formats[i];
+                int out_fmt = test_formats[o];
+                assert_true(mp_sample_conv_supported(in_fmt, out_fmt));
+
+                void *in[8], *out[8], *ref[8];
+                uint8_t *in_buf, *out_buf, *ref_buf;
+                alloc_planes(in, &in_buf, in_fmt, ch);
+                alloc_planes(out, &out_buf, out_fmt, ch);
+                alloc_planes(ref, &ref_buf, out_fmt, ch);
+                size_t in_size = (size_t)SAMPLES * ch * af_fmt_to_bytes(in_fmt);
+                if (af_fmt_from_planar(in_fmt) == AF_FORMAT_FLOAT) {
+                    fill_float((float *)in_buf, SAMPLES * ch, i + o);
+                } else {
+                    fill_pattern(in_buf, in_size, i + o);
+                }
+
+                mp_sample_convert(out, out_fmt, in, in_fmt, ch, SAMPLES);
+
+                struct SwrContext *swr = swr_alloc_set_opts(NULL,
+                    layout, af_to_avformat(out_fmt), 48000,
+                    layout, af_to_avformat(in_fmt), 48000, 0, NULL);
+                assert_true(swr && swr_init(swr) >= 0);
+                int got = swr_convert(swr, (uint8_t **)ref, SAMPLES,
+                                      (const uint8_t **)in, SAMPLES);
+                assert_int_equal(got, SAMPLES);
+                swr_free(&swr);
+
+                int num = SAMPLES * ch;
+                if (af_fmt_from_planar(out_fmt) == AF_FORMAT_FLOAT) {
+                    for (int n = 0; n < num; n++) {
+                        assert_float_equal(((float *)out_buf)[n],
+                                           ((float *)ref_buf)[n]);
+                    }
+                } else {
+                    for (int n = 0; n < num; n++) {
+                        int d = ((int16_t *)out_buf)[n] - ((int16_t *)ref_buf)[n];
+                        assert_true(abs(d) <= 1);
+                    }
+                }
+
+                free(in_buf);
+                free(out_buf);
+                free(ref_buf);
+            }
+        }
+    }
+}
+#endif
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_interleave),
+        cmocka_unit_test(test_s16_float),
+        cmocka_unit_test(test_s32_to_s24),
+#if !HAVE_LIBAV
+        cmocka_unit_test(test_convert_vs_swr),
+#endif
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,158 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_helpers.h"
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "common/msg_control.h"
+#include "demux/packet.h"
+#include "demux/stheader.h"
+#include "options/m_config.h"
+#include "options/options.h"
+#include "osdep/timer.h"
+#include "sub/sd.h"
+
+extern const struct sd_functions sd_ass;
+
+struct setup {
+    struct mpv_global *global;
+    struct m_config *config;
+    struct mp_codec_params codec;
+    struct sd *sd;
+};
+
+static struct sd *create_sd(struct setup *s) {
+    s->global = talloc_zero(NULL, struct mpv_global);
+    mp_msg_init(s->global);
+    s->config = m_config_new(s->global, s->global->log, sizeof(struct MPOpts),
+                             &mp_default_opts, mp_opts);
+    s->config->global = s->global;
+    m_config_create_shadow(s->config);
+    s->global->opts = s->config->optstruct;
+
+    s->codec = (struct mp_codec_params){.type = STREAM_SUB, .codec = "subrip"};
+    struct sd *sd = talloc_zero(s->global, struct sd);
+    *sd = (struct sd){
+        .global = s->global,
+        .log = mp_log_new(sd, s->global->log, "sd"),
+        .opts = mp_get_config_group(sd, s->global, &mp_subtitle_sub_opts),
+        .driver = &sd_ass,
+        .codec = &s->codec,
+        .preload_ok = true,
+    };
+    assert_int_equal(sd->driver->init(sd), 0);
+    s->sd = sd;
+    return sd;
+}
+
+static void destroy_sd(struct setup *s) {
+    s->sd->driver->uninit(s->sd);
+    mp_msg_uninit(s->global);
+    talloc_free(s->global);
+}
+
+// Event n is shown from n * 2 seconds on, for 1.5 seconds (or until the next
+// event if the duration is unknown).
+static void feed(struct sd *sd, int first, int num, bool unknown_duration) {
+    for (int n = first; n < first + num; n++) {
+        char text[30];
+        snprintf(text, sizeof(text), "Line %d", n);
+        struct demux_packet *pkt = new_demux_packet_from(text, strlen(text));
+        assert_true(pkt);
+        pkt->pts = n * 2.0;
+        pkt->duration = unknown_duration ? -1 : 1.5;
+        pkt->pos = n * 100;
+        sd->driver->decode(sd, pkt);
+        talloc_free(pkt);
+    }
+}
+
+static void check_text(struct sd *sd, double pts, const char *expect) {
+    char *text = sd->driver->get_text(sd, pts);
+    assert_string_equal(text ? text : "", expect);
+}
+
+static void test_seen_packets(void **state) {
+    struct setup s;
+    struct sd *sd = create_sd(&s);
+    feed(sd, 0, 2000, false);
+    // Packets that were already decoded must not add events again.
+    feed(sd, 1000, 1000, false);
+    feed(sd, 0, 2000, false);
+    check_text(sd, 0.5, "Line 0");
+    check_text(sd, 1001 * 2 + 1.0, "Line 1001");
+    check_text(sd, 1999 * 2 + 1.0, "Line 1999");
+    check_text(sd, 1999 * 2 + 1.8, "");
+    destroy_sd(&s);
+}
+
+static void test_unknown_duration(void **state) {
+    struct setup s;
+    struct sd *sd = create_sd(&s);
+    feed(sd, 0, 1000, true);
+    for (int n = 0; n < 999; n++) {
+        check_text(sd, n * 2.0 + 1.9, mp_tprintf(30, "Line %d", n));
+        check_text(sd, n * 2.0 + 2.0, mp_tprintf(30, "Line %d", n + 1));
+    }
+    // The last event lasts until another one is added.
+    check_text(sd, 999 * 2.0 + 100, "Line 999");
+    feed(sd, 1000, 1, true);
+    check_text(sd, 999 * 2.0 + 1.9, "Line 999");
+    check_text(sd, 1000 * 2.0, "Line 1000");
+    destroy_sd(&s);
+}
+
+static int64_t memory_usage(struct sd *sd) {
+    int64_t size = 0;
+    assert_int_equal(sd->driver->control(sd, SD_CTRL_GET_MEMORY_USAGE, &size),
+                     CONTROL_OK);
+    return size;
+}
+
+static void test_prune(void **state) {
+    struct setup s;
+    struct sd *sd = create_sd(&s);
+    feed(sd, 0, 1000, false);
+    int64_t size = memory_usage(sd);
+    double pts = 1000.0;
+    sd->driver->control(sd, SD_CTRL_PRUNE_EVENTS, &pts);
+    check_text(sd, 0.5, "");
+    check_text(sd, 499 * 2 + 1.0, "");
+    check_text(sd, 500 * 2 + 1.0, "Line 500");
+    assert_true(memory_usage(sd) < size);
+    // Pruned packets are decoded again if they are read again, the others
+    // are still recognized as duplicates.
+    feed(sd, 0, 1000, false);
+    check_text(sd, 0.5, "Line 0");
+    check_text(sd, 500 * 2 + 1.0, "Line 500");
+    check_text(sd, 999 * 2 + 1.0, "Line 999");
+    destroy_sd(&s);
+}
+
+// Set MPV_SD_ASS_BENCHMARK to time decoding of 100000 packets.
+static void test_benchmark(void **state) {
+    if (!getenv("MPV_SD_ASS_BENCHMARK"))
+        return;
+    int num = 100000;
+    for (int unknown = 0; unknown < 2; unknown++) {
+        struct setup s;
+        struct sd *sd = create_sd(&s);
+        int64_t start = mp_time_us();
+        feed(sd, 0, num, unknown);
+        double secs = (mp_time_us() - start) / 1e6;
+        printf("%d packets, %s duration: %.3f s (%.1f us/packet)\n", num,
+               unknown ? "unknown" : "known", secs, secs / num * 1e6);
+        destroy_sd(&s);
+    }
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_seen_packets),
+        cmocka_unit_test(test_unknown_duration),
+        cmocka_unit_test(test_prune),
+        cmocka_unit_test(test_benchmark),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <libswscale/swscale.h>
+
+#include "test_helpers.h"
+#include "common/common.h"
+#include "osdep/timer.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "video/sws_utils.h"
+
+static void fill_image(struct mp_image *img) {
+    unsigned seed = img->imgfmt;
+    for (int p = 0; p < img->num_planes; p++) {
+        int h = mp_image_plane_h(img, p);
+        int bytes = mp_image_plane_w(img, p) * img->fmt.bpp[p] / 8;
+        for (int y = 0; y < h; y++) {
+            uint8_t *line = img->planes[p] + y * img->stride[p];
+            for (int x = 0; x < bytes; x++) {
+                seed = seed * 1103515245 + 12345;
+                line[x] = seed >> 16;
+            }
+        }
+    }
+}
+
+static bool images_equal(struct mp_image *a, struct mp_image *b) {
+    for (int p = 0; p < a->num_planes; p++) {
+        int h = mp_image_plane_h(a, p);
+        int bytes = mp_image_plane_w(a, p) * a->fmt.bpp[p] / 8;
+        for (int y = 0; y < h; y++) {
+            if (memcmp(a->planes[p] + y * a->stride[p],
+                       b->planes[p] + y * b->stride[p], bytes))
+                return false;
+        }
+    }
+    return true;
+}
+
+static const struct {
+    int src_fmt, dst_fmt;
+    int src_w, dst_w;
+} conversions[] = {
+    {IMGFMT_420P, IMGFMT_BGR0, 1920, 1920},
+    {IMGFMT_P010, IMGFMT_420P, 1920, 1920},
+    {IMGFMT_420P, IMGFMT_BGR0, 1280, 1920}, // horizontal scaling
+    {IMGFMT_BGR0, IMGFMT_420P, 1920, 1920},
+};
+
+static void convert(int src_fmt, int dst_fmt, int src_w, int dst_w,
+                    int threads, int frames, double *fps, struct mp_image **out)
+{
+    int h = 1080;
+    struct mp_image *src = mp_image_alloc(src_fmt, src_w, h);
+    struct mp_image *dst = mp_image_alloc(dst_fmt, dst_w, h);
+    assert_true(src && dst);
+    fill_image(src);
+
+    struct mp_sws_context *sws = mp_sws_alloc(NULL);
+    sws->flags = SWS_BICUBIC;
+    sws->threads = threads;
+    // Initialize outside of the timed loop.
+    assert_true(mp_sws_scale(sws, dst, src) >= 0);
+
+    int64_t start = mp_time_us();
+    for (int n = 0; n < frames; n++)
+        assert_true(mp_sws_scale(sws, dst, src) >= 0);
+    double secs = (mp_time_us() - start) / 1e6;
+    if (fps)
+        *fps = secs > 0 ? frames / secs : 0;
+
+    talloc_free(sws);
+    talloc_free(src);
+    *out = dst;
+}
+
+// Sliced conversion must produce exactly the same output.
+static void test_slices_equal(void **state) {
+    for (int n = 0; n < MP_ARRAY_SIZE(conversions); n++) {
+        struct mp_image *ref, *img;
+        convert(conversions[n].src_fmt, conversions[n].dst_fmt,
+                conversions[n].src_w, conversions[n].dst_w, 1, 1, NULL, &ref);
+        for (int threads = 2; threads <= 8; threads *= 2) {
+            convert(conversions[n].src_fmt, conversions[n].dst_fmt,
+                    conversions[n].src_w, conversions[n].dst_w, threads, 1,
+                    NULL, &img);
+            assert_true(images_equal(ref, img));
+            talloc_free(img);
+        }
+        talloc_free(ref);
+    }
+}
+
+// Set MPV_SWS_BENCHMARK to print frames per second against thread count.
+static void test_benchmark(void **state) {
+    if (!getenv("MPV_SWS_BENCHMARK"))
+        return;
+    for (int n = 0; n < MP_ARRAY_SIZE(conversions); n++) {
+        printf("%s %dx1080 -> %s %dx1080:\n",
+               mp_imgfmt_to_name(conversions[n].src_fmt), conversions[n].src_w,
+               mp_imgfmt_to_name(conversions[n].dst_fmt), conversions[n].dst_w);
+        for (int threads = 1; threads <= 16; threads *= 2) {
+            struct mp_image *img;
+            double fps;
+            convert(conversions[n].src_fmt, conversions[n].dst_fmt,
+                    conversions[n].src_w, conversions[n].dst_w, threads, 100,
+                    &fps, &img);
+            printf("  %2d threads: %8.1f fps\n", threads, fps);
+            talloc_free(img);
+        }
+    }
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_slices_equal),
+        cmocka_unit_test(test_benchmark),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
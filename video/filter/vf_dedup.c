@@ -0,0 +1,219 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "common/tags.h"
+#include "filters/filter.h"
+#include "filters/filter_internal.h"
+#include "filters/user_filters.h"
+#include "options/m_option.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+
+struct vf_dedup_opts {
+    int threshold;
+    double max_hold;
+};
+
+struct priv {
+    struct vf_dedup_opts *opts;
+    struct mp_image *ref;       // last frame passed on
+    struct mp_image *held;      // last dropped duplicate of ref
+    int64_t passed, dropped;
+};
+
+#define BLOCK 16
+
+// Sum of absolute differences of two w*h byte blocks (w <= BLOCK). Written so
+// that the compiler can vectorize the inner loop.
+static unsigned block_sad(const uint8_t *a, ptrdiff_t a_stride,
+                          const uint8_t *b, ptrdiff_t b_stride, int w, int h)
+{
+    unsigned sad = 0;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++)
+            sad += abs(a[x] - b[x]);
+        a += a_stride;
+        b += b_stride;
+    }
+    return sad;
+}
+
+// Return whether any BLOCK x BLOCK area of the two images differs by more than
+// threshold on average (or at all, if threshold is 0).
+static bool images_differ(struct mp_image *a, struct mp_image *b, int threshold)
+{
+    if (!mp_image_params_equal(&a->params, &b->params))
+        return true;
+    // The average difference of bytes is meaningless for >8 bit components.
+    if (a->fmt.component_bits > 8)
+        threshold = 0;
+    for (int p = 0; p < a->num_planes; p++) {
+        int w = mp_image_plane_w(a, p) * a->fmt.bpp[p] / 8;
+        int h = mp_image_plane_h(a, p);
+        if (a->planes[p] == b->planes[p] && a->stride[p] == b->stride[p])
+            continue;
+        for (int y = 0; y < h; y += BLOCK) {
+            int bh = MPMIN(BLOCK, h - y);
+            uint8_t *pa = a->planes[p] + y * a->stride[p];
+            uint8_t *pb = b->planes[p] + y * b->stride[p];
+            if (!threshold) {
+                for (int n = 0; n < bh; n++) {
+                    if (memcmp(pa + n * a->stride[p], pb + n * b->stride[p], w))
+                        return true;
+                }
+                continue;
+            }
+            for (int x = 0; x < w; x += BLOCK) {
+                int bw = MPMIN(BLOCK, w - x);
+                if (block_sad(pa + x, a->stride[p], pb + x, b->stride[p],
+                              bw, bh) > (unsigned)(threshold * bw * bh))
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+static bool is_duplicate(struct priv *p, struct mp_image *img)
+{
+    struct mp_image *ref = p->ref;
+    if (!ref || img->pts == MP_NOPTS_VALUE || ref->pts == MP_NOPTS_VALUE ||
+        img->pts <= ref->pts || IMGFMT_IS_HWACCEL(img->imgfmt))
+        return false;
+    if (p->opts->max_hold > 0 && img->pts - ref->pts >= p->opts->max_hold)
+        return false;
+    return !images_differ(img, ref, p->opts->threshold);
+}
+
+static void vf_dedup_process(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    if (!mp_pin_can_transfer_data(f->ppins[1], f->ppins[0]))
+        return;
+
+    struct mp_frame frame = mp_pin_out_read(f->ppins[0]);
+
+    if (frame.type == MP_FRAME_EOF && p->held) {
+        // Send the last duplicate, so that the frame before it is displayed
+        // for the full duration up to EOF.
+        mp_pin_out_repeat_eof(f->ppins[0]);
+        mp_pin_in_write(f->ppins[1], MAKE_FRAME(MP_FRAME_VIDEO, p->held));
+        p->held = NULL;
+        return;
+    }
+
+    if (frame.type != MP_FRAME_VIDEO) {
+        if (frame.type == MP_FRAME_EOF)
+            mp_image_unrefp(&p->ref);
+        mp_pin_in_write(f->ppins[1], frame);
+        return;
+    }
+
+    struct mp_image *img = frame.data;
+
+    if (is_duplicate(p, img)) {
+        mp_image_unrefp(&p->held);
+        p->held = img;
+        p->dropped++;
+        mp_filter_internal_mark_progress(f);
+        return;
+    }
+
+    mp_image_unrefp(&p->held);
+    mp_image_unrefp(&p->ref);
+    p->ref = mp_image_new_ref(img);
+    p->passed++;
+    mp_pin_in_write(f->ppins[1], frame);
+}
+
+static void vf_dedup_reset(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    mp_image_unrefp(&p->ref);
+    mp_image_unrefp(&p->held);
+}
+
+static bool vf_dedup_command(struct mp_filter *f, struct mp_filter_command *cmd)
+{
+    struct priv *p = f->priv;
+
+    if (cmd->type != MP_FILTER_COMMAND_GET_META)
+        return false;
+
+    struct mp_tags *tags = talloc_zero(NULL, struct mp_tags);
+    mp_tags_set_str(tags, "passed", mp_tprintf(30, "%"PRId64, p->passed));
+    mp_tags_set_str(tags, "dropped", mp_tprintf(30, "%"PRId64, p->dropped));
+    *(struct mp_tags **)cmd->res = tags;
+    return true;
+}
+
+static void vf_dedup_destroy(struct mp_filter *f)
+{
+    vf_dedup_reset(f);
+}
+
+static const struct mp_filter_info vf_dedup_filter = {
+    .name = "dedup",
+    .process = vf_dedup_process,
+    .reset = vf_dedup_reset,
+    .command = vf_dedup_command,
+    .destroy = vf_dedup_destroy,
+    .priv_size = sizeof(struct priv),
+};
+
+static struct mp_filter *vf_dedup_create(struct mp_filter *parent,
+                                         void *options)
+{
+    struct mp_filter *f = mp_filter_create(parent, &vf_dedup_filter);
+    if (!f) {
+        talloc_free(options);
+        return NULL;
+    }
+
+    mp_filter_add_pin(f, MP_PIN_IN, "in");
+    mp_filter_add_pin(f, MP_PIN_OUT, "out");
+
+    struct priv *p = f->priv;
+    p->opts = talloc_steal(p, options);
+
+    return f;
+}
+
+#define OPT_BASE_STRUCT struct vf_dedup_opts
+static const m_option_t vf_opts_fields[] = {
+    OPT_INTRANGE("threshold", threshold, 0, 0, 255),
+    OPT_DOUBLE("max-hold", max_hold, M_OPT_MIN, .min = 0),
+    {0}
+};
+
+const struct mp_user_filter_entry vf_dedup = {
+    .desc = {
+        .description = "Drop duplicate frames",
+        .name = "dedup",
+        .priv_size = sizeof(OPT_BASE_STRUCT),
+        .options = vf_opts_fields,
+    },
+    .create = vf_dedup_create,
+};
@@ -19,8 +19,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <setjmp.h>
+#include <pthread.h>
 
 #include <libavcodec/avcodec.h>
+#include <libavutil/cpu.h>
 #include <libavutil/mem.h>
 #include <libavutil/opt.h>
 
@@ -34,6 +36,10 @@
 
 #include "image_writer.h"
 #include "mpv_talloc.h"
+#include "common/msg.h"
+#include "misc/thread_pool.h"
+#include "options/m_config.h"
+#include "osdep/timer.h"
 #include "video/img_format.h"
 #include "video/mp_image.h"
 #include "video/fmt-conversion.h"
@@ -383,3 +389,217 @@ void dump_png(struct mp_image *image, const char *filename, struct mp_log *log)
     opts.format = AV_CODEC_ID_PNG;
     write_image(image, &opts, filename, log);
 }
+
+struct image_writer_queue_opts {
+    int threads;
+    int queue_size;
+    int drop;
+};
+
+#undef OPT_BASE_STRUCT
+#define OPT_BASE_STRUCT struct image_writer_queue_opts
+
+const struct m_sub_options image_writer_queue_conf = {
+    .opts = (const struct m_option[]) {
+        OPT_INTRANGE("image-writer-threads", threads, 0, 0, 64),
+        OPT_INTRANGE("image-writer-queue-size", queue_size, 0, 0, 1000),
+        OPT_FLAG("image-writer-drop", drop, 0),
+        {0}
+    },
+    .size = sizeof(struct image_writer_queue_opts),
+};
+
+struct image_writer_queue {
+    struct mpv_global *global;
+    struct mp_log *log;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+
+    // --- The following fields are protected by lock
+    bool initialized;
+    struct mp_thread_pool *pool;
+    int max_queued;
+    bool drop;
+    int queued;     // frames not encoded yet (limited by max_queued)
+    int pending;    // frames whose done callback has not returned yet
+    int64_t written, failed, dropped;
+    int64_t fps_start, fps_frames;
+    double fps;
+};
+
+struct queue_item {
+    struct image_writer_queue *q;
+    struct mp_image *image;
+    struct image_writer_opts opts;
+    char *filename;
+    image_writer_done_cb done;
+    void *done_ctx;
+};
+
+static void queue_destroy(void *ptr)
+{
+    struct image_writer_queue *q = ptr;
+
+    // Blocks until all queued frames are written.
+    talloc_free(q->pool);
+
+    assert(!q->pending);
+    pthread_cond_destroy(&q->wakeup);
+    pthread_mutex_destroy(&q->lock);
+}
+
+// Create a queue for writing images with a pool of worker threads. The threads
+// are started on first use, using the --image-writer-* options at that time.
+struct image_writer_queue *image_writer_queue_create(void *ta_parent,
+                                                     struct mpv_global *global,
+                                                     struct mp_log *log)
+{
+    struct image_writer_queue *q = talloc_zero(ta_parent, struct image_writer_queue);
+    talloc_set_destructor(q, queue_destroy);
+    q->global = global;
+    q->log = mp_log_new(q, log, "image-writer");
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->wakeup, NULL);
+    return q;
+}
+
+// Must be called with q->lock held.
+static void queue_init(struct image_writer_queue *q)
+{
+    struct image_writer_queue_opts *opts =
+        mp_get_config_group(NULL, q->global, &image_writer_queue_conf);
+
+    int threads = opts->threads;
+    if (!threads)
+        threads = MPCLAMP(av_cpu_count(), 1, 16);
+    q->max_queued = opts->queue_size ? opts->queue_size : threads * 2;
+    q->drop = opts->drop;
+    talloc_free(opts);
+
+    q->pool = mp_thread_pool_create(q, threads);
+    if (!q->pool)
+        MP_ERR(q, "Could not create worker threads, writing synchronously.\n");
+    MP_VERBOSE(q, "Using %d threads, at most %d frames in flight.\n",
+               q->pool ? threads : 0, q->max_queued);
+    q->initialized = true;
+}
+
+static void queue_worker(void *arg)
+{
+    struct queue_item *item = arg;
+    struct image_writer_queue *q = item->q;
+
+    bool ok = write_image(item->image, &item->opts, item->filename, q->log);
+
+    pthread_mutex_lock(&q->lock);
+    q->queued -= 1;
+    if (ok) {
+        q->written += 1;
+    } else {
+        q->failed += 1;
+    }
+    int64_t now = mp_time_us();
+    q->fps_frames += 1;
+    if (now - q->fps_start >= 1000000) {
+        q->fps = q->fps_frames * 1e6 / (now - q->fps_start);
+        q->fps_start = now;
+        q->fps_frames = 0;
+    }
+    pthread_cond_broadcast(&q->wakeup);
+    pthread_mutex_unlock(&q->lock);
+
+    // Call it outside of the queued frame accounting, so that a thread blocked
+    // in image_writer_queue_add() can continue as soon as encoding finished.
+    if (item->done)
+        item->done(item->done_ctx, ok);
+
+    pthread_mutex_lock(&q->lock);
+    q->pending -= 1;
+    pthread_cond_broadcast(&q->wakeup);
+    pthread_mutex_unlock(&q->lock);
+
+    talloc_free(item);
+}
+
+// Queue the image to be converted and written to filename by a worker thread.
+// A new reference to image is taken. done(done_ctx, success) is called on the
+// worker thread once writing has finished (done can be NULL). done must not
+// wait for a thread that could be blocked in image_writer_queue_add() or
+// image_writer_queue_flush(), since all workers could end up waiting.
+// If the maximum number of frames is in flight, this blocks until a worker has
+// finished encoding one. With --image-writer-drop, the frame is dropped
+// instead. If the frame is dropped (or on OOM), false is returned, and done is
+// not called.
+bool image_writer_queue_add(struct image_writer_queue *q, struct mp_image *image,
+                            const struct image_writer_opts *opts,
+                            const char *filename,
+                            image_writer_done_cb done, void *done_ctx)
+{
+    struct queue_item *item = talloc_ptrtype(NULL, item);
+    *item = (struct queue_item){
+        .q = q,
+        .image = talloc_steal(item, mp_image_new_ref(image)),
+        .opts = opts ? *opts : image_writer_opts_defaults,
+        .filename = talloc_strdup(item, filename),
+        .done = done,
+        .done_ctx = done_ctx,
+    };
+
+    if (!item->image) {
+        talloc_free(item);
+        return false;
+    }
+
+    pthread_mutex_lock(&q->lock);
+    if (!q->initialized)
+        queue_init(q);
+    while (q->pool && q->queued >= q->max_queued) {
+        if (q->drop) {
+            q->dropped += 1;
+            pthread_mutex_unlock(&q->lock);
+            talloc_free(item);
+            return false;
+        }
+        pthread_cond_wait(&q->wakeup, &q->lock);
+    }
+    if (!q->pending) {
+        q->fps_start = mp_time_us();
+        q->fps_frames = 0;
+    }
+    q->queued += 1;
+    q->pending += 1;
+    struct mp_thread_pool *pool = q->pool;
+    pthread_mutex_unlock(&q->lock);
+
+    if (pool) {
+        mp_thread_pool_queue(pool, queue_worker, item);
+    } else {
+        queue_worker(item);
+    }
+    return true;
+}
+
+// Wait until all queued frames have been written, and their done callbacks
+// have returned.
+void image_writer_queue_flush(struct image_writer_queue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->pending)
+        pthread_cond_wait(&q->wakeup, &q->lock);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void image_writer_queue_get_stats(struct image_writer_queue *q,
+                                  struct image_writer_queue_stats *st)
+{
+    pthread_mutex_lock(&q->lock);
+    *st = (struct image_writer_queue_stats){
+        .written = q->written,
+        .failed = q->failed,
+        .dropped = q->dropped,
+        .queued = q->queued,
+        .fps = q->pending ? q->fps : 0,
+    };
+    pthread_mutex_unlock(&q->lock);
+}
@@ -19,6 +19,7 @@
 
 struct mp_image;
 struct mp_log;
+struct mpv_global;
 
 struct image_writer_opts {
     int format;
@@ -69,3 +70,28 @@ struct mp_image *convert_image(struct mp_image *image, int destfmt,
 
 // Debugging helper.
 void dump_png(struct mp_image *image, const char *filename, struct mp_log *log);
+
+extern const struct m_sub_options image_writer_queue_conf;
+
+struct image_writer_queue;
+
+struct image_writer_queue_stats {
+    int64_t written;    // frames written successfully
+    int64_t failed;     // frames that could not be converted or written
+    int64_t dropped;    // frames rejected because the queue was full
+    int queued;         // frames waiting for or being encoded
+    double fps;         // encoded frames per second (0 if idle)
+};
+
+typedef void (*image_writer_done_cb)(void *ctx, bool success);
+
+struct image_writer_queue *image_writer_queue_create(void *ta_parent,
+                                                     struct mpv_global *global,
+                                                     struct mp_log *log);
+bool image_writer_queue_add(struct image_writer_queue *q, struct mp_image *image,
+                            const struct image_writer_opts *opts,
+                            const char *filename,
+                            image_writer_done_cb done, void *done_ctx);
+void image_writer_queue_flush(struct image_writer_queue *q);
+void image_writer_queue_get_stats(struct image_writer_queue *q,
+                                  struct image_writer_queue_stats *st);
@@ -29,22 +29,28 @@
 #include "mpv_talloc.h"
 
 #include "common/common.h"
+#include "osdep/atomic.h"
 
 #include "fmt-conversion.h"
 #include "mp_image.h"
 #include "mp_image_pool.h"
 
-static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
-#define pool_lock() pthread_mutex_lock(&pool_mutex)
-#define pool_unlock() pthread_mutex_unlock(&pool_mutex)
-
 // Thread-safety: the pool itself is not thread-safe, but pool-allocated images
 // can be referenced and unreferenced from other threads. (As long as the image
-// destructors are thread-safe.)
+// destructors are thread-safe.) The state shared between these threads is in
+// image_flags.state, which is accessed with atomics only.
 
-struct mp_image_pool {
+// Images with the same format and size. Only these are scanned when looking
+// for a free image.
+struct pool_bucket {
+    int fmt, w, h;
     struct mp_image **images;
     int num_images;
+};
+
+struct mp_image_pool {
+    struct pool_bucket *buckets;
+    int num_buckets;
 
     int fmt, w, h;
 
@@ -53,21 +59,55 @@ struct mp_image_pool {
 
     bool use_lru;
     unsigned int lru_counter;
+
+    // Cached result of mp_image_hw_download_get_sw_format().
+    AVBufferRef *dl_frames_ctx;
+    int dl_imgfmt;
+
+    struct mp_image_pool_stats stats;
+};
+
+// Bits for image_flags.state.
+enum {
+    IMAGE_REFERENCED    = 1 << 0,   // outside mp_image reference exists
+    IMAGE_POOL_ALIVE    = 1 << 1,   // the mp_image_pool references this
 };
 
 // Used to gracefully handle the case when the pool is freed while image
 // references allocated from the image pool are still held by someone.
 struct image_flags {
-    // If both of these are false, the image must be freed.
-    bool referenced;            // outside mp_image reference exists
-    bool pool_alive;            // the mp_image_pool references this
+    // If both bits are cleared, the image must be freed. Whoever clears the
+    // last bit does this.
+    atomic_int state;
     unsigned int order;         // for LRU allocation (basically a timestamp)
+    bool used;                  // was returned by the pool before
+    int64_t size;               // for statistics
 };
 
+// Sums of the statistics of all pools, see mp_image_pool_get_total_stats().
+static atomic_ullong total_hits;
+static atomic_ullong total_misses;
+static atomic_llong total_images;
+static atomic_llong total_bytes;
+
+static void add_stats(struct mp_image_pool *pool, int hits, int misses,
+                      int images, int64_t bytes)
+{
+    pool->stats.hits += hits;
+    pool->stats.misses += misses;
+    pool->stats.num_images += images;
+    pool->stats.bytes += bytes;
+    atomic_fetch_add(&total_hits, hits);
+    atomic_fetch_add(&total_misses, misses);
+    atomic_fetch_add(&total_images, images);
+    atomic_fetch_add(&total_bytes, bytes);
+}
+
 static void image_pool_destructor(void *ptr)
 {
     struct mp_image_pool *pool = ptr;
     mp_image_pool_clear(pool);
+    av_buffer_unref(&pool->dl_frames_ctx);
 }
 
 // If tparent!=NULL, set it as talloc parent for the pool.
@@ -81,19 +121,21 @@ struct mp_image_pool *mp_image_pool_new(void *tparent)
 
 void mp_image_pool_clear(struct mp_image_pool *pool)
 {
-    for (int n = 0; n < pool->num_images; n++) {
-        struct mp_image *img = pool->images[n];
-        struct image_flags *it = img->priv;
-        bool referenced;
-        pool_lock();
-        assert(it->pool_alive);
-        it->pool_alive = false;
-        referenced = it->referenced;
-        pool_unlock();
-        if (!referenced)
-            talloc_free(img);
+    for (int b = 0; b < pool->num_buckets; b++) {
+        struct pool_bucket *bucket = &pool->buckets[b];
+        for (int n = 0; n < bucket->num_images; n++) {
+            struct mp_image *img = bucket->images[n];
+            struct image_flags *it = img->priv;
+            add_stats(pool, 0, 0, -1, -it->size);
+            int prev = atomic_fetch_and(&it->state, ~IMAGE_POOL_ALIVE);
+            assert(prev & IMAGE_POOL_ALIVE);
+            if (!(prev & IMAGE_REFERENCED))
+                talloc_free(img);
+        }
+        talloc_free(bucket->images);
     }
-    pool->num_images = 0;
+    TA_FREEP(&pool->buckets);
+    pool->num_buckets = 0;
 }
 
 // This is the only function that is allowed to run in a different thread.
@@ -102,41 +144,49 @@ static void unref_image(void *opaque, uint8_t *data)
 {
     struct mp_image *img = opaque;
     struct image_flags *it = img->priv;
-    bool alive;
-    pool_lock();
-    assert(it->referenced);
-    it->referenced = false;
-    alive = it->pool_alive;
-    pool_unlock();
-    if (!alive)
+    int prev = atomic_fetch_and(&it->state, ~IMAGE_REFERENCED);
+    assert(prev & IMAGE_REFERENCED);
+    if (!(prev & IMAGE_POOL_ALIVE))
         talloc_free(img);
 }
 
+static struct pool_bucket *find_bucket(struct mp_image_pool *pool, int fmt,
+                                       int w, int h)
+{
+    for (int n = 0; n < pool->num_buckets; n++) {
+        struct pool_bucket *bucket = &pool->buckets[n];
+        if (bucket->fmt == fmt && bucket->w == w && bucket->h == h)
+            return bucket;
+    }
+    return NULL;
+}
+
 // Return a new image of given format/size. Unlike mp_image_pool_get(), this
 // returns NULL if there is no free image of this format/size.
 struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
                                             int w, int h)
 {
+    struct pool_bucket *bucket = find_bucket(pool, fmt, w, h);
+    if (!bucket)
+        return NULL;
+
     struct mp_image *new = NULL;
-    pool_lock();
-    for (int n = 0; n < pool->num_images; n++) {
-        struct mp_image *img = pool->images[n];
+    for (int n = 0; n < bucket->num_images; n++) {
+        struct mp_image *img = bucket->images[n];
         struct image_flags *img_it = img->priv;
-        assert(img_it->pool_alive);
-        if (!img_it->referenced) {
-            if (img->imgfmt == fmt && img->w == w && img->h == h) {
-                if (pool->use_lru) {
-                    struct image_flags *new_it = new ? new->priv : NULL;
-                    if (!new_it || new_it->order > img_it->order)
-                        new = img;
-                } else {
+        // Only this thread can set IMAGE_REFERENCED, so if it's unset, the
+        // image is free and stays free.
+        if (!(atomic_load(&img_it->state) & IMAGE_REFERENCED)) {
+            if (pool->use_lru) {
+                struct image_flags *new_it = new ? new->priv : NULL;
+                if (!new_it || new_it->order > img_it->order)
                     new = img;
-                    break;
-                }
+            } else {
+                new = img;
+                break;
             }
         }
     }
-    pool_unlock();
     if (!new)
         return NULL;
 
@@ -160,18 +210,57 @@ struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
     }
 
     struct image_flags *it = new->priv;
-    assert(!it->referenced && it->pool_alive);
-    it->referenced = true;
+    int prev = atomic_fetch_or(&it->state, IMAGE_REFERENCED);
+    assert(prev == IMAGE_POOL_ALIVE);
     it->order = ++pool->lru_counter;
+    if (it->used)
+        add_stats(pool, 1, 0, 0, 0);
+    it->used = true;
     return ref;
 }
 
 void mp_image_pool_add(struct mp_image_pool *pool, struct mp_image *new)
 {
     struct image_flags *it = talloc_ptrtype(new, it);
-    *it = (struct image_flags) { .pool_alive = true };
+    *it = (struct image_flags) {
+        .state = ATOMIC_VAR_INIT(IMAGE_POOL_ALIVE),
+        .size = new->bufs[0] ? new->bufs[0]->size : 0,
+    };
     new->priv = it;
-    MP_TARRAY_APPEND(pool, pool->images, pool->num_images, new);
+
+    add_stats(pool, 0, 1, 1, it->size);
+
+    struct pool_bucket *bucket = find_bucket(pool, new->imgfmt, new->w, new->h);
+    if (!bucket) {
+        MP_TARRAY_APPEND(pool, pool->buckets, pool->num_buckets,
+                         (struct pool_bucket){
+                            .fmt = new->imgfmt, .w = new->w, .h = new->h,
+                         });
+        bucket = &pool->buckets[pool->num_buckets - 1];
+    }
+    MP_TARRAY_APPEND(pool, bucket->images, bucket->num_images, new);
+}
+
+// Return the statistics of this pool. "hits" counts images recycled from the
+// pool, "misses" counts images newly added to the pool (usually because no
+// free image was available). Like the other pool functions, this must not be
+// called concurrently with them.
+void mp_image_pool_get_stats(struct mp_image_pool *pool,
+                             struct mp_image_pool_stats *stats)
+{
+    *stats = pool->stats;
+}
+
+// Return the sums of the statistics of all image pools in the process. This
+// can be called from any thread.
+void mp_image_pool_get_total_stats(struct mp_image_pool_stats *stats)
+{
+    *stats = (struct mp_image_pool_stats){
+        .hits = atomic_load(&total_hits),
+        .misses = atomic_load(&total_misses),
+        .num_images = atomic_load(&total_images),
+        .bytes = atomic_load(&total_bytes),
+    };
 }
 
 // Return a new image of given format/size. The only difference to
@@ -254,24 +343,24 @@ void mp_image_pool_set_lru(struct mp_image_pool *pool)
 }
 
 
-// Copies the contents of the HW surface img to system memory and retuns it.
-// If swpool is not NULL, it's used to allocate the target image.
-// img must be a hw surface with a AVHWFramesContext attached.
-// The returned image is cropped as needed.
-// Returns NULL on failure.
-struct mp_image *mp_image_hw_download(struct mp_image *src,
-                                      struct mp_image_pool *swpool)
+// Return the first format mpv supports that the HW surface src can be copied
+// to, or 0 on failure. If pool is not NULL, the result is cached for the
+// hw frames context of src, so it is negotiated only once per context.
+int mp_image_hw_download_get_sw_format(struct mp_image_pool *pool,
+                                       struct mp_image *src)
 {
     if (!src->hwctx)
-        return NULL;
-    AVHWFramesContext *fctx = (void *)src->hwctx->data;
+        return 0;
+
+    if (pool && pool->dl_frames_ctx &&
+        pool->dl_frames_ctx->data == src->hwctx->data)
+        return pool->dl_imgfmt;
 
-    // Try to find the first format which we can apparently use.
     int imgfmt = 0;
     enum AVPixelFormat *fmts;
     if (av_hwframe_transfer_get_formats(src->hwctx,
             AV_HWFRAME_TRANSFER_DIRECTION_FROM, &fmts, 0) < 0)
-        return NULL;
+        return 0;
     for (int n = 0; fmts[n] != AV_PIX_FMT_NONE; n++) {
         imgfmt = pixfmt2imgfmt(fmts[n]);
         if (imgfmt)
@@ -279,35 +368,62 @@ struct mp_image *mp_image_hw_download(struct mp_image *src,
     }
     av_free(fmts);
 
+    if (pool) {
+        // Keeping a reference makes sure the cache key can't be reused by a
+        // different frames context.
+        av_buffer_unref(&pool->dl_frames_ctx);
+        pool->dl_frames_ctx = av_buffer_ref(src->hwctx);
+        pool->dl_imgfmt = imgfmt;
+    }
+    return imgfmt;
+}
+
+// Copy the contents of the HW surface src to dst, which must be a writable
+// image in system memory, use the format returned by
+// mp_image_hw_download_get_sw_format(), and be at least as large as src. This
+// allows downloading directly into memory provided by the consumer (such as a
+// buffer of the next filter or an encoder). Only the image data is copied.
+// Returns false on failure.
+bool mp_image_hw_download_image(struct mp_image *dst, struct mp_image *src)
+{
+    if (!src->hwctx || dst->hwctx || dst->w < src->w || dst->h < src->h)
+        return false;
+
+    // As with mp_image_hw_upload(), the AVFrame is an additional reference to
+    // dst, and libavutil writes to it anyway.
+    AVFrame *dstav = mp_image_to_av_frame(dst);
+    AVFrame *srcav = mp_image_to_av_frame(src);
+    bool ok = dstav && srcav && av_hwframe_transfer_data(dstav, srcav, 0) >= 0;
+    av_frame_free(&srcav);
+    av_frame_free(&dstav);
+    return ok;
+}
+
+// Copies the contents of the HW surface img to system memory and retuns it.
+// If swpool is not NULL, it's used to allocate the target image, and the
+// download format is cached in it.
+// img must be a hw surface with a AVHWFramesContext attached.
+// The returned image is cropped as needed.
+// Returns NULL on failure.
+struct mp_image *mp_image_hw_download(struct mp_image *src,
+                                      struct mp_image_pool *swpool)
+{
+    int imgfmt = mp_image_hw_download_get_sw_format(swpool, src);
     if (!imgfmt)
         return NULL;
+    AVHWFramesContext *fctx = (void *)src->hwctx->data;
 
     struct mp_image *dst =
         mp_image_pool_get(swpool, imgfmt, fctx->width, fctx->height);
     if (!dst)
         return NULL;
 
-    // Target image must be writable, so unref it.
-    AVFrame *dstav = mp_image_to_av_frame_and_unref(dst);
-    if (!dstav)
-        return NULL;
-
-    AVFrame *srcav = mp_image_to_av_frame(src);
-    if (!srcav) {
-        av_frame_unref(dstav);
+    if (!mp_image_hw_download_image(dst, src)) {
+        talloc_free(dst);
         return NULL;
     }
-
-    int res = av_hwframe_transfer_data(dstav, srcav, 0);
-    av_frame_free(&srcav);
-    dst = mp_image_from_av_frame(dstav);
-    av_frame_free(&dstav);
-    if (res >= 0 && dst) {
-        mp_image_set_size(dst, src->w, src->h);
-        mp_image_copy_attributes(dst, src);
-    } else {
-        mp_image_unrefp(&dst);
-    }
+    mp_image_set_size(dst, src->w, src->h);
+    mp_image_copy_attributes(dst, src);
     return dst;
 }
 
@@ -2,6 +2,7 @@
 #define MPV_MP_IMAGE_POOL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 struct mp_image_pool;
 
@@ -21,6 +22,17 @@ typedef struct mp_image *(*mp_image_allocator)(void *data, int fmt, int w, int h
 void mp_image_pool_set_allocator(struct mp_image_pool *pool,
                                  mp_image_allocator cb, void  *cb_data);
 
+struct mp_image_pool_stats {
+    uint64_t hits;          // images reused from a pool
+    uint64_t misses;        // images added to a pool
+    int64_t num_images;     // images currently owned by the pool
+    int64_t bytes;          // size of their data
+};
+
+void mp_image_pool_get_stats(struct mp_image_pool *pool,
+                             struct mp_image_pool_stats *stats);
+void mp_image_pool_get_total_stats(struct mp_image_pool_stats *stats);
+
 struct mp_image *mp_image_pool_new_copy(struct mp_image_pool *pool,
                                         struct mp_image *img);
 bool mp_image_pool_make_writeable(struct mp_image_pool *pool,
@@ -28,6 +40,9 @@ bool mp_image_pool_make_writeable(struct mp_image_pool *pool,
 
 struct mp_image *mp_image_hw_download(struct mp_image *img,
                                       struct mp_image_pool *swpool);
+int mp_image_hw_download_get_sw_format(struct mp_image_pool *pool,
+                                       struct mp_image *src);
+bool mp_image_hw_download_image(struct mp_image *dst, struct mp_image *src);
 
 bool mp_image_hw_upload(struct mp_image *hw_img, struct mp_image *src);
 
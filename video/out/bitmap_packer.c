@@ -20,6 +20,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <stdio.h>
 #include <limits.h>
@@ -197,3 +198,283 @@ void packer_set_size(struct bitmap_packer *packer, int size)
     packer->scratch = talloc_array_ptrtype(packer, packer->scratch,
                                            packer->asize + 16);
 }
+
+// Skyline segment: the area [x, x + w) is occupied from the top down to y.
+struct atlas_node {
+    int x, y, w;
+};
+
+struct atlas_entry {
+    const void *key;
+    int w, h;
+    struct pos pos;
+    // 0: free slot, 1: from previous call (unverified), 2: valid in this call
+    int state;
+};
+
+#define ATLAS_MAX_DIRTY 16
+
+void bitmap_atlas_reset(struct bitmap_atlas *atlas)
+{
+    atlas->w = atlas->h = 0;
+    atlas->num_prev = 0;
+}
+
+static void atlas_clear(struct bitmap_atlas *a)
+{
+    a->num_nodes = 0;
+    MP_TARRAY_APPEND(a, a->nodes, a->num_nodes,
+                     (struct atlas_node){.x = 0, .y = 0, .w = a->w});
+    a->used_width = a->used_height = 0;
+}
+
+// Return the y position of a w*h rectangle whose left edge is at node i, or
+// -1 if it doesn't fit there.
+static int skyline_fit(struct bitmap_atlas *a, int i, int w, int h)
+{
+    if (a->nodes[i].x + w > a->w)
+        return -1;
+    int y = 0;
+    for (int left = w; left > 0; i++) {
+        y = MPMAX(y, a->nodes[i].y);
+        if (y + h > a->h)
+            return -1;
+        left -= a->nodes[i].w;
+    }
+    return y;
+}
+
+// Bottom-left heuristic: pick the position with the lowest bottom edge.
+static bool skyline_alloc(struct bitmap_atlas *a, int w, int h, struct pos *out)
+{
+    int best = -1, best_bottom = INT_MAX;
+    for (int i = 0; i < a->num_nodes; i++) {
+        int y = skyline_fit(a, i, w, h);
+        if (y >= 0 && y + h < best_bottom) {
+            best = i;
+            best_bottom = y + h;
+        }
+    }
+    if (best < 0)
+        return false;
+
+    int x = a->nodes[best].x;
+    MP_TARRAY_INSERT_AT(a, a->nodes, a->num_nodes, best,
+                        (struct atlas_node){.x = x, .y = best_bottom, .w = w});
+    // Cut the nodes covered by the new one.
+    int i = best + 1;
+    while (i < a->num_nodes) {
+        struct atlas_node *n = &a->nodes[i];
+        int covered = x + w - n->x;
+        if (covered <= 0)
+            break;
+        if (covered < n->w) {
+            n->x += covered;
+            n->w -= covered;
+            break;
+        }
+        MP_TARRAY_REMOVE_AT(a->nodes, a->num_nodes, i);
+    }
+    // Merge neighbours with the same height.
+    for (i = MPMAX(best - 1, 0); i + 1 < a->num_nodes && i <= best; ) {
+        if (a->nodes[i].y == a->nodes[i + 1].y) {
+            a->nodes[i].w += a->nodes[i + 1].w;
+            MP_TARRAY_REMOVE_AT(a->nodes, a->num_nodes, i + 1);
+        } else {
+            i++;
+        }
+    }
+
+    *out = (struct pos){x, best_bottom - h};
+    a->used_width = MPMAX(a->used_width, x + w);
+    a->used_height = MPMAX(a->used_height, best_bottom);
+    return true;
+}
+
+static void add_dirty(struct bitmap_atlas *a, struct pos p, int w, int h)
+{
+    struct mp_rect rc = {p.x, p.y, p.x + w, p.y + h};
+    if (a->num_dirty == ATLAS_MAX_DIRTY) {
+        // Too many small uploads are slower than one large one.
+        for (int n = 1; n < a->num_dirty; n++)
+            mp_rect_union(&a->dirty[0], &a->dirty[n]);
+        mp_rect_union(&a->dirty[0], &rc);
+        a->num_dirty = 1;
+        return;
+    }
+    MP_TARRAY_APPEND(a, a->dirty, a->num_dirty, rc);
+}
+
+static void table_init(struct bitmap_atlas *a, int num)
+{
+    int size = 16;
+    while (size < num * 2)
+        size *= 2;
+    if (size > a->table_size) {
+        a->table = talloc_realloc(a, a->table, struct atlas_entry, size);
+        a->table_size = size;
+    }
+    memset(a->table, 0, a->table_size * sizeof(a->table[0]));
+}
+
+// Return the slot for the given key and size (free if not present).
+static struct atlas_entry *table_find(struct bitmap_atlas *a, const void *key,
+                                      int w, int h)
+{
+    uint64_t k = (uintptr_t)key;
+    unsigned hash = (unsigned)((k >> 4) ^ (k >> 32)) * 2654435761u;
+    hash ^= w * 31 + h;
+    for (unsigned i = hash & (a->table_size - 1); ; i = (i + 1) & (a->table_size - 1)) {
+        struct atlas_entry *e = &a->table[i];
+        if (!e->state || (e->key == key && e->w == w && e->h == h))
+            return e;
+    }
+}
+
+static void table_add(struct bitmap_atlas *a, struct bitmap_atlas_item *item,
+                      int state)
+{
+    struct atlas_entry *e = table_find(a, item->key, item->w, item->h);
+    *e = (struct atlas_entry){item->key, item->w, item->h, item->pos, state};
+}
+
+static void save_entries(struct bitmap_atlas *a)
+{
+    a->num_prev = 0;
+    for (int n = 0; n < a->table_size; n++) {
+        if (a->table[n].state == 2)
+            MP_TARRAY_APPEND(a, a->prev, a->num_prev, a->table[n]);
+    }
+}
+
+static bool place_item(struct bitmap_atlas *a, struct bitmap_atlas_item *item,
+                       bool (*same_content)(void *ctx,
+                                            struct bitmap_atlas_item *item),
+                       void *ctx)
+{
+    item->is_new = false;
+    if (item->w <= 0 || item->h <= 0) {
+        item->pos = (struct pos){0, 0};
+        return true;
+    }
+    if (item->key) {
+        struct atlas_entry *e = table_find(a, item->key, item->w, item->h);
+        if (e->state == 1) {
+            item->pos = e->pos;
+            if (!same_content || same_content(ctx, item))
+                e->state = 2;
+        }
+        if (e->state == 2) {
+            item->pos = e->pos;
+            return true;
+        }
+    }
+    if (!skyline_alloc(a, item->w, item->h, &item->pos))
+        return false;
+    item->is_new = true;
+    if (item->key)
+        table_add(a, item, 2);
+    return true;
+}
+
+static int compare_height(const void *pa, const void *pb)
+{
+    const struct bitmap_atlas_item *a = *(struct bitmap_atlas_item **)pa;
+    const struct bitmap_atlas_item *b = *(struct bitmap_atlas_item **)pb;
+    if (a->h != b->h)
+        return a->h > b->h ? -1 : 1;
+    return a->w > b->w ? -1 : (a->w < b->w);
+}
+
+int bitmap_atlas_pack(struct bitmap_atlas *atlas,
+                      struct bitmap_atlas_item *items, int num_items,
+                      bool (*same_content)(void *ctx,
+                                           struct bitmap_atlas_item *item),
+                      void *ctx)
+{
+    struct bitmap_atlas *a = atlas;
+    a->full_dirty = false;
+    a->num_dirty = 0;
+
+    if (a->w > 0 && a->h > 0) {
+        table_init(a, a->num_prev + num_items);
+        for (int n = 0; n < a->num_prev; n++) {
+            struct atlas_entry *p = &a->prev[n];
+            struct atlas_entry *e = table_find(a, p->key, p->w, p->h);
+            *e = *p;
+            e->state = 1;
+        }
+        bool ok = true;
+        for (int n = 0; n < num_items; n++) {
+            if (!place_item(a, &items[n], same_content, ctx)) {
+                ok = false;
+                break;
+            }
+            if (items[n].is_new)
+                add_dirty(a, items[n].pos, items[n].w, items[n].h);
+        }
+        if (ok) {
+            save_entries(a);
+            return 0;
+        }
+    }
+
+    // Place everything from scratch, tallest first, and grow if needed.
+    int xmax = 0, ymax = 0;
+    for (int n = 0; n < num_items; n++) {
+        if (items[n].w > 65535 || items[n].h > 65535) {
+            fprintf(stderr, "Invalid OSD / subtitle bitmap size\n");
+            abort();
+        }
+        xmax = MPMAX(xmax, items[n].w);
+        ymax = MPMAX(ymax, items[n].h);
+    }
+    int w_max = a->w_max > 0 ? a->w_max : INT_MAX;
+    int h_max = a->h_max > 0 ? a->h_max : INT_MAX;
+    int w = MPMIN(MPMAX(a->w, 64), w_max);
+    int h = MPMIN(MPMAX(a->h, 64), h_max);
+    while (w < xmax && w < w_max)
+        w = MPMIN(w * 2, w_max);
+    while (h < ymax && h < h_max)
+        h = MPMIN(h * 2, h_max);
+
+    struct bitmap_atlas_item **order =
+        talloc_array(NULL, struct bitmap_atlas_item *, num_items);
+    for (int n = 0; n < num_items; n++)
+        order[n] = &items[n];
+    qsort(order, num_items, sizeof(order[0]), compare_height);
+
+    int res = 1;
+    while (1) {
+        a->w = w;
+        a->h = h;
+        a->num_dirty = 0;
+        atlas_clear(a);
+        table_init(a, num_items);
+        bool ok = true;
+        for (int n = 0; n < num_items; n++) {
+            if (!place_item(a, order[n], NULL, NULL)) {
+                ok = false;
+                break;
+            }
+        }
+        if (ok)
+            break;
+        if (w <= h && w != w_max) {
+            w = MPMIN(w * 2, w_max);
+        } else if (h != h_max) {
+            h = MPMIN(h * 2, h_max);
+        } else {
+            bitmap_atlas_reset(a);
+            res = -1;
+            break;
+        }
+    }
+    talloc_free(order);
+
+    if (res > 0) {
+        a->full_dirty = true;
+        save_entries(a);
+    }
+    return res;
+}
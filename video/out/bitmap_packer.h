@@ -1,6 +1,10 @@
 #ifndef MPLAYER_PACK_RECTANGLES_H
 #define MPLAYER_PACK_RECTANGLES_H
 
+#include <stdbool.h>
+
+#include "common/common.h"
+
 struct pos {
     int x;
     int y;
@@ -48,4 +52,61 @@ void packer_set_size(struct bitmap_packer *packer, int size);
  */
 int packer_pack(struct bitmap_packer *packer);
 
+struct atlas_node;
+struct atlas_entry;
+
+/* A texture atlas that keeps the placement of rectangles across calls, so
+ * that only rectangles which were not present in the previous call need to be
+ * written (and uploaded). Rectangles are allocated with a skyline allocator.
+ * Space of rectangles that went away is reclaimed only when the atlas is full,
+ * in which case everything is placed again from scratch.
+ * Like struct bitmap_packer, this must be allocated with talloc.
+ */
+struct bitmap_atlas {
+    int w, h;               // current atlas size (powers of 2, or 0)
+    int w_max, h_max;       // maximum size (0: unlimited)
+    int used_width, used_height; // bounding box of all allocations
+
+    // Set by bitmap_atlas_pack(): the areas that were written to. If
+    // full_dirty is set, everything needs to be rewritten instead.
+    bool full_dirty;
+    struct mp_rect *dirty;
+    int num_dirty;
+
+    // internal
+    struct atlas_node *nodes;
+    int num_nodes;
+    struct atlas_entry *prev;
+    int num_prev;
+    struct atlas_entry *table;
+    int table_size;
+};
+
+struct bitmap_atlas_item {
+    // in: if not NULL, identifies the content. Items with the same key and size
+    //     as an item in the previous call are candidates for keeping their
+    //     position. Items with the same key and size in the same call share it.
+    const void *key;
+    int w, h;               // in: size
+    struct pos pos;         // out: position in the atlas
+    bool is_new;            // out: content must be written to pos
+};
+
+// Forget all placements; the next bitmap_atlas_pack() starts from scratch.
+void bitmap_atlas_reset(struct bitmap_atlas *atlas);
+
+/* Place the num_items rectangles in items[] into the atlas. For items that
+ * may keep their previous position, same_content(ctx, item) is called with
+ * item->pos set to that position; if it returns false, the item is placed
+ * like a new one. If same_content is NULL, the key alone identifies content.
+ * Returns 1 if everything was placed from scratch (full_dirty is set, and the
+ * atlas size may have changed), 0 if the placement was incremental, and -1 if
+ * the items did not fit into the maximum size.
+ */
+int bitmap_atlas_pack(struct bitmap_atlas *atlas,
+                      struct bitmap_atlas_item *items, int num_items,
+                      bool (*same_content)(void *ctx,
+                                           struct bitmap_atlas_item *item),
+                      void *ctx);
+
 #endif
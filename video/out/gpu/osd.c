@@ -52,6 +52,7 @@ static const struct ra_renderpass_input vertex_vao[] = {
 struct mpgl_osd_part {
     enum sub_bitmap_format format;
     int change_id;
+    uint64_t packed_version; // of the data in texture (0 if unknown)
     struct ra_tex *texture;
     int w, h;
     int num_subparts;
@@ -134,6 +135,12 @@ static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
     const struct ra_format *fmt = ctx->fmt_table[imgs->format];
     assert(fmt);
 
+    // If the texture has the previous version of the packed image, only the
+    // changed areas need to be uploaded.
+    bool incremental = imgs->packed_prev_version &&
+                       imgs->packed_prev_version == osd->packed_version;
+    osd->packed_version = 0;
+
     if (!osd->texture || req_w > osd->w || req_h > osd->h ||
         osd->format != imgs->format)
     {
@@ -165,17 +172,40 @@ static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
         osd->texture = ra_tex_create(ra, &params);
         if (!osd->texture)
             goto done;
+        incremental = false;
     }
 
-    struct ra_tex_upload_params params = {
-        .tex = osd->texture,
-        .src = imgs->packed->planes[0],
-        .invalidate = true,
-        .rc = &(struct mp_rect){0, 0, imgs->packed_w, imgs->packed_h},
-        .stride = imgs->packed->stride[0],
-    };
+    if (incremental) {
+        ok = true;
+        for (int n = 0; n < imgs->num_packed_dirty; n++) {
+            struct mp_rect *dirty = &imgs->packed_dirty[n];
+            // Upload whole rows: the PBO upload path copies stride * height
+            // bytes starting at src, which would read past the end of the
+            // image if src pointed into the middle of the first row.
+            struct mp_rect rc = {0, dirty->y0, imgs->packed_w, dirty->y1};
+            struct ra_tex_upload_params params = {
+                .tex = osd->texture,
+                .src = imgs->packed->planes[0] +
+                       rc.y0 * imgs->packed->stride[0],
+                .rc = &rc,
+                .stride = imgs->packed->stride[0],
+            };
+            ok &= ra->fns->tex_upload(ra, &params);
+        }
+    } else {
+        struct ra_tex_upload_params params = {
+            .tex = osd->texture,
+            .src = imgs->packed->planes[0],
+            .invalidate = true,
+            .rc = &(struct mp_rect){0, 0, imgs->packed_w, imgs->packed_h},
+            .stride = imgs->packed->stride[0],
+        };
+
+        ok = ra->fns->tex_upload(ra, &params);
+    }
 
-    ok = ra->fns->tex_upload(ra, &params);
+    if (ok)
+        osd->packed_version = imgs->packed_version;
 
 done:
     return ok;
@@ -208,6 +208,7 @@ struct vo_extra {
     struct input_ctx *input_ctx;
     struct osd_state *osd;
     struct encode_lavc_context *encode_lavc_ctx;
+    struct image_writer_queue *image_writer_queue;
     void (*wakeup_cb)(void *ctx);
     void *wakeup_ctx;
 };
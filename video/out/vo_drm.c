@@ -75,6 +75,15 @@ struct priv {
     struct mp_image *last_input;
     struct mp_image *cur_frame;
     struct mp_image *cur_frame_cropped;
+    // For redrawing the same frame with changed OSD: cur_frame without OSD,
+    // and the OSD state of cur_frame.
+    struct mp_image *clean_frame;
+    struct osd_damage *damage;
+    // Areas of each framebuffer that differ from cur_frame (-1: all).
+    struct {
+        struct mp_rect rc[OSD_DAMAGE_MAX_RECTS];
+        int num_rc;
+    } buf_damage[BUF_COUNT];
     struct mp_rect src;
     struct mp_rect dst;
     struct mp_osd_res osd;
@@ -300,10 +309,14 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
 
     talloc_free(p->last_input);
     p->last_input = NULL;
+    mp_image_unrefp(&p->clean_frame);
+    osd_damage_reset(p->damage);
 
     struct framebuffer *buf = p->bufs;
-    for (unsigned int i = 0; i < BUF_COUNT; i++)
+    for (unsigned int i = 0; i < BUF_COUNT; i++) {
         memset(buf[i].map, 0, buf[i].size);
+        p->buf_damage[i].num_rc = -1;
+    }
 
     if (mp_sws_reinit(p->sws) < 0)
         return -1;
@@ -312,12 +325,46 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     return 0;
 }
 
+static void restore_clean(void *ctx, struct mp_rect rc)
+{
+    struct priv *p = ctx;
+    struct mp_image dst = *p->cur_frame, clean = *p->clean_frame;
+    mp_image_crop_rc(&dst, rc);
+    mp_image_crop_rc(&clean, rc);
+    mp_image_copy(&dst, &clean);
+}
+
+// Record that the rectangles in rc (all if num_rc < 0) of cur_frame changed.
+static void add_buf_damage(struct priv *p, struct mp_rect *rc, int num_rc)
+{
+    for (unsigned int i = 0; i < BUF_COUNT; i++) {
+        int *num = &p->buf_damage[i].num_rc;
+        if (*num < 0)
+            continue;
+        if (num_rc < 0 || *num + num_rc > OSD_DAMAGE_MAX_RECTS) {
+            *num = -1;
+            continue;
+        }
+        for (int n = 0; n < num_rc; n++)
+            p->buf_damage[i].rc[(*num)++] = rc[n];
+    }
+}
+
 static void draw_image(struct vo *vo, mp_image_t *mpi)
 {
     struct priv *p = vo->priv;
 
     if (p->active) {
-        if (mpi) {
+        bool redraw = mpi == p->last_input;
+        double pts = mpi ? mpi->pts : 0;
+        struct mp_rect rc[OSD_DAMAGE_MAX_RECTS];
+        int num_rc = -1;
+
+        if (redraw && p->clean_frame) {
+            num_rc = osd_draw_on_image_damage(vo->osd, p->osd, pts, 0,
+                                              p->cur_frame, p->damage,
+                                              restore_clean, p, rc);
+        } else if (mpi) {
             struct mp_image src = *mpi;
             struct mp_rect src_rc = p->src;
             src_rc.x0 = MP_ALIGN_DOWN(src_rc.x0, mpi->fmt.align_x);
@@ -330,22 +377,47 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
             mp_image_clear(p->cur_frame, p->dst.x1, p->dst.y0, p->cur_frame->w, p->dst.y1);
 
             mp_sws_scale(p->sws, p->cur_frame_cropped, &src);
-            osd_draw_on_image(vo->osd, p->osd, src.pts, 0, p->cur_frame);
         } else {
             mp_image_clear(p->cur_frame, 0, 0, p->cur_frame->w, p->cur_frame->h);
-            osd_draw_on_image(vo->osd, p->osd, 0, 0, p->cur_frame);
         }
 
+        if (num_rc < 0) {
+            // Keep the frame without OSD, so that further redraws of it only
+            // need to update the areas where the OSD changed.
+            if (redraw)
+                p->clean_frame = mp_image_new_copy(p->cur_frame);
+            osd_draw_on_image_damage(vo->osd, p->osd, pts, 0, p->cur_frame,
+                                     p->damage, NULL, NULL, rc);
+        }
+        add_buf_damage(p, rc, num_rc);
+
         struct framebuffer *front_buf = &p->bufs[p->front_buf];
-        memcpy_pic(front_buf->map, p->cur_frame->planes[0],
-                   p->cur_frame->w * BYTES_PER_PIXEL, p->cur_frame->h,
-                   front_buf->stride,
-                   p->cur_frame->stride[0]);
+        int *num_buf_rc = &p->buf_damage[p->front_buf].num_rc;
+        if (*num_buf_rc < 0) {
+            memcpy_pic(front_buf->map, p->cur_frame->planes[0],
+                       p->cur_frame->w * BYTES_PER_PIXEL, p->cur_frame->h,
+                       front_buf->stride,
+                       p->cur_frame->stride[0]);
+        } else {
+            for (int n = 0; n < *num_buf_rc; n++) {
+                struct mp_rect r = p->buf_damage[p->front_buf].rc[n];
+                memcpy_pic(front_buf->map + r.y0 * front_buf->stride +
+                               r.x0 * BYTES_PER_PIXEL,
+                           p->cur_frame->planes[0] +
+                               r.y0 * p->cur_frame->stride[0] +
+                               r.x0 * BYTES_PER_PIXEL,
+                           (r.x1 - r.x0) * BYTES_PER_PIXEL, r.y1 - r.y0,
+                           front_buf->stride,
+                           p->cur_frame->stride[0]);
+            }
+        }
+        *num_buf_rc = 0;
     }
 
     if (mpi != p->last_input) {
         talloc_free(p->last_input);
         p->last_input = mpi;
+        mp_image_unrefp(&p->clean_frame);
     }
 }
 
@@ -400,12 +472,14 @@ static void uninit(struct vo *vo)
     talloc_free(p->last_input);
     talloc_free(p->cur_frame);
     talloc_free(p->cur_frame_cropped);
+    talloc_free(p->clean_frame);
 }
 
 static int preinit(struct vo *vo)
 {
     struct priv *p = vo->priv;
     p->sws = mp_sws_alloc(vo);
+    p->damage = osd_damage_create(p);
     p->ev.version = DRM_EVENT_CONTEXT_VERSION;
     p->ev.page_flip_handler = page_flipped;
 
@@ -20,11 +20,20 @@
 #include <string.h>
 #include <math.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <sys/stat.h>
 
+#include <libavutil/rational.h>
 #include <libswscale/swscale.h>
 
 #include "config.h"
+
+#if HAVE_POSIX
+#include <sys/uio.h>
+#endif
 #include "misc/bstr.h"
 #include "osdep/io.h"
 #include "options/m_config.h"
@@ -47,9 +56,13 @@ static const struct m_sub_options image_writer_conf = {
     .defaults = &image_writer_opts_defaults,
 };
 
+#define RAW_PLANES 1
+#define RAW_Y4M 2
+
 struct vo_image_opts {
     struct image_writer_opts *opts;
     char *outdir;
+    int raw;
 };
 
 #define OPT_BASE_STRUCT struct vo_image_opts
@@ -58,6 +71,10 @@ static const struct m_sub_options vo_image_conf = {
     .opts = (const struct m_option[]) {
         OPT_SUBSTRUCT("vo-image", opts, image_writer_conf, 0),
         OPT_STRING("vo-image-outdir", outdir, M_OPT_FILE),
+        OPT_CHOICE("vo-image-raw", raw, 0,
+                   ({"no", 0},
+                    {"planes", RAW_PLANES},
+                    {"y4m", RAW_Y4M})),
         {0},
     },
     .size = sizeof(struct vo_image_opts),
@@ -65,11 +82,166 @@ static const struct m_sub_options vo_image_conf = {
 
 struct priv {
     struct vo_image_opts *opts;
+    struct image_writer_queue *queue;
+
+    // Number of this VO's frames in the queue. The queue is shared with
+    // screenshots, so this is what uninit() waits for.
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int in_flight;
 
     struct mp_image *current;
     int frame;
+
+    int y4m_fd;
+    struct mp_image_params y4m_params; // params of the written header
+};
+
+#if !HAVE_POSIX
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
+
+static ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    return write(fd, iov[0].iov_base, iov[0].iov_len);
+}
+#endif
+
+#define MAX_IOV 64
+
+struct iov_writer {
+    int fd;
+    bool error;
+    struct iovec iov[MAX_IOV];
+    int num_iov;
 };
 
+static void iov_flush(struct iov_writer *w)
+{
+    struct iovec *iov = w->iov;
+    int num = w->num_iov;
+    while (num > 0 && !w->error) {
+        ssize_t r = writev(w->fd, iov, num);
+        if (r < 0) {
+            if (errno != EINTR)
+                w->error = true;
+            continue;
+        }
+        while (num > 0 && r >= iov->iov_len) {
+            r -= iov->iov_len;
+            iov++;
+            num--;
+        }
+        if (num > 0) {
+            iov->iov_base = (char *)iov->iov_base + r;
+            iov->iov_len -= r;
+        }
+    }
+    w->num_iov = 0;
+}
+
+static void iov_add(struct iov_writer *w, void *data, size_t size)
+{
+    if (w->num_iov == MAX_IOV)
+        iov_flush(w);
+    w->iov[w->num_iov++] = (struct iovec){data, size};
+}
+
+// Write the header (if any) and the image planes without padding. Rows are
+// passed to the kernel directly, instead of being copied into a buffer.
+static bool write_planes(int fd, const char *header, struct mp_image *img)
+{
+    struct iov_writer w = {.fd = fd};
+    if (header)
+        iov_add(&w, (char *)header, strlen(header));
+    for (int p = 0; p < img->num_planes; p++) {
+        int h = mp_image_plane_h(img, p);
+        size_t bytes = (size_t)mp_image_plane_w(img, p) * img->fmt.bytes[p];
+        if (img->stride[p] == bytes) {
+            iov_add(&w, img->planes[p], bytes * h);
+        } else {
+            for (int y = 0; y < h; y++)
+                iov_add(&w, img->planes[p] + (ptrdiff_t)img->stride[p] * y, bytes);
+        }
+    }
+    iov_flush(&w);
+    return !w.error;
+}
+
+static const char *y4m_colorspace(struct mp_image_params *params)
+{
+    if (params->imgfmt == IMGFMT_Y8)
+        return "mono";
+    struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(params->imgfmt);
+    if (!(desc.flags & MP_IMGFLAG_YUV_P) || desc.num_planes != 3 ||
+        desc.component_bits != 8 || desc.bytes[0] != 1)
+        return NULL;
+    if (desc.chroma_xs == 1 && desc.chroma_ys == 1) {
+        return params->chroma_location == MP_CHROMA_LEFT ? "420mpeg2"
+                                                         : "420jpeg";
+    }
+    if (desc.chroma_xs == 1 && desc.chroma_ys == 0)
+        return "422";
+    if (desc.chroma_xs == 0 && desc.chroma_ys == 0)
+        return "444";
+    return NULL;
+}
+
+static bool query_raw_format(struct vo *vo, int fmt)
+{
+    struct priv *p = vo->priv;
+    if (p->opts->raw == RAW_Y4M) {
+        struct mp_image_params params = {.imgfmt = fmt};
+        return y4m_colorspace(&params);
+    }
+    struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(fmt);
+    return (desc.flags & MP_IMGFLAG_BYTE_ALIGNED) &&
+           !(desc.flags & (MP_IMGFLAG_HWACCEL | MP_IMGFLAG_PAL));
+}
+
+static void write_y4m(struct vo *vo, struct mp_image *img)
+{
+    struct priv *p = vo->priv;
+
+    char header[200] = "FRAME\n";
+    if (!p->y4m_params.imgfmt) {
+        struct mp_image_params *par = &img->params;
+        AVRational fps = av_d2q(img->nominal_fps > 0 ? img->nominal_fps : 25,
+                                1001000);
+        snprintf(header, sizeof(header),
+                 "YUV4MPEG2 W%d H%d F%d:%d Ip A%d:%d C%s XCOLORRANGE=%s\n"
+                 "FRAME\n", par->w, par->h, fps.num, fps.den,
+                 MPMAX(par->p_w, 0), MPMAX(par->p_h, 0), y4m_colorspace(par),
+                 par->color.levels == MP_CSP_LEVELS_PC ? "FULL" : "LIMITED");
+        p->y4m_params = *par;
+    } else if (img->params.w != p->y4m_params.w ||
+               img->params.h != p->y4m_params.h ||
+               img->params.imgfmt != p->y4m_params.imgfmt)
+    {
+        MP_ERR(vo, "y4m output can't change resolution or format, dropping "
+               "frame %d.\n", p->frame);
+        return;
+    }
+
+    if (!write_planes(p->y4m_fd, header, img))
+        MP_ERR(vo, "Error writing frame %d: %s\n", p->frame, mp_strerror(errno));
+}
+
+static void write_raw(struct vo *vo, struct mp_image *img, const char *filename)
+{
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+    if (fd < 0) {
+        MP_ERR(vo, "Error opening '%s' for writing!\n", filename);
+        return;
+    }
+    bool ok = write_planes(fd, NULL, img);
+    ok = !close(fd) && ok;
+    if (!ok)
+        MP_ERR(vo, "Error writing file '%s'!\n", filename);
+}
+
 static bool checked_mkdir(struct vo *vo, const char *buf)
 {
     MP_INFO(vo, "Creating output directory '%s'...\n", buf);
@@ -86,11 +258,45 @@ static bool checked_mkdir(struct vo *vo, const char *buf)
     return true;
 }
 
+static char *out_filename(struct vo *vo, void *ta_parent, const char *name)
+{
+    struct priv *p = vo->priv;
+    if (p->opts->outdir && strlen(p->opts->outdir))
+        return mp_path_join(ta_parent, p->opts->outdir, name);
+    return talloc_strdup(ta_parent, name);
+}
+
+static void frame_done(void *ctx, bool success)
+{
+    struct priv *p = ctx;
+    pthread_mutex_lock(&p->lock);
+    p->in_flight -= 1;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+}
+
 static int reconfig(struct vo *vo, struct mp_image_params *params)
 {
     struct priv *p = vo->priv;
     mp_image_unrefp(&p->current);
 
+    if (p->opts->raw == RAW_PLANES) {
+        MP_INFO(vo, "Writing raw %s frames of %dx%d pixels.\n",
+                mp_imgfmt_to_name(params->imgfmt), params->w, params->h);
+    }
+
+    if (p->opts->raw == RAW_Y4M && p->y4m_fd < 0) {
+        char *filename = out_filename(vo, NULL, "output.y4m");
+        MP_INFO(vo, "Writing %s\n", filename);
+        p->y4m_fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY,
+                         0666);
+        if (p->y4m_fd < 0)
+            MP_ERR(vo, "Error opening '%s' for writing!\n", filename);
+        talloc_free(filename);
+        if (p->y4m_fd < 0)
+            return -1;
+    }
+
     return 0;
 }
 
@@ -112,15 +318,32 @@ static void flip_page(struct vo *vo)
 
     (p->frame)++;
 
-    void *t = talloc_new(NULL);
-    char *filename = talloc_asprintf(t, "%08d.%s", p->frame,
-                                     image_writer_file_ext(p->opts->opts));
+    if (p->opts->raw == RAW_Y4M) {
+        write_y4m(vo, p->current);
+        mp_image_unrefp(&p->current);
+        return;
+    }
 
-    if (p->opts->outdir && strlen(p->opts->outdir))
-        filename = mp_path_join(t, p->opts->outdir, filename);
+    void *t = talloc_new(NULL);
+    const char *ext = p->opts->raw ? mp_imgfmt_to_name(p->current->imgfmt)
+                                   : image_writer_file_ext(p->opts->opts);
+    char *filename = out_filename(vo, t, talloc_asprintf(t, "%08d.%s",
+                                                         p->frame, ext));
 
     MP_INFO(vo, "Saving %s\n", filename);
-    write_image(p->current, p->opts->opts, filename, vo->log);
+    if (p->opts->raw) {
+        write_raw(vo, p->current, filename);
+    } else {
+        pthread_mutex_lock(&p->lock);
+        p->in_flight += 1;
+        pthread_mutex_unlock(&p->lock);
+        if (!image_writer_queue_add(p->queue, p->current, p->opts->opts,
+                                    filename, frame_done, p))
+        {
+            MP_WARN(vo, "Dropping %s\n", filename);
+            frame_done(p, false);
+        }
+    }
 
     talloc_free(t);
     mp_image_unrefp(&p->current);
@@ -128,6 +351,9 @@ static void flip_page(struct vo *vo)
 
 static int query_format(struct vo *vo, int fmt)
 {
+    struct priv *p = vo->priv;
+    if (p->opts->raw)
+        return query_raw_format(vo, fmt);
     if (mp_sws_supported_format(fmt))
         return 1;
     return 0;
@@ -138,14 +364,31 @@ static void uninit(struct vo *vo)
     struct priv *p = vo->priv;
 
     mp_image_unrefp(&p->current);
+    // Don't lose frames that are still being encoded. Don't flush the whole
+    // queue, which may be shared with screenshots still being written. Done
+    // callbacks never block the workers, so our frames always finish.
+    pthread_mutex_lock(&p->lock);
+    while (p->in_flight)
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->wakeup);
+    if (p->y4m_fd >= 0)
+        close(p->y4m_fd);
 }
 
 static int preinit(struct vo *vo)
 {
     struct priv *p = vo->priv;
     p->opts = mp_get_config_group(vo, vo->global, &vo_image_conf);
+    p->y4m_fd = -1;
     if (p->opts->outdir && !checked_mkdir(vo, p->opts->outdir))
         return -1;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+    p->queue = vo->extra.image_writer_queue;
+    if (!p->queue)
+        p->queue = image_writer_queue_create(vo, vo->global, vo->log);
     return 0;
 }
 
@@ -15,17 +15,24 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <config.h>
 
 #if HAVE_POSIX
+#include <poll.h>
 #include <sys/ioctl.h>
 #endif
 
 #include <libswscale/swscale.h>
 
+#include "common/msg.h"
+#include "common/msg_control.h"
 #include "options/m_config.h"
+#include "osdep/timer.h"
 #include "config.h"
 #include "vo.h"
 #include "sub/osd.h"
@@ -41,10 +48,6 @@
 #define ESC_CLEAR_SCREEN "\e[2J"
 #define ESC_CLEAR_COLORS "\e[0m"
 #define ESC_GOTOXY "\e[%d;%df"
-#define ESC_COLOR_BG "\e[48;2;%d;%d;%dm"
-#define ESC_COLOR_FG "\e[38;2;%d;%d;%dm"
-#define ESC_COLOR256_BG "\e[48;5;%dm"
-#define ESC_COLOR256_FG "\e[38;5;%dm"
 #define DEFAULT_WIDTH 80
 #define DEFAULT_HEIGHT 25
 
@@ -72,6 +75,17 @@ static const struct m_sub_options vo_tct_conf = {
     .size = sizeof(struct vo_tct_opts),
 };
 
+#define CELL_UNSET UINT32_MAX
+
+// Redraw all cells at least this often (in microseconds), to repair damage by
+// terminal output we don't know about, such as the status line.
+#define FULL_REDRAW_INTERVAL 1000000
+
+struct lut_item {
+    char str[4];
+    int width;
+};
+
 struct priv {
     struct vo_tct_opts *opts;
     size_t buffer_size;
@@ -82,6 +96,16 @@ struct priv {
     struct mp_rect src;
     struct mp_rect dst;
     struct mp_sws_context *sws;
+
+    // Colors of each cell as last written to the terminal (background and
+    // foreground), either as 0xRRGGBB or as xterm-256 index.
+    uint32_t *cells;
+    uint64_t term_lines;        // mp_msg_get_term_lines() at the last redraw
+    int64_t last_full_redraw;
+
+    struct lut_item lut[256];   // decimal representations of 0-255
+    uint8_t x256_ci[256];       // nearest color cube index per channel
+    uint8_t x256_gray[3 * 255 + 1]; // nearest gray index by sum of r/g/b
 };
 
 // Convert RGB24 to xterm-256 8-bit value
@@ -90,16 +114,13 @@ struct priv {
 // input is the exact middle:
 // - The r/g/b channels and the gray value: the higher value output is chosen.
 // - If the gray and color have same distance from the input - color is chosen.
-static int rgb_to_x256(uint8_t r, uint8_t g, uint8_t b)
+static int rgb_to_x256(struct priv *p, uint8_t r, uint8_t g, uint8_t b)
 {
-    // Calculate the nearest 0-based color index at 16 .. 231
-#   define v2ci(v) (v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40)
-    int ir = v2ci(r), ig = v2ci(g), ib = v2ci(b);   // 0..5 each
-#   define color_index() (36 * ir + 6 * ig + ib)  /* 0..215, lazy evaluation */
+    // Nearest 0-based color index at 16 .. 231, 0..5 each
+    int ir = p->x256_ci[r], ig = p->x256_ci[g], ib = p->x256_ci[b];
 
-    // Calculate the nearest 0-based gray index at 232 .. 255
-    int average = (r + g + b) / 3;
-    int gray_index = average > 238 ? 23 : (average - 3) / 10;  // 0..23
+    // Nearest 0-based gray index at 232 .. 255
+    int gray_index = p->x256_gray[r + g + b];
 
     // Calculate the represented colors back from the index
     static const int i2cv[6] = {0, 0x5f, 0x87, 0xaf, 0xd7, 0xff};
@@ -110,69 +131,160 @@ static int rgb_to_x256(uint8_t r, uint8_t g, uint8_t b)
 #   define dist_square(A,B,C, a,b,c) ((A-a)*(A-a) + (B-b)*(B-b) + (C-c)*(C-c))
     int color_err = dist_square(cr, cg, cb, r, g, b);
     int gray_err  = dist_square(gv, gv, gv, r, g, b);
-    return color_err <= gray_err ? 16 + color_index() : 232 + gray_index;
+    return color_err <= gray_err ? 16 + 36 * ir + 6 * ig + ib
+                                 : 232 + gray_index;
+}
+
+static void init_tables(struct priv *p)
+{
+    for (int v = 0; v < 256; v++) {
+        struct lut_item *item = &p->lut[v];
+        item->width = snprintf(item->str, sizeof(item->str), "%d", v);
+        p->x256_ci[v] = v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40;
+    }
+    for (int sum = 0; sum < MP_ARRAY_SIZE(p->x256_gray); sum++) {
+        int average = sum / 3;
+        p->x256_gray[sum] = average > 238 ? 23 : (average - 3) / 10;
+    }
+}
+
+static char *append_str(char *dst, const char *src)
+{
+    size_t len = strlen(src);
+    memcpy(dst, src, len);
+    return dst + len;
+}
+
+static char *append_lut(char *dst, struct lut_item *item)
+{
+    memcpy(dst, item->str, 4);
+    return dst + item->width;
+}
+
+static char *append_int(char *dst, int v)
+{
+    char tmp[12];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n)
+        *dst++ = tmp[--n];
+    return dst;
+}
+
+// Append the SGR parameters for a color, e.g. "48;2;R;G;B".
+static char *append_color(struct priv *p, char *dst, bool fg, uint32_t color)
+{
+    dst = append_str(dst, fg ? "38;" : "48;");
+    if (p->opts->term256) {
+        dst = append_str(dst, "5;");
+        return append_lut(dst, &p->lut[color]);
+    }
+    dst = append_str(dst, "2;");
+    dst = append_lut(dst, &p->lut[(color >> 16) & 0xFF]);
+    *dst++ = ';';
+    dst = append_lut(dst, &p->lut[(color >> 8) & 0xFF]);
+    *dst++ = ';';
+    return append_lut(dst, &p->lut[color & 0xFF]);
 }
 
-static void write_plain(
-    const int dwidth, const int dheight,
-    const int swidth, const int sheight,
-    const unsigned char *source, const int source_stride,
-    bool term256)
+static uint32_t get_color(struct priv *p, const unsigned char *bgr)
 {
-    assert(source);
-    const int tx = (dwidth - swidth) / 2;
-    const int ty = (dheight - sheight) / 2;
-    for (int y = 0; y < sheight; y++) {
-        const unsigned char *row = source + y * source_stride;
-        printf(ESC_GOTOXY, ty + y, tx);
-        for (int x = 0; x < swidth; x++) {
-            unsigned char b = *row++;
-            unsigned char g = *row++;
-            unsigned char r = *row++;
-            if (term256) {
-                printf(ESC_COLOR256_BG, rgb_to_x256(r, g, b));
-            } else {
-                printf(ESC_COLOR_BG, r, g, b);
+    if (p->opts->term256)
+        return rgb_to_x256(p, bgr[2], bgr[1], bgr[0]);
+    return ((uint32_t)bgr[2] << 16) | (bgr[1] << 8) | bgr[0];
+}
+
+// Compose the frame into p->buffer and return its size. Only cells whose
+// colors differ from what the terminal shows are written.
+static size_t compose_frame(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+    bool half_blocks = p->opts->algo == ALGO_HALF_BLOCKS;
+    const char *glyph = half_blocks ? "\xe2\x96\x84" : " "; // U+2584 (lower half block)
+    const int tx = (vo->dwidth - p->swidth) / 2;
+    const int ty = (vo->dheight - p->sheight) / 2;
+    unsigned char *source = p->frame->planes[0];
+    int stride = p->frame->stride[0];
+
+    char *dst = p->buffer;
+    uint32_t cur_bg = CELL_UNSET, cur_fg = CELL_UNSET;
+    int cursor_x = -1, cursor_y = -1;
+    for (int y = 0; y < p->sheight; y++) {
+        const unsigned char *row_up = source + y * (half_blocks + 1) * stride;
+        const unsigned char *row_down = row_up + stride;
+        uint32_t *cells = p->cells + y * p->swidth * 2;
+        for (int x = 0; x < p->swidth; x++) {
+            uint32_t bg = get_color(p, row_up + x * 3);
+            uint32_t fg = half_blocks ? get_color(p, row_down + x * 3) : 0;
+            if (cells[x * 2 + 0] == bg && cells[x * 2 + 1] == fg)
+                continue;
+            cells[x * 2 + 0] = bg;
+            cells[x * 2 + 1] = fg;
+
+            if (cursor_x != x || cursor_y != y) {
+                dst = append_str(dst, "\e[");
+                dst = append_int(dst, ty + y);
+                *dst++ = ';';
+                dst = append_int(dst, tx + x);
+                *dst++ = 'f';
             }
-            printf(" ");
+            if (bg != cur_bg || (half_blocks && fg != cur_fg)) {
+                dst = append_str(dst, "\e[");
+                if (bg != cur_bg)
+                    dst = append_color(p, dst, false, bg);
+                if (half_blocks && fg != cur_fg) {
+                    if (bg != cur_bg)
+                        *dst++ = ';';
+                    dst = append_color(p, dst, true, fg);
+                }
+                *dst++ = 'm';
+                cur_bg = bg;
+                cur_fg = fg;
+            }
+            dst = append_str(dst, glyph);
+            cursor_x = x + 1;
+            cursor_y = y;
         }
-        printf(ESC_CLEAR_COLORS);
     }
-    printf("\n");
+
+    if (dst != p->buffer) {
+        dst = append_str(dst, ESC_CLEAR_COLORS);
+        // Leave the cursor below the image.
+        dst = append_str(dst, "\e[");
+        dst = append_int(dst, ty + p->sheight);
+        dst = append_str(dst, ";0f");
+    }
+
+    assert(dst - p->buffer <= p->buffer_size);
+    return dst - p->buffer;
 }
 
-static void write_half_blocks(
-    const int dwidth, const int dheight,
-    const int swidth, const int sheight,
-    unsigned char *source, int source_stride,
-    bool term256)
+static void write_all(const char *buf, size_t size)
 {
-    assert(source);
-    const int tx = (dwidth - swidth) / 2;
-    const int ty = (dheight - sheight) / 2;
-    for (int y = 0; y < sheight * 2; y += 2) {
-        const unsigned char *row_up = source + y * source_stride;
-        const unsigned char *row_down = source + (y + 1) * source_stride;
-        printf(ESC_GOTOXY, ty + y / 2, tx);
-        for (int x = 0; x < swidth; x++) {
-            unsigned char b_up = *row_up++;
-            unsigned char g_up = *row_up++;
-            unsigned char r_up = *row_up++;
-            unsigned char b_down = *row_down++;
-            unsigned char g_down = *row_down++;
-            unsigned char r_down = *row_down++;
-            if (term256) {
-                printf(ESC_COLOR256_BG, rgb_to_x256(r_up, g_up, b_up));
-                printf(ESC_COLOR256_FG, rgb_to_x256(r_down, g_down, b_down));
-            } else {
-                printf(ESC_COLOR_BG, r_up, g_up, b_up);
-                printf(ESC_COLOR_FG, r_down, g_down, b_down);
+#if HAVE_POSIX
+    while (size > 0) {
+        ssize_t r = write(STDOUT_FILENO, buf, size);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // Non-blocking stdout: wait until the terminal catches up.
+                struct pollfd fd = { .fd = STDOUT_FILENO, .events = POLLOUT };
+                if (poll(&fd, 1, -1) >= 0 || errno == EINTR)
+                    continue;
             }
-            printf("\xe2\x96\x84");  // UTF8 bytes of U+2584 (lower half block)
+            return;
         }
-        printf(ESC_CLEAR_COLORS);
+        buf += r;
+        size -= r;
     }
-    printf("\n");
+#else
+    fwrite(buf, 1, size, stdout);
+    fflush(stdout);
+#endif
 }
 
 static void get_win_size(struct vo *vo, int *out_width, int *out_height) {
@@ -193,7 +305,18 @@ static void get_win_size(struct vo *vo, int *out_width, int *out_height) {
         *out_height = p->opts->height;
 }
 
-static int reconfig(struct vo *vo, struct mp_image_params *params)
+// Make the next frame write all cells.
+static void invalidate_cells(struct priv *p)
+{
+    size_t cells = (size_t)p->swidth * p->sheight;
+    for (size_t n = 0; n < cells * 2; n++)
+        p->cells[n] = CELL_UNSET;
+    p->last_full_redraw = mp_time_us();
+}
+
+// (Re)initialize everything that depends on the terminal size, and clear the
+// screen, so that the next frame is drawn completely.
+static int resize(struct vo *vo)
 {
     struct priv *p = vo->priv;
 
@@ -204,11 +327,6 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     p->swidth = p->dst.x1 - p->dst.x0;
     p->sheight = p->dst.y1 - p->dst.y0;
 
-    if (p->buffer)
-        free(p->buffer);
-
-    mp_sws_set_from_cmdline(p->sws, vo->global);
-    p->sws->src = *params;
     p->sws->dst = (struct mp_image_params) {
         .imgfmt = IMGFMT,
         .w = p->swidth,
@@ -217,44 +335,76 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
         .p_h = 1,
     };
 
+    // On failure, leave no frame behind, so that nothing is drawn with
+    // buffers of a stale size.
+    TA_FREEP(&p->frame);
+    if (mp_sws_reinit(p->sws) < 0)
+        return -1;
+
     const int mul = (p->opts->algo == ALGO_PLAIN ? 1 : 2);
     p->frame = mp_image_alloc(IMGFMT, p->swidth, p->sheight * mul);
     if (!p->frame)
         return -1;
 
-    if (mp_sws_reinit(p->sws) < 0)
-        return -1;
+    // Worst case per cell: cursor position, both colors, and the glyph.
+    size_t cells = (size_t)p->swidth * p->sheight;
+    p->buffer_size = cells * 64 + 64;
+    talloc_free(p->buffer);
+    p->buffer = talloc_size(p, p->buffer_size);
+    talloc_free(p->cells);
+    p->cells = talloc_array(p, uint32_t, cells * 2);
+    invalidate_cells(p);
 
     printf(ESC_HIDE_CURSOR);
     printf(ESC_CLEAR_SCREEN);
+    fflush(stdout);
     vo->want_redraw = true;
     return 0;
 }
 
+static int reconfig(struct vo *vo, struct mp_image_params *params)
+{
+    struct priv *p = vo->priv;
+
+    mp_sws_set_from_cmdline(p->sws, vo->global);
+    p->sws->src = *params;
+    return resize(vo);
+}
+
 static void draw_image(struct vo *vo, mp_image_t *mpi)
 {
     struct priv *p = vo->priv;
-    struct mp_image src = *mpi;
-    // XXX: pan, crop etc.
-    mp_sws_scale(p->sws, p->frame, &src);
+
+    // The cells written last say nothing about the screen contents after
+    // the terminal was resized, so start over with a full redraw.
+    int width, height;
+    get_win_size(vo, &width, &height);
+    if (width != vo->dwidth || height != vo->dheight)
+        resize(vo);
+
+    if (p->frame) {
+        struct mp_image src = *mpi;
+        // XXX: pan, crop etc.
+        mp_sws_scale(p->sws, p->frame, &src);
+    }
     talloc_free(mpi);
 }
 
 static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
-    if (p->opts->algo == ALGO_PLAIN) {
-        write_plain(
-            vo->dwidth, vo->dheight, p->swidth, p->sheight,
-            p->frame->planes[0], p->frame->stride[0],
-            p->opts->term256);
-    } else {
-        write_half_blocks(
-            vo->dwidth, vo->dheight, p->swidth, p->sheight,
-            p->frame->planes[0], p->frame->stride[0],
-            p->opts->term256);
-    }
-    fflush(stdout);
+    if (!p->frame)
+        return;
+
+    // Log messages may have scrolled the terminal, so redraw everything.
+    uint64_t term_lines = mp_msg_get_term_lines(vo->global);
+    int64_t now = mp_time_us();
+    if (term_lines != p->term_lines ||
+        now - p->last_full_redraw >= FULL_REDRAW_INTERVAL)
+        invalidate_cells(p);
+    p->term_lines = term_lines;
+
+    write_all(p->buffer, compose_frame(vo));
 }
 
 static void uninit(struct vo *vo)
@@ -262,9 +412,8 @@ static void uninit(struct vo *vo)
     printf(ESC_RESTORE_CURSOR);
     printf(ESC_CLEAR_SCREEN);
     printf(ESC_GOTOXY, 0, 0);
+    fflush(stdout);
     struct priv *p = vo->priv;
-    if (p->buffer)
-        talloc_free(p->buffer);
     if (p->sws)
         talloc_free(p->sws);
 }
@@ -278,6 +427,7 @@ static int preinit(struct vo *vo)
     struct priv *p = vo->priv;
     p->opts = mp_get_config_group(vo, vo->global, &vo_tct_conf);
     p->sws = mp_sws_alloc(vo);
+    init_tables(p);
     return 0;
 }
 
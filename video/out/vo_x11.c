@@ -56,6 +56,14 @@ struct priv {
 
     struct mp_image *original_image;
 
+    // For redrawing the same frame with changed OSD: the scaled
+    // original_image without OSD, the OSD state of each X image, and the
+    // areas of the X image that need to be sent to the server (-1: all).
+    struct mp_image *clean_image;
+    struct osd_damage *damage[2];
+    struct mp_rect put_rc[OSD_DAMAGE_MAX_RECTS];
+    int num_put_rc;
+
     XImage *myximage[2];
     int depth;
     GC gc;
@@ -199,8 +207,11 @@ static bool resize(struct vo *vo)
 {
     struct priv *p = vo->priv;
 
-    for (int i = 0; i < 2; i++)
+    for (int i = 0; i < 2; i++) {
         freeMyXImage(p, i);
+        osd_damage_reset(p->damage[i]);
+    }
+    mp_image_unrefp(&p->clean_image);
 
     vo_get_src_dst_rects(vo, &p->src, &p->dst, &p->osd);
 
@@ -262,6 +273,22 @@ static bool resize(struct vo *vo)
     return true;
 }
 
+static void put_image_rect(struct priv *p, XImage *x_image, struct mp_rect rc)
+{
+    struct vo *vo = p->vo;
+    int w = rc.x1 - rc.x0, h = rc.y1 - rc.y0;
+
+    if (p->Shmem_Flag) {
+        XShmPutImage(vo->x11->display, vo->x11->window, p->gc, x_image,
+                     rc.x0, rc.y0, p->dst.x0 + rc.x0, p->dst.y0 + rc.y0, w, h,
+                     True);
+        vo->x11->ShmCompletionWaitCount++;
+    } else {
+        XPutImage(vo->x11->display, vo->x11->window, p->gc, x_image,
+                  rc.x0, rc.y0, p->dst.x0 + rc.x0, p->dst.y0 + rc.y0, w, h);
+    }
+}
+
 static void Display_Image(struct priv *p, XImage *myximage)
 {
     struct vo *vo = p->vo;
@@ -271,16 +298,14 @@ static void Display_Image(struct priv *p, XImage *myximage)
     if (p->reset_view) {
         XFillRectangle(vo->x11->display, vo->x11->window, p->gc, 0, 0, vo->dwidth, vo->dheight);
         p->reset_view = false;
+        p->num_put_rc = -1;
     }
 
-    if (p->Shmem_Flag) {
-        XShmPutImage(vo->x11->display, vo->x11->window, p->gc, x_image,
-                     0, 0, p->dst.x0, p->dst.y0, p->dst_w, p->dst_h,
-                     True);
-        vo->x11->ShmCompletionWaitCount++;
+    if (p->num_put_rc < 0) {
+        put_image_rect(p, x_image, (struct mp_rect){0, 0, p->dst_w, p->dst_h});
     } else {
-        XPutImage(vo->x11->display, vo->x11->window, p->gc, x_image,
-                  0, 0, p->dst.x0, p->dst.y0, p->dst_w, p->dst_h);
+        for (int n = 0; n < p->num_put_rc; n++)
+            put_image_rect(p, x_image, p->put_rc[n]);
     }
 }
 
@@ -320,15 +345,9 @@ static void flip_page(struct vo *vo)
     p->current_buf = (p->current_buf + 1) % 2;
 }
 
-// Note: REDRAW_FRAME can call this with NULL.
-static void draw_image(struct vo *vo, mp_image_t *mpi)
+static void scale_image(struct priv *p, struct mp_image *dst,
+                        struct mp_image *mpi)
 {
-    struct priv *p = vo->priv;
-
-    wait_for_completion(vo, 1);
-
-    struct mp_image img = get_x_buffer(p, p->current_buf);
-
     if (mpi) {
         struct mp_image src = *mpi;
         struct mp_rect src_rc = p->src;
@@ -336,12 +355,66 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
         src_rc.y0 = MP_ALIGN_DOWN(src_rc.y0, src.fmt.align_y);
         mp_image_crop_rc(&src, src_rc);
 
-        mp_sws_scale(p->sws, &img, &src);
+        mp_sws_scale(p->sws, dst, &src);
+    } else {
+        mp_image_clear(dst, 0, 0, dst->w, dst->h);
+    }
+}
+
+struct restore_closure {
+    struct mp_image *dst, *clean;
+};
+
+static void restore_clean(void *ctx, struct mp_rect rc)
+{
+    struct restore_closure *c = ctx;
+    struct mp_image dst = *c->dst, clean = *c->clean;
+    mp_image_crop_rc(&dst, rc);
+    mp_image_crop_rc(&clean, rc);
+    mp_image_copy(&dst, &clean);
+}
+
+// Note: REDRAW_FRAME can call this with NULL.
+static void draw_image(struct vo *vo, mp_image_t *mpi)
+{
+    struct priv *p = vo->priv;
+    bool redraw = mpi == p->original_image;
+
+    if (redraw) {
+        // Update the X image that is on screen, so that only the areas where
+        // the OSD changed need to be sent to the server.
+        wait_for_completion(vo, 0);
+        p->current_buf = (p->current_buf + 1) % 2;
     } else {
-        mp_image_clear(&img, 0, 0, img.w, img.h);
+        wait_for_completion(vo, 1);
+    }
+
+    struct mp_image img = get_x_buffer(p, p->current_buf);
+    struct osd_damage *damage = p->damage[p->current_buf];
+    double pts = mpi ? mpi->pts : 0;
+
+    if (redraw && !p->clean_image) {
+        p->clean_image = mp_image_alloc(p->sws->dst.imgfmt, p->dst_w, p->dst_h);
+        if (p->clean_image) {
+            mp_image_set_params(p->clean_image, &p->sws->dst);
+            scale_image(p, p->clean_image, mpi);
+        }
     }
 
-    osd_draw_on_image(vo->osd, p->osd, mpi ? mpi->pts : 0, 0, &img);
+    if (redraw && p->clean_image) {
+        struct restore_closure ctx = {&img, p->clean_image};
+        p->num_put_rc = osd_draw_on_image_damage(vo->osd, p->osd, pts, 0, &img,
+                                                 damage, restore_clean, &ctx,
+                                                 p->put_rc);
+    } else {
+        scale_image(p, &img, mpi);
+        for (int i = 0; i < 2; i++)
+            osd_damage_reset(p->damage[i]);
+        osd_draw_on_image_damage(vo->osd, p->osd, pts, 0, &img, damage,
+                                 NULL, NULL, p->put_rc);
+        p->num_put_rc = -1;
+        mp_image_unrefp(&p->clean_image);
+    }
 
     if (mpi != p->original_image) {
         talloc_free(p->original_image);
@@ -367,6 +440,7 @@ static void uninit(struct vo *vo)
         XFreeGC(vo->x11->display, p->gc);
 
     talloc_free(p->original_image);
+    talloc_free(p->clean_image);
 
     vo_x11_uninit(vo);
 }
@@ -376,6 +450,8 @@ static int preinit(struct vo *vo)
     struct priv *p = vo->priv;
     p->vo = vo;
     p->sws = mp_sws_alloc(vo);
+    for (int i = 0; i < 2; i++)
+        p->damage[i] = osd_damage_create(p);
 
     if (!vo_x11_init(vo))
         goto error;
@@ -16,6 +16,7 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
 
 #include <libswscale/swscale.h>
 #include <libavcodec/avcodec.h>
@@ -34,6 +35,7 @@
 #include "fmt-conversion.h"
 #include "csputils.h"
 #include "common/msg.h"
+#include "misc/thread_pool.h"
 #include "osdep/endian.h"
 
 //global sws_flags from the command line
@@ -45,6 +47,7 @@ struct sws_opts {
     int chr_hshift;
     float chr_sharpen;
     float lum_sharpen;
+    int threads;
 };
 
 #define OPT_BASE_STRUCT struct sws_opts
@@ -68,11 +71,13 @@ const struct m_sub_options sws_conf = {
         OPT_INT("chs", chr_hshift, 0),
         OPT_FLOATRANGE("ls", lum_sharpen, 0, -100.0, 100.0),
         OPT_FLOATRANGE("cs", chr_sharpen, 0, -100.0, 100.0),
+        OPT_INTRANGE("threads", threads, 0, 1, MP_SWS_MAX_THREADS),
         {0}
     },
     .size = sizeof(struct sws_opts),
     .defaults = &(const struct sws_opts){
         .scaler = SWS_BICUBIC,
+        .threads = 1,
     },
 };
 
@@ -97,6 +102,7 @@ void mp_sws_set_from_cmdline(struct mp_sws_context *ctx, struct mpv_global *g)
 
     ctx->flags = SWS_PRINT_INFO;
     ctx->flags |= opts->scaler;
+    ctx->threads = opts->threads;
 
     talloc_free(opts);
 }
@@ -126,12 +132,95 @@ static bool cache_valid(struct mp_sws_context *ctx)
            ctx->flags == old->flags &&
            ctx->brightness == old->brightness &&
            ctx->contrast == old->contrast &&
-           ctx->saturation == old->saturation;
+           ctx->saturation == old->saturation &&
+           ctx->threads == old->threads;
+}
+
+// A horizontal band of the image, converted by its own SwsContext.
+struct mp_sws_slice {
+    struct SwsContext *sws;
+    // Rows written to the destination image.
+    int y0, y1;
+    // Rows actually converted. If this is larger than y0/y1, the conversion
+    // goes to the scratch image, and only y0/y1 is copied to the destination.
+    int pad_y0, pad_y1;
+    struct mp_image *scratch;
+    struct slice_batch *batch;
+};
+
+// Worker threads shared by all contexts in the process, so that several
+// scalers in a pipeline don't each start their own set of threads.
+struct mp_sws_pool {
+    struct mp_thread_pool *pool;
+    int threads;
+    int refs;                   // protected by pool_lock
+};
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+// Pool handed out to new users. If a user needs more threads, it's replaced
+// with a larger pool, and the old one lives on until its last user is gone.
+static struct mp_sws_pool *shared_pool;
+
+// Return a reference to a pool with at least the given number of threads.
+// Returns NULL if the threads could not be created.
+static struct mp_sws_pool *acquire_pool(int threads)
+{
+    pthread_mutex_lock(&pool_lock);
+    struct mp_sws_pool *p = shared_pool;
+    if (!p || p->threads < threads) {
+        p = talloc_zero(NULL, struct mp_sws_pool);
+        p->threads = threads;
+        p->pool = mp_thread_pool_create(p, threads);
+        if (p->pool) {
+            shared_pool = p;
+        } else {
+            TA_FREEP(&p);
+        }
+    }
+    if (p)
+        p->refs += 1;
+    pthread_mutex_unlock(&pool_lock);
+    return p;
+}
+
+// Drop a reference; the threads are stopped when the pool becomes unused.
+static void release_pool(struct mp_sws_pool *p)
+{
+    if (!p)
+        return;
+    pthread_mutex_lock(&pool_lock);
+    assert(p->refs > 0);
+    p->refs -= 1;
+    bool unused = !p->refs;
+    if (unused && shared_pool == p)
+        shared_pool = NULL;
+    pthread_mutex_unlock(&pool_lock);
+    // Nobody can acquire it anymore, so join the threads outside of the lock.
+    if (unused)
+        talloc_free(p);
+}
+
+// State for a single mp_sws_scale() call.
+struct slice_batch {
+    struct mp_image *src, *dst;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int pending;
+};
+
+static void free_slices(struct mp_sws_context *ctx)
+{
+    for (int n = 0; n < ctx->num_slices; n++)
+        sws_freeContext(ctx->slices[n].sws);
+    TA_FREEP(&ctx->slices);
+    ctx->num_slices = 0;
 }
 
 static void free_mp_sws(void *p)
 {
     struct mp_sws_context *ctx = p;
+    free_slices(ctx);
+    release_pool(ctx->pool);
     sws_freeContext(ctx->sws);
     sws_freeFilter(ctx->src_filter);
     sws_freeFilter(ctx->dst_filter);
@@ -155,45 +244,33 @@ struct mp_sws_context *mp_sws_alloc(void *talloc_ctx)
     return ctx;
 }
 
-// Reinitialize (if needed) - return error code.
-// Optional, but possibly useful to avoid having to handle mp_sws_scale errors.
-int mp_sws_reinit(struct mp_sws_context *ctx)
+// Create a SwsContext converting images with the given parameters, using the
+// other settings from ctx. Returns NULL on failure.
+static struct SwsContext *create_sws(struct mp_sws_context *ctx,
+                                     struct mp_image_params *src,
+                                     struct mp_image_params *dst)
 {
-    struct mp_image_params *src = &ctx->src;
-    struct mp_image_params *dst = &ctx->dst;
-
-    // Neutralize unsupported or ignored parameters.
-    src->p_w = dst->p_w = 0;
-    src->p_h = dst->p_h = 0;
-
-    if (cache_valid(ctx))
-        return 0;
-
-    sws_freeContext(ctx->sws);
-    ctx->sws = sws_alloc_context();
-    if (!ctx->sws)
-        return -1;
-
-    mp_image_params_guess_csp(src); // sanitize colorspace/colorlevels
-    mp_image_params_guess_csp(dst);
+    struct SwsContext *sws = sws_alloc_context();
+    if (!sws)
+        return NULL;
 
     struct mp_imgfmt_desc src_fmt = mp_imgfmt_get_desc(src->imgfmt);
     struct mp_imgfmt_desc dst_fmt = mp_imgfmt_get_desc(dst->imgfmt);
     if (!src_fmt.id || !dst_fmt.id)
-        return -1;
+        goto error;
 
     enum AVPixelFormat s_fmt = imgfmt2pixfmt(src->imgfmt);
     if (s_fmt == AV_PIX_FMT_NONE || sws_isSupportedInput(s_fmt) < 1) {
         MP_ERR(ctx, "Input image format %s not supported by libswscale.\n",
                mp_imgfmt_to_name(src->imgfmt));
-        return -1;
+        goto error;
     }
 
     enum AVPixelFormat d_fmt = imgfmt2pixfmt(dst->imgfmt);
     if (d_fmt == AV_PIX_FMT_NONE || sws_isSupportedOutput(d_fmt) < 1) {
         MP_ERR(ctx, "Output image format %s not supported by libswscale.\n",
                mp_imgfmt_to_name(dst->imgfmt));
-        return -1;
+        goto error;
     }
 
     int s_csp = mp_csp_to_sws_colorspace(src->color.space);
@@ -208,49 +285,257 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
     s_range = s_range && (src_fmt.flags & MP_IMGFLAG_YUV);
     d_range = d_range && (dst_fmt.flags & MP_IMGFLAG_YUV);
 
-    av_opt_set_int(ctx->sws, "sws_flags", ctx->flags, 0);
+    av_opt_set_int(sws, "sws_flags", ctx->flags, 0);
 
-    av_opt_set_int(ctx->sws, "srcw", src->w, 0);
-    av_opt_set_int(ctx->sws, "srch", src->h, 0);
-    av_opt_set_int(ctx->sws, "src_format", s_fmt, 0);
+    av_opt_set_int(sws, "srcw", src->w, 0);
+    av_opt_set_int(sws, "srch", src->h, 0);
+    av_opt_set_int(sws, "src_format", s_fmt, 0);
 
-    av_opt_set_int(ctx->sws, "dstw", dst->w, 0);
-    av_opt_set_int(ctx->sws, "dsth", dst->h, 0);
-    av_opt_set_int(ctx->sws, "dst_format", d_fmt, 0);
+    av_opt_set_int(sws, "dstw", dst->w, 0);
+    av_opt_set_int(sws, "dsth", dst->h, 0);
+    av_opt_set_int(sws, "dst_format", d_fmt, 0);
 
-    av_opt_set_double(ctx->sws, "param0", ctx->params[0], 0);
-    av_opt_set_double(ctx->sws, "param1", ctx->params[1], 0);
+    av_opt_set_double(sws, "param0", ctx->params[0], 0);
+    av_opt_set_double(sws, "param1", ctx->params[1], 0);
 
 #if LIBAVCODEC_VERSION_MICRO >= 100
     int cr_src = mp_chroma_location_to_av(src->chroma_location);
     int cr_dst = mp_chroma_location_to_av(dst->chroma_location);
     int cr_xpos, cr_ypos;
     if (avcodec_enum_to_chroma_pos(&cr_xpos, &cr_ypos, cr_src) >= 0) {
-        av_opt_set_int(ctx->sws, "src_h_chr_pos", cr_xpos, 0);
-        av_opt_set_int(ctx->sws, "src_v_chr_pos", cr_ypos, 0);
+        av_opt_set_int(sws, "src_h_chr_pos", cr_xpos, 0);
+        av_opt_set_int(sws, "src_v_chr_pos", cr_ypos, 0);
     }
     if (avcodec_enum_to_chroma_pos(&cr_xpos, &cr_ypos, cr_dst) >= 0) {
-        av_opt_set_int(ctx->sws, "dst_h_chr_pos", cr_xpos, 0);
-        av_opt_set_int(ctx->sws, "dst_v_chr_pos", cr_ypos, 0);
+        av_opt_set_int(sws, "dst_h_chr_pos", cr_xpos, 0);
+        av_opt_set_int(sws, "dst_v_chr_pos", cr_ypos, 0);
     }
 #endif
 
     // This can fail even with normal operation, e.g. if a conversion path
     // simply does not support these settings.
     int r =
-        sws_setColorspaceDetails(ctx->sws, sws_getCoefficients(s_csp), s_range,
+        sws_setColorspaceDetails(sws, sws_getCoefficients(s_csp), s_range,
                                  sws_getCoefficients(d_csp), d_range,
                                  ctx->brightness, ctx->contrast, ctx->saturation);
     ctx->supports_csp = r >= 0;
 
-    if (sws_init_context(ctx->sws, ctx->src_filter, ctx->dst_filter) < 0)
+    if (sws_init_context(sws, ctx->src_filter, ctx->dst_filter) < 0)
+        goto error;
+
+    return sws;
+
+error:
+    sws_freeContext(sws);
+    return NULL;
+}
+
+// Slice boundaries are aligned to this. This is a multiple of the chroma
+// subsampling of all formats, and of the period of libswscale's ordered
+// dither matrices, so that each slice produces the same pixels as a
+// conversion of the whole image would.
+#define SLICE_ALIGN 16
+// Extra rows converted around each slice if the vertical filter needs context
+// from neighboring rows (see mp_sws_slice.pad_y0). Multiple of SLICE_ALIGN.
+#define SLICE_PAD 16
+#define SLICE_MIN_H 64
+
+static bool filter_is_vertical(SwsFilter *f)
+{
+    return f && ((f->lumV && f->lumV->length > 1) ||
+                 (f->chrV && f->chrV->length > 1));
+}
+
+// Return the number of slices the current conversion can be split into, or 0
+// if it has to be done in one go.
+static int get_num_slices(struct mp_sws_context *ctx)
+{
+    struct mp_image_params *src = &ctx->src;
+    struct mp_image_params *dst = &ctx->dst;
+
+    if (ctx->threads < 2)
+        return 0;
+
+    // Vertical scaling makes each output row depend on a range of input rows
+    // with a position that can't be expressed with per-slice contexts.
+    // Horizontal scaling is fine.
+    if (src->h != dst->h)
+        return 0;
+
+    if (filter_is_vertical(ctx->src_filter) || filter_is_vertical(ctx->dst_filter))
+        return 0;
+
+    struct mp_imgfmt_desc src_fmt = mp_imgfmt_get_desc(src->imgfmt);
+    struct mp_imgfmt_desc dst_fmt = mp_imgfmt_get_desc(dst->imgfmt);
+    if ((src_fmt.flags | dst_fmt.flags) & MP_IMGFLAG_PAL)
+        return 0;
+
+    return MPMIN(ctx->threads, dst->h / SLICE_MIN_H);
+}
+
+static bool init_slices(struct mp_sws_context *ctx)
+{
+    free_slices(ctx);
+
+    int num = get_num_slices(ctx);
+    if (num < 2) {
+        release_pool(ctx->pool);
+        ctx->pool = NULL;
+        return true;
+    }
+
+    struct mp_imgfmt_desc src_fmt = mp_imgfmt_get_desc(ctx->src.imgfmt);
+    struct mp_imgfmt_desc dst_fmt = mp_imgfmt_get_desc(ctx->dst.imgfmt);
+
+    // If the vertical chroma resolution or position changes, chroma is
+    // resampled vertically, which reads neighboring rows. Convert some extra
+    // rows around each slice to get the same result at the slice borders.
+    bool need_pad = src_fmt.chroma_ys != dst_fmt.chroma_ys ||
+                    (src_fmt.chroma_ys &&
+                     ctx->src.chroma_location != ctx->dst.chroma_location);
+
+    int h = ctx->dst.h;
+    ctx->slices = talloc_zero_array(ctx, struct mp_sws_slice, num);
+    ctx->num_slices = num;
+    for (int n = 0; n < num; n++) {
+        struct mp_sws_slice *slice = &ctx->slices[n];
+        slice->y0 = n ? ctx->slices[n - 1].y1 : 0;
+        slice->y1 = n == num - 1 ? h : h * (n + 1) / num / SLICE_ALIGN * SLICE_ALIGN;
+        slice->pad_y0 = slice->y0;
+        slice->pad_y1 = slice->y1;
+        if (need_pad) {
+            slice->pad_y0 = MPMAX(slice->y0 - SLICE_PAD, 0);
+            slice->pad_y1 = MPMIN(slice->y1 + SLICE_PAD, h);
+        }
+
+        struct mp_image_params src = ctx->src, dst = ctx->dst;
+        src.h = dst.h = slice->pad_y1 - slice->pad_y0;
+        slice->sws = create_sws(ctx, &src, &dst);
+        if (!slice->sws)
+            goto error;
+
+        if (need_pad) {
+            slice->scratch = mp_image_alloc(dst.imgfmt, dst.w, dst.h);
+            if (!slice->scratch)
+                goto error;
+            talloc_steal(ctx->slices, slice->scratch);
+        }
+    }
+
+    // Keep the current pool if it's large enough, so that reinitializing
+    // the only user of a pool doesn't restart the threads.
+    if (!ctx->pool || ctx->pool->threads < num - 1) {
+        struct mp_sws_pool *pool = acquire_pool(num - 1);
+        if (!pool)
+            goto error;
+        release_pool(ctx->pool);
+        ctx->pool = pool;
+    }
+
+    MP_VERBOSE(ctx, "Using %d slices%s.\n", num, need_pad ? " (padded)" : "");
+    return true;
+
+error:
+    free_slices(ctx);
+    return false;
+}
+
+// Reinitialize (if needed) - return error code.
+// Optional, but possibly useful to avoid having to handle mp_sws_scale errors.
+int mp_sws_reinit(struct mp_sws_context *ctx)
+{
+    struct mp_image_params *src = &ctx->src;
+    struct mp_image_params *dst = &ctx->dst;
+
+    // Neutralize unsupported or ignored parameters.
+    src->p_w = dst->p_w = 0;
+    src->p_h = dst->p_h = 0;
+
+    if (cache_valid(ctx))
+        return 0;
+
+    free_slices(ctx);
+    sws_freeContext(ctx->sws);
+
+    mp_image_params_guess_csp(src); // sanitize colorspace/colorlevels
+    mp_image_params_guess_csp(dst);
+
+    ctx->sws = create_sws(ctx, src, dst);
+    if (!ctx->sws)
         return -1;
 
+    // On failure, fall back to converting the whole image on one thread.
+    if (!init_slices(ctx))
+        MP_WARN(ctx, "Could not set up slice-parallel conversion.\n");
+
     ctx->force_reload = false;
     *ctx->cached = *ctx;
     return 1;
 }
 
+static void scale_slice(struct mp_sws_slice *slice)
+{
+    struct slice_batch *batch = slice->batch;
+
+    struct mp_image src = *batch->src;
+    mp_image_crop(&src, 0, slice->pad_y0, src.w, slice->pad_y1);
+
+    struct mp_image dst = *batch->dst;
+    mp_image_crop(&dst, 0, slice->y0, dst.w, slice->y1);
+
+    struct mp_image *out = slice->scratch ? slice->scratch : &dst;
+    sws_scale(slice->sws, (const uint8_t *const *) src.planes, src.stride,
+              0, src.h, out->planes, out->stride);
+
+    if (slice->scratch) {
+        struct mp_image area = *slice->scratch;
+        mp_image_crop(&area, 0, slice->y0 - slice->pad_y0, area.w,
+                      slice->y1 - slice->pad_y0);
+        mp_image_copy(&dst, &area);
+    }
+}
+
+static void slice_worker(void *p)
+{
+    struct mp_sws_slice *slice = p;
+    struct slice_batch *batch = slice->batch;
+
+    scale_slice(slice);
+
+    pthread_mutex_lock(&batch->lock);
+    batch->pending -= 1;
+    pthread_cond_signal(&batch->wakeup);
+    pthread_mutex_unlock(&batch->lock);
+}
+
+static void scale_slices(struct mp_sws_context *ctx, struct mp_image *dst,
+                         struct mp_image *src)
+{
+    struct slice_batch batch = {
+        .src = src,
+        .dst = dst,
+        .pending = ctx->num_slices - 1,
+    };
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.wakeup, NULL);
+
+    for (int n = 0; n < ctx->num_slices; n++)
+        ctx->slices[n].batch = &batch;
+
+    // The first slice is done on the calling thread.
+    for (int n = 1; n < ctx->num_slices; n++)
+        mp_thread_pool_queue(ctx->pool->pool, slice_worker, &ctx->slices[n]);
+    scale_slice(&ctx->slices[0]);
+
+    pthread_mutex_lock(&batch.lock);
+    while (batch.pending)
+        pthread_cond_wait(&batch.wakeup, &batch.lock);
+    pthread_mutex_unlock(&batch.lock);
+
+    pthread_cond_destroy(&batch.wakeup);
+    pthread_mutex_destroy(&batch.lock);
+}
+
 // Scale from src to dst - if src/dst have different parameters from previous
 // calls, the context is reinitialized. Return error code. (It can fail if
 // reinitialization was necessary, and swscale returned an error.)
@@ -266,8 +551,12 @@ int mp_sws_scale(struct mp_sws_context *ctx, struct mp_image *dst,
         return r;
     }
 
-    sws_scale(ctx->sws, (const uint8_t *const *) src->planes, src->stride,
-              0, src->h, dst->planes, dst->stride);
+    if (ctx->num_slices) {
+        scale_slices(ctx, dst, src);
+    } else {
+        sws_scale(ctx->sws, (const uint8_t *const *) src->planes, src->stride,
+                  0, src->h, dst->planes, dst->stride);
+    }
     return 0;
 }
 
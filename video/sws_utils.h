@@ -13,6 +13,8 @@ struct mpv_global;
 // Guaranteed to be a power of 2 and > 1.
 #define SWS_MIN_BYTE_ALIGN 16
 
+#define MP_SWS_MAX_THREADS 64
+
 extern const int mp_sws_hq_flags;
 extern const int mp_sws_fast_flags;
 
@@ -31,6 +33,9 @@ struct mp_sws_context {
     // mp_sws_scale() will handle the changes transparently.
     int flags;
     int brightness, contrast, saturation;
+    // If >1, split the conversion into horizontal slices, which are converted
+    // in parallel. Only done if there is no vertical scaling.
+    int threads;
     bool force_reload;
     // These are also implicitly set by mp_sws_scale(), and thus optional.
     // Setting them before that call makes sense when using mp_sws_reinit().
@@ -48,6 +53,11 @@ struct mp_sws_context {
 
     // Contains parameters for which sws is valid
     struct mp_sws_context *cached;
+
+    // Slice-parallel conversion (if threads > 1)
+    struct mp_sws_slice *slices;
+    int num_slices;
+    struct mp_sws_pool *pool;
 };
 
 struct mp_sws_context *mp_sws_alloc(void *talloc_ctx);
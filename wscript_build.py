@@ -230,6 +230,7 @@ def build(ctx):
         ( "audio/filter/af_scaletempo.c" ),
         ( "audio/fmt-conversion.c" ),
         ( "audio/format.c" ),
+        ( "audio/loudness.c" ),
         ( "audio/out/ao.c" ),
         ( "audio/out/ao_alsa.c",                 "alsa" ),
         ( "audio/out/ao_audiounit.m",            "audiounit" ),
@@ -256,6 +257,7 @@ def build(ctx):
         ( "audio/out/ao_wasapi_utils.c",         "wasapi" ),
         ( "audio/out/pull.c" ),
         ( "audio/out/push.c" ),
+        ( "audio/sample_conv.c" ),
 
         ## Core
         ( "common/av_common.c" ),
@@ -346,8 +348,10 @@ def build(ctx):
         ( "player/misc.c" ),
         ( "player/osd.c" ),
         ( "player/playloop.c" ),
+        ( "player/replaygain_scan.c" ),
         ( "player/screenshot.c" ),
         ( "player/scripting.c" ),
+        ( "player/storyboard.c" ),
         ( "player/sub.c" ),
         ( "player/video.c" ),
 
@@ -404,6 +408,7 @@ def build(ctx):
         ( "video/decode/vd_lavc.c" ),
         ( "video/filter/refqueue.c" ),
         ( "video/filter/vf_d3d11vpp.c",          "d3d-hwaccel" ),
+        ( "video/filter/vf_dedup.c" ),
         ( "video/filter/vf_format.c" ),
         ( "video/filter/vf_sub.c" ),
         ( "video/filter/vf_vapoursynth.c",       "vapoursynth-core" ),